@@ -0,0 +1,88 @@
+/* patomic.h - Atomic operations shared by the lock free structures
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ATOMIC_H
+#define __ATOMIC_H
+
+/*
+* Load has acquire semantics, store has release semantics,
+* read-modify-write operations are sequentially consistent.
+* Add and Sub return the new value, Exchange returns the old value,
+* Cas returns 1 when the swap took place.
+* Suffix 32 works on volatile long / int, 64 on volatile long long, Ptr on void*.
+*/
+#if defined(_MSC_VER)
+#include <windows.h>
+
+#define plg_AtomicLoad32(p) InterlockedCompareExchange((volatile long*)(p), 0, 0)
+#define plg_AtomicStore32(p, v) InterlockedExchange((volatile long*)(p), (long)(v))
+#define plg_AtomicAdd32(p, v) (InterlockedExchangeAdd((volatile long*)(p), (long)(v)) + (long)(v))
+#define plg_AtomicSub32(p, v) (InterlockedExchangeAdd((volatile long*)(p), -(long)(v)) - (long)(v))
+#define plg_AtomicExchange32(p, v) InterlockedExchange((volatile long*)(p), (long)(v))
+#define plg_AtomicCas32(p, o, n) (InterlockedCompareExchange((volatile long*)(p), (long)(n), (long)(o)) == (long)(o))
+
+#define plg_AtomicLoad64(p) InterlockedCompareExchange64((volatile long long*)(p), 0, 0)
+#define plg_AtomicStore64(p, v) InterlockedExchange64((volatile long long*)(p), (long long)(v))
+#define plg_AtomicAdd64(p, v) (InterlockedExchangeAdd64((volatile long long*)(p), (long long)(v)) + (long long)(v))
+#define plg_AtomicSub64(p, v) (InterlockedExchangeAdd64((volatile long long*)(p), -(long long)(v)) - (long long)(v))
+#define plg_AtomicExchange64(p, v) InterlockedExchange64((volatile long long*)(p), (long long)(v))
+#define plg_AtomicCas64(p, o, n) (InterlockedCompareExchange64((volatile long long*)(p), (long long)(n), (long long)(o)) == (long long)(o))
+
+#define plg_AtomicLoadPtr(p) InterlockedCompareExchangePointer((void* volatile*)(p), 0, 0)
+#define plg_AtomicStorePtr(p, v) InterlockedExchangePointer((void* volatile*)(p), (void*)(v))
+#define plg_AtomicExchangePtr(p, v) InterlockedExchangePointer((void* volatile*)(p), (void*)(v))
+#define plg_AtomicCasPtr(p, o, n) (InterlockedCompareExchangePointer((void* volatile*)(p), (void*)(n), (void*)(o)) == (void*)(o))
+
+#define plg_AtomicPause() YieldProcessor()
+
+#else
+
+#define plg_AtomicLoad32(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define plg_AtomicStore32(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define plg_AtomicAdd32(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define plg_AtomicSub32(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define plg_AtomicExchange32(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define plg_AtomicCas32(p, o, n) plg_AtomicCasN((p), (o), (n))
+
+#define plg_AtomicLoad64 plg_AtomicLoad32
+#define plg_AtomicStore64 plg_AtomicStore32
+#define plg_AtomicAdd64 plg_AtomicAdd32
+#define plg_AtomicSub64 plg_AtomicSub32
+#define plg_AtomicExchange64 plg_AtomicExchange32
+#define plg_AtomicCas64 plg_AtomicCas32
+
+#define plg_AtomicLoadPtr plg_AtomicLoad32
+#define plg_AtomicStorePtr plg_AtomicStore32
+#define plg_AtomicExchangePtr plg_AtomicExchange32
+#define plg_AtomicCasPtr plg_AtomicCas32
+
+#define plg_AtomicCasN(p, o, n) __extension__({\
+	__typeof__(o) _expected = (o);\
+	__atomic_compare_exchange_n((p), &_expected, (n), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);\
+})
+
+#if defined(__i386__) || defined(__x86_64__)
+#define plg_AtomicPause() __builtin_ia32_pause()
+#else
+#define plg_AtomicPause() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#endif
+
+#endif
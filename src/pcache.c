@@ -42,6 +42,7 @@
 #include "pdictexten.h"
 #include "ptimesys.h"
 #include "pjson.h"
+#include "patomic.h"
 
 /*
 When it comes to transaction, the transaction to delete a page must be submitted immediately, otherwise the address of the page in the file will be wrong
@@ -55,7 +56,8 @@ pageDirty:dirty pages
 listDictTableHandle:table header data cache
 dictTableHandleDirty:tableͷݻ¼
 //transaction
-transaction_listDictPageCache:еҳ
+transaction_pageUndo:pages changed in place by the transaction, see PageUndoState
+undoLog:undo records of the transaction, see PageUndoRecord
 transaction_pageDirty:еҳ
 transaction_listDictTableHandle:еͷݻ
 transaction_dictTableHandleDirty:еͷ
@@ -79,15 +81,93 @@ typedef struct _CacheHandle
 	dict* dictTableHandleDirty;
 	dict* delPage;
 	//transaction
-	ListDict* transaction_listDictPageCache;
 	ListDict* transaction_listDictTableInFile;
 	dict* transaction_createPage;
 	dict* transaction_delPage;
+	dict* transaction_pageUndo;
+	unsigned char* undoLog;
+	unsigned int undoLength;
+	unsigned int undoSize;
+#ifdef CACHE_UNDOCHECK
+	dict* transaction_undoCheck;
+#endif
 
 	void* memoryListPage;
 	void* memoryListTable;
+	//buffer pool
+	dict* pageFlushing;
+	list* listFlushing;
+	unsigned char evictCheck;
 } *PCacheHandle, CacheHandle;
 
+/*
+Transactions change the pages of the cache in place.
+Before a write the old bytes go to the undo log, rollback puts them back from the newest record to the oldest
+and commit only drops the log.
+prevPage: log offset + 1 of the previous record of the same page, 0 is none.
+The length old bytes follow the record.
+*/
+typedef struct _PageUndoRecord
+{
+	unsigned int pageAddr;
+	unsigned int offset;
+	unsigned int length;
+	unsigned int prevPage;
+} *PPageUndoRecord, PageUndoRecord;
+
+/*
+lastRecord:log offset + 1 of the newest record of the page
+undoBytes:old bytes logged for the page
+image:past half a page the whole page is kept once in a pool buffer, the records of the page are older than it.
+rollback installs it in listPageCache in place of the changed page, commit gives it back to the pool.
+view:the page as committed, built for readers that do not see the transaction
+*/
+typedef struct _PageUndoState
+{
+	unsigned int pageAddr;
+	unsigned int lastRecord;
+	unsigned int undoBytes;
+	void* image;
+	void* view;
+} *PPageUndoState, PageUndoState;
+
+/*
+Buffer pool shared by all caches of the process.
+cache_resident counts the bytes of the pages of every cache, when it is over cache_budget
+each cache evicts its own clean pages with a clock hand, see cache_Evict.
+A budget of zero keeps the old eviction by age in cache_Arrange.
+*/
+static unsigned long long cache_budget = 0;
+static unsigned long long cache_resident = 0;
+static unsigned long long cache_evict = 0;
+
+static void* cache_PagePop(PCacheHandle pCacheHandle) {
+	plg_AtomicAdd64(&cache_resident, (unsigned long long)FULLSIZE(pCacheHandle->pageSize));
+	pCacheHandle->evictCheck = 1;
+	return plg_MemListPop(pCacheHandle->memoryListPage);
+}
+
+static void cache_PagePush(PCacheHandle pCacheHandle, void* page) {
+	plg_AtomicSub64(&cache_resident, (unsigned long long)FULLSIZE(pCacheHandle->pageSize));
+	plg_MemListPush(pCacheHandle->memoryListPage, page);
+}
+
+/*
+The file thread writes the flushed pages straight from the cache, pageFlushing maps their address to the slot of the flush.
+Before a page still queued is changed or freed the file thread is given its own copy,
+so only pages changed in flight are copied.
+*/
+static void cache_FlushingDetach(PCacheHandle pCacheHandle, unsigned int* pageAddr) {
+
+	if (dictSize(pCacheHandle->pageFlushing) == 0) {
+		return;
+	}
+	dictEntry* entry = plg_dictFind(pCacheHandle->pageFlushing, pageAddr);
+	if (entry) {
+		plg_FileFlushDetach(dictGetVal(entry));
+	}
+}
+
 static int PageCacheCmpFun(void* left, void* right) {
 
 	PDiskPageHead leftPage = (PDiskPageHead)left;
@@ -104,7 +184,9 @@ static int PageCacheCmpFun(void* left, void* right) {
 
 static void PageFreeCallback(void *privdata, void *val) {
 	PCacheHandle pCacheHandle = privdata;
-	plg_MemListPush(pCacheHandle->memoryListPage, listNodeValue((listNode*)val));
+	PDiskPageHead pDiskPageHead = listNodeValue((listNode*)val);
+	cache_FlushingDetach(pCacheHandle, &pDiskPageHead->addr);
+	cache_PagePush(pCacheHandle, pDiskPageHead);
 }
 
 static unsigned long long hashCallback(const void *key) {
@@ -128,6 +210,27 @@ static dictType pageDictType = {
 	PageFreeCallback
 };
 
+static void PageUndoFreeCallback(void *privdata, void *val) {
+	PCacheHandle pCacheHandle = privdata;
+	PPageUndoState pPageUndoState = val;
+	if (pPageUndoState->image) {
+		cache_PagePush(pCacheHandle, pPageUndoState->image);
+	}
+	if (pPageUndoState->view) {
+		cache_PagePush(pCacheHandle, pPageUndoState->view);
+	}
+	free(pPageUndoState);
+}
+
+static dictType pageUndoDictType = {
+	hashCallback,
+	NULL,
+	NULL,
+	uintCompareCallback,
+	NULL,
+	PageUndoFreeCallback
+};
+
 static int sdsCompareCallback(void *privdata, const void *key1, const void *key2) {
 	int l1, l2;
 	NOTUSED(privdata);
@@ -207,6 +310,173 @@ unsigned int cache_LoadPageFromFile(void* pvCacheHandle, unsigned int pageAddr,
 	return 1;
 }
 
+/*
+Log the bytes ptr to ptr + length of page before the transaction changes them.
+Pages created by the transaction are simply freed at rollback and need no log.
+*/
+static void cache_PageUndo(void* pvCacheHandle, void* page, void* ptr, unsigned int length) {
+
+	PCacheHandle pCacheHandle = pvCacheHandle;
+	if (page == 0 || length == 0) {
+		return;
+	}
+
+	PDiskPageHead pDiskPageHead = (PDiskPageHead)page;
+	cache_FlushingDetach(pCacheHandle, &pDiskPageHead->addr);
+	if (plg_dictFind(pCacheHandle->transaction_createPage, &pDiskPageHead->addr)) {
+		return;
+	}
+
+	unsigned int fullSize = FULLSIZE(pCacheHandle->pageSize);
+	unsigned int offset = OFFSET(page, ptr);
+	assert(offset + length <= fullSize);
+
+	PPageUndoState pPageUndoState;
+	dictEntry* entry = plg_dictFind(pCacheHandle->transaction_pageUndo, &pDiskPageHead->addr);
+	if (entry) {
+		pPageUndoState = dictGetVal(entry);
+		if (pPageUndoState->image) {
+			return;
+		}
+
+		//the newest record of the page already holds these bytes
+		PPageUndoRecord pLastRecord = (PPageUndoRecord)(pCacheHandle->undoLog + pPageUndoState->lastRecord - 1);
+		if (pLastRecord->offset <= offset && offset + length <= pLastRecord->offset + pLastRecord->length) {
+			return;
+		}
+	} else {
+		pPageUndoState = malloc(sizeof(PageUndoState));
+		pPageUndoState->pageAddr = pDiskPageHead->addr;
+		pPageUndoState->lastRecord = 0;
+		pPageUndoState->undoBytes = 0;
+		pPageUndoState->image = 0;
+		pPageUndoState->view = 0;
+		plg_dictAdd(pCacheHandle->transaction_pageUndo, &pPageUndoState->pageAddr, pPageUndoState);
+	}
+
+	//the whole page goes to a pool buffer instead of the log
+	if (pPageUndoState->undoBytes + length > fullSize / 2) {
+		pPageUndoState->image = cache_PagePop(pCacheHandle);
+		memcpy(pPageUndoState->image, page, fullSize);
+		return;
+	}
+
+	unsigned int recordSize = (sizeof(PageUndoRecord) + length + 7) & ~7;
+	if (pCacheHandle->undoLength + recordSize > pCacheHandle->undoSize) {
+		unsigned int undoSize = pCacheHandle->undoSize ? pCacheHandle->undoSize * 2 : fullSize;
+		while (undoSize < pCacheHandle->undoLength + recordSize) {
+			undoSize *= 2;
+		}
+		pCacheHandle->undoLog = realloc(pCacheHandle->undoLog, undoSize);
+		pCacheHandle->undoSize = undoSize;
+	}
+
+	PPageUndoRecord pPageUndoRecord = (PPageUndoRecord)(pCacheHandle->undoLog + pCacheHandle->undoLength);
+	pPageUndoRecord->pageAddr = pDiskPageHead->addr;
+	pPageUndoRecord->offset = offset;
+	pPageUndoRecord->length = length;
+	pPageUndoRecord->prevPage = pPageUndoState->lastRecord;
+	memcpy(pPageUndoRecord + 1, (unsigned char*)page + offset, length);
+
+	pPageUndoState->lastRecord = pCacheHandle->undoLength + 1;
+	pPageUndoState->undoBytes += length;
+	pCacheHandle->undoLength += recordSize;
+}
+
+/*
+Put the old bytes of the records of one page back into page, the image first and then the records newest first.
+*/
+static void cache_PageApplyUndo(PCacheHandle pCacheHandle, PPageUndoState pPageUndoState, void* page) {
+
+	if (pPageUndoState->image) {
+		memcpy(page, pPageUndoState->image, FULLSIZE(pCacheHandle->pageSize));
+	}
+	unsigned int record = pPageUndoState->lastRecord;
+	while (record) {
+		PPageUndoRecord pPageUndoRecord = (PPageUndoRecord)(pCacheHandle->undoLog + record - 1);
+		memcpy((unsigned char*)page + pPageUndoRecord->offset, pPageUndoRecord + 1, pPageUndoRecord->length);
+		record = pPageUndoRecord->prevPage;
+	}
+}
+
+/*
+The committed page for readers that do not see the transaction, built once per transaction.
+*/
+static void* cache_PageView(PCacheHandle pCacheHandle, PPageUndoState pPageUndoState, void* page) {
+
+	if (pPageUndoState->view == 0) {
+		pPageUndoState->view = cache_PagePop(pCacheHandle);
+		if (pPageUndoState->image == 0) {
+			memcpy(pPageUndoState->view, page, FULLSIZE(pCacheHandle->pageSize));
+		}
+		cache_PageApplyUndo(pCacheHandle, pPageUndoState, pPageUndoState->view);
+	}
+	return pPageUndoState->view;
+}
+
+/*
+Drop the log and the views at the end of the transaction, a log grown by a big transaction is released.
+*/
+static void cache_UndoReset(PCacheHandle pCacheHandle) {
+
+	plg_dictEmpty(pCacheHandle->transaction_pageUndo, NULL);
+	pCacheHandle->undoLength = 0;
+	if (pCacheHandle->undoSize > FULLSIZE(pCacheHandle->pageSize) * 16) {
+		free(pCacheHandle->undoLog);
+		pCacheHandle->undoLog = 0;
+		pCacheHandle->undoSize = 0;
+	}
+}
+
+#ifdef CACHE_UNDOCHECK
+/*
+Debug check of the callers of pageUndo, each page is copied when the transaction first finds it
+and must equal the page with its log applied at commit, or the page after rollback.
+*/
+static void cache_UndoCheckAdd(PCacheHandle pCacheHandle, void* page) {
+
+	PDiskPageHead pDiskPageHead = (PDiskPageHead)page;
+	if (plg_dictFind(pCacheHandle->transaction_undoCheck, &pDiskPageHead->addr) ||
+		plg_dictFind(pCacheHandle->transaction_createPage, &pDiskPageHead->addr)) {
+		return;
+	}
+	void* copyPage = malloc(FULLSIZE(pCacheHandle->pageSize));
+	memcpy(copyPage, page, FULLSIZE(pCacheHandle->pageSize));
+	dictAddWithUint(pCacheHandle->transaction_undoCheck, pDiskPageHead->addr, copyPage);
+}
+
+static void cache_UndoCheck(PCacheHandle pCacheHandle, short apply) {
+
+	unsigned int fullSize = FULLSIZE(pCacheHandle->pageSize);
+	void* checkPage = malloc(fullSize);
+	dictIterator* iter = plg_dictGetSafeIterator(pCacheHandle->transaction_undoCheck);
+	dictEntry* node;
+	while ((node = plg_dictNext(iter)) != NULL) {
+		void* copyPage = dictGetVal(node);
+		dictEntry* pageEntry = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), dictGetKey(node));
+		if (pageEntry) {
+			memcpy(checkPage, plg_ListDictGetVal(pageEntry), fullSize);
+			dictEntry* undoEntry = plg_dictFind(pCacheHandle->transaction_pageUndo, dictGetKey(node));
+			if (apply && undoEntry) {
+				cache_PageApplyUndo(pCacheHandle, dictGetVal(undoEntry), checkPage);
+			}
+			((PDiskPageHead)checkPage)->hitStamp = ((PDiskPageHead)copyPage)->hitStamp;
+			((PDiskPageHead)checkPage)->crc = ((PDiskPageHead)copyPage)->crc;
+			for (unsigned int l = 0; l < fullSize; l++) {
+				if (((unsigned char*)checkPage)[l] != ((unsigned char*)copyPage)[l]) {
+					elog(log_error, "cache_UndoCheck.page:%i offset:%i", *(unsigned int*)dictGetKey(node), l);
+					break;
+				}
+			}
+		}
+		free(copyPage);
+	}
+	plg_dictReleaseIterator(iter);
+	plg_dictEmpty(pCacheHandle->transaction_undoCheck, NULL);
+	free(checkPage);
+}
+#endif
+
 static unsigned int cache_ArrangementCheckBigValue(void* pvCacheHandle, void* page) {
 
 	PCacheHandle pCacheHandle = pvCacheHandle;
@@ -225,6 +495,7 @@ static unsigned int cache_ArrangementCheckBigValue(void* pvCacheHandle, void* pa
 	if (pDiskValuePage->valueArrangmentStamp + _ARRANGMENTTIME_ < sec) {
 		return 0;
 	}
+	cache_PageUndo(pCacheHandle, page, page, FULLSIZE(pCacheHandle->pageSize));
 	pDiskValuePage->valueArrangmentStamp = sec;
 
 	unsigned int pageSize = FULLSIZE(pCacheHandle->pageSize) - sizeof(DiskPageHead) - sizeof(DiskTablePage);
@@ -260,6 +531,7 @@ static unsigned int cache_ArrangementCheck(void* pvCacheHandle, void* page) {
 	if (pDiskTablePage->arrangmentStamp + _ARRANGMENTTIME_ < sec) {
 		return 0;
 	}
+	cache_PageUndo(pCacheHandle, page, page, FULLSIZE(pCacheHandle->pageSize));
 	pDiskTablePage->arrangmentStamp = sec;
 
 	unsigned int pageSize = FULLSIZE(pCacheHandle->pageSize) - sizeof(DiskPageHead) - sizeof(DiskTablePage);
@@ -283,24 +555,12 @@ static unsigned int cache_FindPage(void* pvCacheHandle, unsigned int pageAddr, v
 	PCacheHandle pCacheHandle = pvCacheHandle;
 	elog(log_fun, "cache_FindPage.pageAddr:%i recent:%i", pageAddr, pCacheHandle->recent);
 	assert(pageAddr);
-	if (pCacheHandle->recent) {
-		dictEntry* findTranPageEntry = plg_dictFind(plg_ListDictDict(pCacheHandle->transaction_listDictPageCache), &pageAddr);
-
-		if (findTranPageEntry !=0 ) {
-			*page = plg_ListDictGetVal(findTranPageEntry);
-
-			PDiskPageHead leftPage = *page;
-			leftPage->hitStamp = plg_GetCurrentSec();
-			return 1;
-		}
-	}
-
 	dictEntry* findPageEntry = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), &pageAddr);
 	if (findPageEntry == 0) {
-		*page = plg_MemListPop(pCacheHandle->memoryListPage);
+		*page = cache_PagePop(pCacheHandle);
 		if (0 == cache_LoadPageFromFile(pCacheHandle, pageAddr, *page)) {
 			elog(log_error, "cache_FindPage.disk load page %i!", pageAddr);
-			plg_MemListPush(pCacheHandle->memoryListPage, *page);
+			cache_PagePush(pCacheHandle, *page);
 			return 0;
 		} else {
 			elog(log_details, "cache_FindPage.cache_LoadPageFromFile:%i", pageAddr);
@@ -314,6 +574,16 @@ static unsigned int cache_FindPage(void* pvCacheHandle, unsigned int pageAddr, v
 	PDiskPageHead leftPage = *page;
 	leftPage->hitStamp = plg_GetCurrentSec();
 
+	if (pCacheHandle->recent) {
+#ifdef CACHE_UNDOCHECK
+		cache_UndoCheckAdd(pCacheHandle, *page);
+#endif
+	} else {
+		dictEntry* undoEntry = plg_dictFind(pCacheHandle->transaction_pageUndo, &pageAddr);
+		if (undoEntry) {
+			*page = cache_PageView(pCacheHandle, dictGetVal(undoEntry), *page);
+		}
+	}
 	return 1;
 }
 
@@ -345,7 +615,7 @@ static unsigned int cache_CreatePage(void* pvCacheHandle,
 	elog(log_fun, "cache_CreatePage.plg_DiskAllocPage:%i", pageAddr);
 
 	//calloc memory
-	*retPage = plg_MemListPop(pCacheHandle->memoryListPage);
+	*retPage = cache_PagePop(pCacheHandle);
 	memset(*retPage, 0, FULLSIZE(pCacheHandle->pageSize));
 
 	//init
@@ -356,6 +626,7 @@ static unsigned int cache_CreatePage(void* pvCacheHandle,
 
 	//add to chache
 	plg_ListDictAdd(pCacheHandle->listPageCache, &pDiskPageHead->addr, *retPage);
+	dictAddWithUint(pCacheHandle->transaction_createPage, pageAddr, NULL);
 	return 1;
 }
 
@@ -368,25 +639,20 @@ static unsigned int cache_DelPage(void* pvCacheHandle, unsigned int pageAddr) {
 	elog(log_fun, "cache_DelPage %i", pageAddr);
 	//add to transaction
 	dictAddWithUint(pCacheHandle->transaction_delPage, pageAddr, NULL);
-	plg_ListDictDel(pCacheHandle->transaction_listDictPageCache, &pageAddr);
 	return 1;
 }
 
 
+/*
+Pages are changed in place, the writes are logged by cache_PageUndo.
+*/
 static void* cache_pageCopyOnWrite(void* pvCacheHandle, unsigned int pageAddr, void* page) {
 	
 	elog(log_fun, "cache_pageCopyOnWrite.pageAddr:%i", pageAddr);
-	PCacheHandle pCacheHandle = pvCacheHandle;
-	dictEntry* entry = plg_dictFind(plg_ListDictDict(pCacheHandle->transaction_listDictPageCache), &pageAddr);
-	if (entry) {
-		return plg_ListDictGetVal(entry);
-	} else {
-		void* copyPage = plg_MemListPop(pCacheHandle->memoryListPage);
-		memcpy(copyPage, page, FULLSIZE(pCacheHandle->pageSize));
-		PDiskPageHead pDiskPageHead = (PDiskPageHead)copyPage;
-		plg_ListDictAdd(pCacheHandle->transaction_listDictPageCache, &pDiskPageHead->addr, copyPage);
-		return copyPage;
+	if (page == 0 && cache_FindPage(pvCacheHandle, pageAddr, &page) == 0) {
+		return 0;
 	}
+	return page;
 }
 
 static void* cache_tableCopyOnWrite(void* pvCacheHandle, sds table, void* tableHead) {
@@ -449,9 +715,128 @@ static TableHandleCallBack tableHandleCallBack = {
 	cache_addDirtyPage,
 	cache_tableCopyOnWrite,
 	cache_addDirtyTable,
-	cache_findTableInFile
+	cache_findTableInFile,
+	cache_PageUndo
 };
 
+/*
+A page can not leave the cache while it is dirty, deleted, used by the transaction in progress
+or its write is still queued on the file thread, which would reload the old page.
+*/
+static int cache_IsPagePinned(PCacheHandle pCacheHandle, unsigned int* pageAddr) {
+
+	if (plg_dictFind(pCacheHandle->pageDirty, pageAddr) || plg_dictFind(pCacheHandle->delPage, pageAddr)) {
+		return 1;
+	}
+	if (plg_dictFind(pCacheHandle->transaction_pageUndo, pageAddr) ||
+		plg_dictFind(pCacheHandle->transaction_createPage, pageAddr) || plg_dictFind(pCacheHandle->transaction_delPage, pageAddr)) {
+		return 1;
+	}
+	if (plg_dictFind(pCacheHandle->pageFlushing, pageAddr)) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+Forget the flushed pages and drop the flushes once the file thread has written them.
+*/
+static void cache_FlushingRelease(PCacheHandle pCacheHandle) {
+
+	listIter* iter = plg_listGetIterator(pCacheHandle->listFlushing, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		plg_FileFlushRelease(listNodeValue(node));
+	}
+	plg_listReleaseIterator(iter);
+	plg_listEmpty(pCacheHandle->listFlushing);
+	plg_dictEmpty(pCacheHandle->pageFlushing, NULL);
+}
+
+/*
+Drop the flushes the file thread has written, each on its own, a page stays pinned
+while its entry in pageFlushing still points to a flush that is queued.
+*/
+static void cache_FlushingDone(PCacheHandle pCacheHandle) {
+
+	listIter* iter = plg_listGetIterator(pCacheHandle->listFlushing, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		void* fileFlush = listNodeValue(node);
+		if (!plg_FileFlushIsDone(fileFlush)) {
+			continue;
+		}
+
+		unsigned int length = plg_FileFlushLength(fileFlush);
+		for (unsigned int l = 0; l < length; l++) {
+			unsigned int pageAddr = plg_FileFlushAddr(fileFlush, l);
+			dictEntry* entry = plg_dictFind(pCacheHandle->pageFlushing, &pageAddr);
+			if (entry && dictGetVal(entry) == plg_FileFlushSlot(fileFlush, l)) {
+				plg_dictDelete(pCacheHandle->pageFlushing, &pageAddr);
+			}
+		}
+		plg_FileFlushRelease(fileFlush);
+		plg_listDelNode(pCacheHandle->listFlushing, node);
+	}
+	plg_listReleaseIterator(iter);
+}
+
+/*
+Clock eviction while the buffer pool is over budget, until it is 1/16 under it.
+listPageCache is the clock and its tail the hand, hitStamp is the reference bit.
+A page hit since the hand last passed gets its bit cleared and a second chance at the head,
+pinned pages go to the head too. Only runs when pages were loaded or flushed since the last sweep.
+*/
+static void cache_Evict(PCacheHandle pCacheHandle) {
+
+	unsigned long long budget = plg_AtomicLoad64(&cache_budget);
+	if (budget == 0 || pCacheHandle->evictCheck == 0) {
+		return;
+	}
+	if (plg_AtomicLoad64(&cache_resident) <= budget) {
+		return;
+	}
+
+	elog(log_fun, "cache_Evict %U", pCacheHandle);
+	pCacheHandle->evictCheck = 0;
+	cache_FlushingDone(pCacheHandle);
+	unsigned long long lowWater = budget - budget / 16;
+	list* listPage = plg_ListDictList(pCacheHandle->listPageCache);
+	unsigned long scan = listLength(listPage) * 2;
+	unsigned int count = 0;
+	while (scan-- && plg_AtomicLoad64(&cache_resident) > lowWater) {
+		listNode* nodePage = listLast(listPage);
+		if (nodePage == 0) {
+			break;
+		}
+
+		PDiskPageHead pageHead = listNodeValue(nodePage);
+		if (cache_IsPagePinned(pCacheHandle, &pageHead->addr)) {
+			plg_listDelNodeKeepMem(listPage, nodePage);
+			plg_listAddNodeHeadKeepMem(listPage, nodePage);
+		} else if (pageHead->hitStamp) {
+			pageHead->hitStamp = 0;
+			plg_listDelNodeKeepMem(listPage, nodePage);
+			plg_listAddNodeHeadKeepMem(listPage, nodePage);
+		} else {
+			plg_ListDictDel(pCacheHandle->listPageCache, &pageHead->addr);
+			count++;
+		}
+	}
+
+	plg_AtomicAdd64(&cache_evict, count);
+	elog(log_details, "cache_Evict.count:%i", count);
+}
+
+/*
+Every operation ends here, no page of the cache is referenced any more so pages can be evicted.
+*/
+static void cache_Unlock(PCacheHandle pCacheHandle) {
+
+	cache_Evict(pCacheHandle);
+	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+}
+
 void* plg_CacheCreateHandle(void* pDiskHandle) {
 
 	PCacheHandle pCacheHandle = malloc(sizeof(CacheHandle));
@@ -471,12 +856,21 @@ void* plg_CacheCreateHandle(void* pDiskHandle) {
 	pCacheHandle->mutexHandle = plg_MutexCreateHandle(1);
 	pCacheHandle->objectName = plg_sdsNew("cache");
 
-	pCacheHandle->transaction_listDictPageCache = plg_ListDictCreateHandle(&pageDictType, DICT_MIDDLE, LIST_MIDDLE, NULL, pCacheHandle);
 	pCacheHandle->transaction_listDictTableInFile = plg_ListDictCreateHandle(&tableHeadDictType, DICT_MIDDLE, LIST_MIDDLE, NULL, pCacheHandle);
 	pCacheHandle->transaction_createPage = plg_dictCreate(plg_DefaultUintPtr(), NULL, DICT_MIDDLE);
 	pCacheHandle->transaction_delPage = plg_dictCreate(plg_DefaultUintPtr(), NULL, DICT_MIDDLE);
+	pCacheHandle->transaction_pageUndo = plg_dictCreate(&pageUndoDictType, pCacheHandle, DICT_MIDDLE);
+	pCacheHandle->undoLog = 0;
+	pCacheHandle->undoLength = 0;
+	pCacheHandle->undoSize = 0;
+#ifdef CACHE_UNDOCHECK
+	pCacheHandle->transaction_undoCheck = plg_dictCreate(plg_DefaultUintPtr(), NULL, DICT_MIDDLE);
+#endif
 	pCacheHandle->memoryListPage = plg_MemListCreate(60, FULLSIZE(pCacheHandle->pageSize), 0);
 	pCacheHandle->memoryListTable = plg_MemListCreate(60, sizeof(TableInFile), 0);
+	pCacheHandle->pageFlushing = plg_dictCreate(plg_DefaultUintPtr(), NULL, DICT_MIDDLE);
+	pCacheHandle->listFlushing = plg_listCreate(LIST_MIDDLE);
+	pCacheHandle->evictCheck = 0;
 	return pCacheHandle;
 }
 
@@ -491,10 +885,17 @@ void plg_CacheDestroyHandle(void* pvCacheHandle) {
 	plg_dictRelease(pCacheHandle->dictTableHandleDirty);
 	plg_dictRelease(pCacheHandle->delPage);
 
-	plg_ListDictDestroyHandle(pCacheHandle->transaction_listDictPageCache);
 	plg_dictRelease(pCacheHandle->transaction_createPage);
 	plg_ListDictDestroyHandle(pCacheHandle->transaction_listDictTableInFile);
 	plg_dictRelease(pCacheHandle->transaction_delPage);
+	plg_dictRelease(pCacheHandle->transaction_pageUndo);
+	free(pCacheHandle->undoLog);
+#ifdef CACHE_UNDOCHECK
+	plg_dictRelease(pCacheHandle->transaction_undoCheck);
+#endif
+	cache_FlushingRelease(pCacheHandle);
+	plg_dictRelease(pCacheHandle->pageFlushing);
+	plg_listRelease(pCacheHandle->listFlushing);
 
 	plg_MemListDestory(pCacheHandle->memoryListPage);
 	plg_MemListDestory(pCacheHandle->memoryListTable);
@@ -559,7 +960,7 @@ unsigned int plg_CacheTableAdd(void* pvCacheHandle, sds sdsTable, sds sdsKey, vo
 		}
 		
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -572,7 +973,7 @@ unsigned int plg_CacheTableMultiAdd(void* pvCacheHandle, sds sdsTable, void* pDi
 	if (pTableHandle != 0) {
 		r = plg_TableMultiAdd(pTableHandle, pDictExten);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 
 	return r;
 };
@@ -594,7 +995,7 @@ unsigned int plg_CacheTableAddIfNoExist(void* pvCacheHandle, sds sdsTable, sds s
 		}
 
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -607,7 +1008,7 @@ unsigned int plg_CacheTableRename(void* pvCacheHandle, sds sdsTable, sds sdsKey,
 	if (pTableHandle != 0) {
 		r = plg_TableRename(pTableHandle, sdsKey, sdsNewKey);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -622,7 +1023,7 @@ unsigned int plg_CacheTableIsKeyExist(void* pvCacheHandle, sds sdsTable, sds sds
 		r = plg_TableIsKeyExist(pTableHandle, sdsKey);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -635,7 +1036,7 @@ unsigned int plg_CacheTableDel(void* pvCacheHandle, sds sdsTable, sds sdsKey) {
 	if (pTableHandle != 0) {
 		r = plg_TableDel(pTableHandle, sdsKey);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -660,7 +1061,7 @@ int plg_CacheTableFind(void* pvCacheHandle, sds sdsTable, sds sdsKey, void* pDic
 		r = plg_TableFind(pTableHandle, sdsKey, pDictExten, 0);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -674,7 +1075,7 @@ void plg_CacheTableMultiFind(void* pvCacheHandle, sds sdsTable, void* pKeyDictEx
 		plg_TableMultiFind(pTableHandle, pKeyDictExten, pValueDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 unsigned int plg_CacheTableRand(void* pvCacheHandle, sds sdsTable, void* pDictExten, short recent) {
@@ -688,7 +1089,7 @@ unsigned int plg_CacheTableRand(void* pvCacheHandle, sds sdsTable, void* pDictEx
 		r = plg_TableRand(pTableHandle, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -704,7 +1105,7 @@ unsigned int plg_CacheTableLength(void* pvCacheHandle, sds sdsTable, short recen
 		len = plg_TableLength(pTableHandle);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return len;
 }
 
@@ -718,7 +1119,7 @@ void plg_CacheTableLimite(void* pvCacheHandle, sds sdsTable, sds sdsKey, unsigne
 		plg_TableLimite(pTableHandle, sdsKey, left, right, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 void plg_CacheTableOrder(void* pvCacheHandle, sds sdsTable, short order, unsigned int limite, void* pDictExten, short recent) {
@@ -731,7 +1132,7 @@ void plg_CacheTableOrder(void* pvCacheHandle, sds sdsTable, short order, unsigne
 		plg_TableOrder(pTableHandle, order, limite, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 void plg_CacheTableRang(void* pvCacheHandle, sds sdsTable, sds sdsBeginKey, sds sdsEndKey, void* pDictExten, short recent) {
@@ -744,7 +1145,7 @@ void plg_CacheTableRang(void* pvCacheHandle, sds sdsTable, sds sdsBeginKey, sds
 		plg_TableRang(pTableHandle, sdsBeginKey, sdsEndKey, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 void plg_CacheTablePattern(void* pvCacheHandle, sds sdsTable, sds sdsBeginKey, sds sdsEndKey, sds pattern, void* pDictExten, short recent) {
@@ -757,7 +1158,7 @@ void plg_CacheTablePattern(void* pvCacheHandle, sds sdsTable, sds sdsBeginKey, s
 		plg_TablePattern(pTableHandle, sdsBeginKey, sdsEndKey, pattern, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 void plg_CacheTableClear(void* pvCacheHandle, sds sdsTable) {
@@ -768,7 +1169,7 @@ void plg_CacheTableClear(void* pvCacheHandle, sds sdsTable) {
 	if (pTableHandle != 0) {
 		plg_TableClear(pTableHandle, 1);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 unsigned int plg_CacheTableSetAdd(void* pvCacheHandle, sds sdsTable, sds sdsKey, sds sdsValue) {
@@ -780,7 +1181,7 @@ unsigned int plg_CacheTableSetAdd(void* pvCacheHandle, sds sdsTable, sds sdsKey,
 	if (pTableHandle != 0) {
 		r = plg_TableSetAdd(pTableHandle, sdsKey, sdsValue);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -794,7 +1195,7 @@ void plg_CacheTableSetRang(void* pvCacheHandle, sds sdsTable, sds sdsKey, sds sd
 		plg_TableSetRang(pTableHandle, sdsKey, sdsBeginValue, sdsEndValue, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 void plg_CacheTableSetLimite(void* pvCacheHandle, sds sdsTable, sds sdsKey, sds sdsValue, unsigned int left, unsigned int right, void* pDictExten, short recent) {
@@ -807,7 +1208,7 @@ void plg_CacheTableSetLimite(void* pvCacheHandle, sds sdsTable, sds sdsKey, sds
 		plg_TableSetLimite(pTableHandle, sdsKey, sdsValue, left, right, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 unsigned int plg_CacheTableSetLength(void* pvCacheHandle, sds sdsTable, sds sdsKey, short recent) {
@@ -822,7 +1223,7 @@ unsigned int plg_CacheTableSetLength(void* pvCacheHandle, sds sdsTable, sds sdsK
 		len = plg_TableSetLength(pTableHandle, sdsKey);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return len;
 }
 
@@ -837,7 +1238,7 @@ unsigned int plg_CacheTableSetIsKeyExist(void* pvCacheHandle, sds sdsTable, sds
 		r = plg_TableSetIsKeyExist(pTableHandle, sdsKey, sdsValue);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -851,7 +1252,7 @@ void plg_CacheTableSetMembers(void* pvCacheHandle, sds sdsTable, sds sdsKey, voi
 		plg_TableSetMembers(pTableHandle, sdsKey, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 unsigned int plg_CacheTableSetRand(void* pvCacheHandle, sds sdsTable, sds sdsKey, void* pDictExten, short recent) {
@@ -865,7 +1266,7 @@ unsigned int plg_CacheTableSetRand(void* pvCacheHandle, sds sdsTable, sds sdsKey
 		r = plg_TableSetRand(pTableHandle, sdsKey, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -877,7 +1278,7 @@ void plg_CacheTableSetDel(void* pvCacheHandle, sds sdsTable, sds sdsKey, void* p
 	if (pTableHandle != 0) {
 		plg_TableSetDel(pTableHandle, sdsKey, pValueDictExten);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 }
 
 unsigned int plg_CacheTableSetPop(void* pvCacheHandle, sds sdsTable, sds sdsKey, void* pDictExten, short recent) {
@@ -891,7 +1292,7 @@ unsigned int plg_CacheTableSetPop(void* pvCacheHandle, sds sdsTable, sds sdsKey,
 		r = plg_TableSetPop(pTableHandle, sdsKey, pDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return r;
 }
 
@@ -906,7 +1307,7 @@ unsigned int plg_CacheTableSetRangCount(void* pvCacheHandle, sds sdsTable, sds s
 		count = plg_TableSetRangCount(pTableHandle, sdsKey, sdsBeginValue, sdsEndValue);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -926,7 +1327,7 @@ unsigned int plg_CacheTableSetUion(void* pvCacheHandle, sds sdsTable, void* pSet
 		plg_TableSetUion(pTableHandle, pSetDictExten, pKeyDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -939,7 +1340,7 @@ unsigned int plg_CacheTableSetUionStore(void* pvCacheHandle, sds sdsTable, void*
 	if (pTableHandle != 0) {
 		plg_TableSetUionStore(pTableHandle, pSetDictExten, sdsKey);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -954,7 +1355,7 @@ unsigned int plg_CacheTableSetInter(void* pvCacheHandle, sds sdsTable, void* pSe
 		plg_TableSetInter(pTableHandle, pSetDictExten, pKeyDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -967,7 +1368,7 @@ unsigned int plg_CacheTableSetInterStore(void* pvCacheHandle, sds sdsTable, void
 	if (pTableHandle != 0) {
 		plg_TableSetInterStore(pTableHandle, pSetDictExten, sdsKey);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -982,7 +1383,7 @@ unsigned int plg_CacheTableSetDiff(void* pvCacheHandle, sds sdsTable, void* pSet
 		plg_TableSetDiff(pTableHandle, pSetDictExten, pKeyDictExten);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -995,7 +1396,7 @@ unsigned int plg_CacheTableSetDiffStore(void* pvCacheHandle, sds sdsTable, void*
 	if (pTableHandle != 0) {
 		plg_TableSetDiffStore(pTableHandle, pSetDictExten, sdsKey);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -1008,7 +1409,7 @@ unsigned int plg_CacheTableSetMove(void* pvCacheHandle, sds sdsTable, sds sdsSrc
 	if (pTableHandle != 0) {
 		plg_TableSetMove(pTableHandle, sdsSrcKey, sdsDesKey, sdsValue);
 	}
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
@@ -1024,13 +1425,23 @@ unsigned int plg_CacheTableMembersWithJson(void* pvCacheHandle, sds sdsTable, vo
 		plg_TableMembersWithJson(pTableHandle, jsonRoot);
 	}
 	pCacheHandle->recent = 1;
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 	return count;
 }
 
 /*
 flush dirty page to file
 */
+/*
+Calculate CRC on the file thread just before the page is written.
+*/
+static void cache_FlushPrepare(void* page, unsigned int fullPageSize) {
+
+	PDiskPageHead pDiskPageHead = (PDiskPageHead)page;
+	char* pDiskPage = (char*)page + sizeof(DiskPageHead);
+	pDiskPageHead->crc = plg_crc16(pDiskPage, fullPageSize - sizeof(DiskPageHead));
+}
+
 unsigned int plg_CacheFlushDirtyToFile(void* pvCacheHandle) {
 
 	PCacheHandle pCacheHandle = pvCacheHandle;
@@ -1042,41 +1453,48 @@ unsigned int plg_CacheFlushDirtyToFile(void* pvCacheHandle) {
 		return 0;
 	}
 
-	//flush dict page
+	//flush dict page, the file thread writes the cached pages themselves
 	int dirtySize = dictSize(pCacheHandle->pageDirty);
 	unsigned int* pageAddr = malloc(dirtySize*sizeof(unsigned int));
+	void** pageArrary = malloc(dirtySize*sizeof(void*));
 	unsigned count = 0;
-	void** memArrary;
 	void* fileHandle = plg_DiskFileHandle(pCacheHandle->pDiskHandle);
-	plg_FileMallocPageArrary(fileHandle, &memArrary, dirtySize);
 
 	dictIterator* dictIter = plg_dictGetSafeIterator(pCacheHandle->pageDirty);
 	dictEntry* dictNode;
 	while ((dictNode = plg_dictNext(dictIter)) != NULL) {
-		pageAddr[count++] = *(unsigned int*)dictGetKey(dictNode);
-	}
-	plg_dictReleaseIterator(dictIter);
-
-	for (int l = 0; l < dirtySize; l++) {
-		dictEntry* diskNode = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), &pageAddr[l]);
-		if (diskNode != 0) {
-			char* page = plg_ListDictGetVal(diskNode);
-			assert(pageAddr[l]);
-			if (pageAddr[l] != 0) {
-				PDiskPageHead pDiskPageHead = (PDiskPageHead)page;
-				char* pDiskPage = page + sizeof(DiskPageHead);
-
-				//Calculate CRC
-				pDiskPageHead->crc = plg_crc16((char*)pDiskPage, FULLSIZE(pCacheHandle->pageSize) - sizeof(DiskPageHead));
-			}
-			memcpy(memArrary[l], page, FULLSIZE(pCacheHandle->pageSize));
+		unsigned int* dirtyAddr = (unsigned int*)dictGetKey(dictNode);
+		dictEntry* diskNode = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), dirtyAddr);
+		if (diskNode == 0) {
+			elog(log_error, "plg_CacheFlushDirtyToFile.pageId: %i", *dirtyAddr);
+			continue;
 		}
+
+		assert(*dirtyAddr);
+		pageAddr[count] = *dirtyAddr;
+		pageArrary[count++] = plg_ListDictGetVal(diskNode);
 	}
+	plg_dictReleaseIterator(dictIter);
 
 	//Clear before switching to file critical area for transaction integrity
 	plg_dictEmpty(pCacheHandle->pageDirty, NULL);
 
-	plg_FileFlushPage(fileHandle, pageAddr, memArrary, dirtySize);
+	//the pages stay pinned until the file thread has written them
+	cache_FlushingDone(pCacheHandle);
+	void* fileFlush = plg_FileFlushShare(fileHandle, pageAddr, pageArrary, count, cache_FlushPrepare);
+	plg_listAddNodeTail(pCacheHandle->listFlushing, fileFlush);
+	for (unsigned int l = 0; l < count; l++) {
+		dictEntry* entry = plg_dictFind(pCacheHandle->pageFlushing, &pageAddr[l]);
+		if (entry) {
+			//only the newest flush of a page is tracked, the earlier one gets its own copy if still queued
+			plg_FileFlushDetach(dictGetVal(entry));
+			dictSetVal(pCacheHandle->pageFlushing, entry, plg_FileFlushSlot(fileFlush, l));
+		} else {
+			dictAddWithUint(pCacheHandle->pageFlushing, pageAddr[l], plg_FileFlushSlot(fileFlush, l));
+		}
+	}
+	free(pageAddr);
+	free(pageArrary);
 	return 1;
 }
 
@@ -1087,26 +1505,20 @@ int plg_CacheCommit(void* pvCacheHandle) {
 
 	PCacheHandle pCacheHandle = pvCacheHandle;
 	elog(log_fun, "plg_CacheCommit %U", pCacheHandle);
-	short tableHead = 0, delPage = 0;
+	short tableHead = 0, delPage = 0, page = 0;
 	MutexLock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
-	//copy from transaction_listDictPageCache to listPageCache
-	dict* t_listDictPageCache = plg_ListDictDict(pCacheHandle->transaction_listDictPageCache);
-	dictIterator* itert_listDictPageCache = plg_dictGetSafeIterator(t_listDictPageCache);
-	dictEntry* nodet_listDictPageCache;
-	while ((nodet_listDictPageCache = plg_dictNext(itert_listDictPageCache)) != NULL) {
-
-		dictEntry* pcEntry = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), dictGetKey(nodet_listDictPageCache));
-		if (pcEntry != 0) {
-			elog(log_details, "plg_CacheCommit.tranPageId: %i", *(unsigned int*)dictGetKey(nodet_listDictPageCache));
-
-			memcpy(plg_ListDictGetVal(pcEntry), plg_ListDictGetVal(nodet_listDictPageCache), FULLSIZE(pCacheHandle->pageSize));
-			dictAddWithUint(pCacheHandle->pageDirty, *(unsigned int*)dictGetKey(nodet_listDictPageCache), NULL);
-		} else {
-			elog(log_error, "plg_CacheCommit.tranPageId: %i", *(unsigned int*)dictGetKey(nodet_listDictPageCache));
-		}
-	}
-	plg_dictReleaseIterator(itert_listDictPageCache);
-	plg_ListDictEmpty(pCacheHandle->transaction_listDictPageCache);
+#ifdef CACHE_UNDOCHECK
+	cache_UndoCheck(pCacheHandle, 1);
+#endif
+	//the pages are already changed in place, only mark them dirty and drop the undo log
+	dictIterator* itert_pageUndo = plg_dictGetSafeIterator(pCacheHandle->transaction_pageUndo);
+	dictEntry* nodet_pageUndo;
+	while ((nodet_pageUndo = plg_dictNext(itert_pageUndo)) != NULL) {
+		page++;
+		dictAddWithUint(pCacheHandle->pageDirty, *(unsigned int*)dictGetKey(nodet_pageUndo), NULL);
+	}
+	plg_dictReleaseIterator(itert_pageUndo);
+	cache_UndoReset(pCacheHandle);
 
 	//copy from transaction_listDictTableInFile to dictTableHandleDirty
 	dict* t_listDictTableInFile = plg_ListDictDict(pCacheHandle->transaction_listDictTableInFile);
@@ -1126,6 +1538,13 @@ int plg_CacheCommit(void* pvCacheHandle) {
 	plg_ListDictEmpty(pCacheHandle->transaction_listDictTableInFile);
 
 	//createpage
+	dictIterator* itert_createPage = plg_dictGetSafeIterator(pCacheHandle->transaction_createPage);
+	dictEntry* nodet_createPage;
+	while ((nodet_createPage = plg_dictNext(itert_createPage)) != NULL) {
+		page++;
+		dictAddWithUint(pCacheHandle->pageDirty, *(unsigned int*)dictGetKey(nodet_createPage), NULL);
+	}
+	plg_dictReleaseIterator(itert_createPage);
 	plg_dictEmpty(pCacheHandle->transaction_createPage, NULL);
 
 	//delpage
@@ -1141,9 +1560,9 @@ int plg_CacheCommit(void* pvCacheHandle) {
 	}
 	plg_dictReleaseIterator(itert_delpage);
 	plg_dictEmpty(pCacheHandle->transaction_delPage, NULL);
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 
-	elog(log_details, "plg_CacheCommit.table:%i delPage:%i", tableHead, delPage);
+	elog(log_details, "plg_CacheCommit.page:%i table:%i delPage:%i", page, tableHead, delPage);
 	return 1;
 }
 
@@ -1155,7 +1574,32 @@ int plg_CacheRollBack(void* pvCacheHandle) {
 	PCacheHandle pCacheHandle = pvCacheHandle;
 	elog(log_fun, "plg_CacheRollBack %U", pCacheHandle);
 	MutexLock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
-	plg_ListDictEmpty(pCacheHandle->transaction_listDictPageCache);
+
+	//the pages are independent, each one takes back its image by swapping the buffer and then its records
+	dictIterator* itert_pageUndo = plg_dictGetSafeIterator(pCacheHandle->transaction_pageUndo);
+	dictEntry* nodet_pageUndo;
+	while ((nodet_pageUndo = plg_dictNext(itert_pageUndo)) != NULL) {
+		PPageUndoState pPageUndoState = dictGetVal(nodet_pageUndo);
+		dictEntry* pcEntry = plg_dictFind(plg_ListDictDict(pCacheHandle->listPageCache), &pPageUndoState->pageAddr);
+		if (pcEntry == 0) {
+			elog(log_error, "plg_CacheRollBack.undoPageId: %i", pPageUndoState->pageAddr);
+			continue;
+		}
+
+		listNode* node = dictGetVal(pcEntry);
+		if (pPageUndoState->image) {
+			cache_PagePush(pCacheHandle, listNodeValue(node));
+			node->value = pPageUndoState->image;
+			pcEntry->key = &((PDiskPageHead)pPageUndoState->image)->addr;
+			pPageUndoState->image = 0;
+		}
+		cache_PageApplyUndo(pCacheHandle, pPageUndoState, listNodeValue(node));
+	}
+	plg_dictReleaseIterator(itert_pageUndo);
+	cache_UndoReset(pCacheHandle);
+#ifdef CACHE_UNDOCHECK
+	cache_UndoCheck(pCacheHandle, 0);
+#endif
 	plg_ListDictEmpty(pCacheHandle->transaction_listDictTableInFile);
 	plg_dictEmpty(pCacheHandle->transaction_delPage, NULL);
 
@@ -1169,7 +1613,7 @@ int plg_CacheRollBack(void* pvCacheHandle) {
 	}
 	plg_dictReleaseIterator(itert_createPage);
 	plg_dictEmpty(pCacheHandle->transaction_createPage, NULL);
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	cache_Unlock(pCacheHandle);
 
 	return 1;
 }
@@ -1184,6 +1628,19 @@ void plg_CacheSetPercent(void* pvCacheHandle, unsigned int percent){
 	pCacheHandle->cachePercent = percent;
 }
 
+/*
+Byte budget of the pages of all caches, 0 is no budget.
+*/
+void plg_CacheSetBudget(unsigned long long budget) {
+	plg_AtomicStore64(&cache_budget, budget);
+}
+
+void plg_CacheBudgetStat(unsigned long long* budget, unsigned long long* resident, unsigned long long* evict) {
+	*budget = plg_AtomicLoad64(&cache_budget);
+	*resident = plg_AtomicLoad64(&cache_resident);
+	*evict = plg_AtomicLoad64(&cache_evict);
+}
+
 /*
 ҳ,ҳܸһִ
 */
@@ -1197,9 +1654,9 @@ static void cache_Arrange(void* pvCacheHandle) {
 		return;
 	}
 
-	//page
+	//page, with a budget the pages are evicted by cache_Evict
 	list* listPage = plg_ListDictList(pCacheHandle->listPageCache);
-	listNode* nodePage = listLast(listPage);
+	listNode* nodePage = plg_AtomicLoad64(&cache_budget) ? 0 : listLast(listPage);
 	unsigned int limite = listLength(listPage) / 100 * pCacheHandle->cachePercent;
 	unsigned int interval = pCacheHandle->cacheInterval * 3;
 	unsigned int count = 0;
@@ -1252,6 +1709,7 @@ void plg_CacheFlush(void* pvCacheHandle) {
 
 	//no sava
 	if (plg_DiskIsNoSave(pCacheHandle->pDiskHandle)) {
+		cache_Unlock(pCacheHandle);
 		return;
 	}
 	
@@ -1288,5 +1746,6 @@ void plg_CacheFlush(void* pvCacheHandle) {
 	//process pCacheHandle->pageDirty;
 	plg_CacheFlushDirtyToFile(pCacheHandle);
 	cache_Arrange(pCacheHandle);
-	MutexUnlock(pCacheHandle->mutexHandle, pCacheHandle->objectName);
+	pCacheHandle->evictCheck = 1;
+	cache_Unlock(pCacheHandle);
 }
\ No newline at end of file
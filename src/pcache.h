@@ -66,6 +66,8 @@ void plg_CacheFlush(void* pvCacheHandle);
 //config
 void plg_CacheSetInterval(void* pvCacheHandle, unsigned int interval);
 void plg_CacheSetPercent(void* pvCacheHandle, unsigned int percent);
+void plg_CacheSetBudget(unsigned long long budget);
+void plg_CacheBudgetStat(unsigned long long* budget, unsigned long long* resident, unsigned long long* evict);
 
 unsigned int plg_CacheTableMembersWithJson(void* pvCacheHandle, char* sdsTable, void* jsonRoot, short recent);
 #endif
\ No newline at end of file
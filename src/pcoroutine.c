@@ -0,0 +1,173 @@
+/* coroutine.c - Stackful coroutines for async processes
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600
+#endif
+#include "plateform.h"
+#include "pelog.h"
+#include "pcoroutine.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <ucontext.h>
+#endif
+
+/*
+A coroutine owns its stack and keeps it between runs, plg_CoStart hands it the next function.
+It only ever switches with the thread that resumed it, so it must be resumed by the thread that created it.
+plg_CoStart and plg_CoResume return 1 when the function returned and 0 when it called plg_CoYield.
+Windows uses fibers, the other systems ucontext.
+*/
+typedef struct _Coroutine
+{
+	CoroutineFun fun;
+	void* arg;
+	int done;
+#ifdef _WIN32
+	void* fiber;
+	void* caller;
+#else
+	ucontext_t context;
+	ucontext_t caller;
+	void* stack;
+#endif
+} *PCoroutine, Coroutine;
+
+#ifdef _WIN32
+
+static void WINAPI co_Entry(void* arg) {
+
+	PCoroutine pCoroutine = arg;
+	for (;;) {
+		pCoroutine->fun(pCoroutine->arg);
+		pCoroutine->done = 1;
+		SwitchToFiber(pCoroutine->caller);
+	}
+}
+
+void* plg_CoCreate(unsigned int stackSize) {
+
+	PCoroutine pCoroutine = malloc(sizeof(Coroutine));
+	pCoroutine->done = 1;
+	pCoroutine->caller = 0;
+	pCoroutine->fiber = CreateFiber(stackSize, co_Entry, pCoroutine);
+	if (!pCoroutine->fiber) {
+		elog(log_error, "plg_CoCreate.CreateFiber");
+		free(pCoroutine);
+		return 0;
+	}
+	return pCoroutine;
+}
+
+void plg_CoDestroy(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	DeleteFiber(pCoroutine->fiber);
+	free(pCoroutine);
+}
+
+int plg_CoResume(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	if (!IsThreadAFiber()) {
+		ConvertThreadToFiber(0);
+	}
+	pCoroutine->caller = GetCurrentFiber();
+	SwitchToFiber(pCoroutine->fiber);
+	return pCoroutine->done;
+}
+
+void plg_CoYield(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	SwitchToFiber(pCoroutine->caller);
+}
+
+#else
+
+//makecontext only passes int arguments, the pointer is split in two
+static void co_Entry(unsigned int high, unsigned int low) {
+
+	PCoroutine pCoroutine = (PCoroutine)(((unsigned long long)high << 32) | low);
+	for (;;) {
+		pCoroutine->fun(pCoroutine->arg);
+		pCoroutine->done = 1;
+		swapcontext(&pCoroutine->context, &pCoroutine->caller);
+	}
+}
+
+//the context only resumes at co_Entry, the wrapper keeps the returns twice warning of getcontext out of plg_CoCreate
+static int co_GetContext(ucontext_t* context) {
+
+	return getcontext(context);
+}
+
+void* plg_CoCreate(unsigned int stackSize) {
+
+	PCoroutine pCoroutine = malloc(sizeof(Coroutine));
+	pCoroutine->done = 1;
+	pCoroutine->stack = malloc(stackSize);
+	if (co_GetContext(&pCoroutine->context) != 0) {
+		elog(log_error, "plg_CoCreate.getcontext");
+		free(pCoroutine->stack);
+		free(pCoroutine);
+		return 0;
+	}
+
+	unsigned long long ptr = (unsigned long long)(size_t)pCoroutine;
+	pCoroutine->context.uc_stack.ss_sp = pCoroutine->stack;
+	pCoroutine->context.uc_stack.ss_size = stackSize;
+	pCoroutine->context.uc_link = 0;
+	makecontext(&pCoroutine->context, (void(*)(void))co_Entry, 2, (unsigned int)(ptr >> 32), (unsigned int)ptr);
+	return pCoroutine;
+}
+
+void plg_CoDestroy(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	free(pCoroutine->stack);
+	free(pCoroutine);
+}
+
+int plg_CoResume(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	swapcontext(&pCoroutine->caller, &pCoroutine->context);
+	return pCoroutine->done;
+}
+
+void plg_CoYield(void* pvCoroutine) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	swapcontext(&pCoroutine->context, &pCoroutine->caller);
+}
+
+#endif
+
+int plg_CoStart(void* pvCoroutine, CoroutineFun fun, void* arg) {
+
+	PCoroutine pCoroutine = pvCoroutine;
+	pCoroutine->fun = fun;
+	pCoroutine->arg = arg;
+	pCoroutine->done = 0;
+	return plg_CoResume(pCoroutine);
+}
@@ -0,0 +1,31 @@
+/* coroutine.h - Stackful coroutines for async processes
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COROUTINE_H
+#define __COROUTINE_H
+
+typedef void(*CoroutineFun)(void* arg);
+
+void* plg_CoCreate(unsigned int stackSize);
+void plg_CoDestroy(void* pCoroutine);
+int plg_CoStart(void* pCoroutine, CoroutineFun fun, void* arg);
+int plg_CoResume(void* pCoroutine);
+void plg_CoYield(void* pCoroutine);
+
+#endif
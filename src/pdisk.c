@@ -823,6 +823,15 @@ void* plg_DiskfindTableInFile(void* pvDiskHandle, sds table, void* tableInFile)
 	return tableInFile;
 }
 
+/*
+The disk has no transaction, its pages are not rolled back.
+*/
+static void plg_DiskPageUndo(void* pvDiskHandle, void* page, void* ptr, unsigned int length) {
+	NOTUSED(pvDiskHandle);
+	NOTUSED(page);
+	NOTUSED(ptr);
+	NOTUSED(length);
+}
 
 static TableHandleCallBack tableHandleCallBack = {
 	plg_DiskFindPage,
@@ -833,7 +842,8 @@ static TableHandleCallBack tableHandleCallBack = {
 	plg_DiskAddDirtyPage,
 	plg_DisktableCopyOnWrite,
 	plg_DiskaddDirtyTable,
-	plg_DiskfindTableInFile
+	plg_DiskfindTableInFile,
+	plg_DiskPageUndo
 };
 
 /*
@@ -24,6 +24,50 @@
 //user manage API
 typedef void(*AfterDestroyFun)(void* value);
 
+//called with the buffer of plg_MngRemoteCallBuffer or plg_JobRemoteCallBuffer once the job is done with it
+typedef void(*ReleaseBufferFun)(void* buffer, unsigned long long bufferLen);
+
+//what plg_MngRemoteCall does when the queue of the job is at its high water, see plg_MngSetQueueLimit
+enum QueuePolicy {
+	QP_BLOCK = 1,
+	QP_BUSY = 2,
+	QP_SHED = 3
+};
+
+//how plg_JobSetCoalesce merges a new packet of the order into a pending one
+enum CoalesceMode {
+	CM_NONE = 0,
+	CM_SAME = 1,
+	CM_LATEST = 2
+};
+
+//returned by plg_MngRemoteCall under QP_BUSY
+#define REMOTECALL_BUSY -1
+
+//one call of plg_MngRemoteCallBatch or plg_JobRemoteCallBatch
+typedef struct _RemoteCallItem {
+	char* order;
+	char* value;
+	unsigned short orderLen;
+	unsigned short valueLen;
+} *PRemoteCallItem, RemoteCallItem;
+
+//metrics of an order over all jobs returned by plg_MngOrderStat, times are nanoseconds
+typedef struct _OrderStat {
+	unsigned long long count;
+	unsigned long long rollback;
+	unsigned long long execMean;
+	unsigned long long execP50;
+	unsigned long long execP99;
+	unsigned long long execP999;
+	unsigned long long execMax;
+	unsigned long long waitMean;
+	unsigned long long waitP50;
+	unsigned long long waitP99;
+	unsigned long long waitP999;
+	unsigned long long waitMax;
+} *POrderStat, OrderStat;
+
 PELAGIA_API void* plg_MngCreateHandle(char* dbPath, short dbPahtLen);
 PELAGIA_API void plg_MngDestoryHandle(void* pManage, AfterDestroyFun fun, void* ptr);
 PELAGIA_API int plg_MngStarJob(void* pManage);
@@ -43,6 +87,27 @@ PELAGIA_API int plg_MngConfigFromJsonFile(void* pManage, char* jsonPath);
 PELAGIA_API int plg_MngAllocJob(void* pManage, unsigned int core);
 PELAGIA_API int plg_MngFreeJob(void* pManage);
 PELAGIA_API int plg_MngRemoteCall(void* pManage, char* order, short orderLen, char* value, short valueLen);
+PELAGIA_API unsigned int plg_MngOrderId(void* pManage, char* order, short orderLen);
+PELAGIA_API int plg_MngRemoteCallById(void* pManage, unsigned int orderId, char* value, short valueLen);
+PELAGIA_API int plg_MngRemoteCallBuffer(void* pManage, char* order, short orderLen, void* buffer, unsigned long long bufferLen, ReleaseBufferFun release);
+PELAGIA_API void* plg_MngCall(void* pManage, char* order, short orderLen, char* value, short valueLen);
+PELAGIA_API unsigned int plg_MngRemoteCallBatch(void* pManage, PRemoteCallItem pRemoteCallItem, unsigned int count);
+PELAGIA_API int plg_MngMigrateOrder(void* pManage, char* order, short orderLen, unsigned int jobIndex);
+PELAGIA_API int plg_MngRebalanceJob(void* pManage);
+PELAGIA_API int plg_MngSetJobCore(void* pManage, unsigned int jobIndex, int core);
+PELAGIA_API int plg_MngSetFileCore(void* pManage, unsigned int fileIndex, int core);
+PELAGIA_API int plg_MngSetQueueLimit(void* pManage, unsigned int highWater, int policy);
+PELAGIA_API int plg_MngQueueStat(void* pManage, unsigned int jobIndex, unsigned long long* depth, unsigned long long* peak,
+	unsigned long long* busy, unsigned long long* block, unsigned long long* shed);
+PELAGIA_API int plg_MngSetGroupCommit(void* pManage, unsigned int commitCount, unsigned int commitTime);
+PELAGIA_API int plg_MngSetOrderJob(void* pManage, char* nameOrder, short nameOrderLen, unsigned int jobIndex);
+PELAGIA_API int plg_MngPlanJob(void* pManage, unsigned int core);
+PELAGIA_API int plg_MngPlanToJsonFile(void* pManage, char* jsonPath);
+PELAGIA_API int plg_MngMetricsToJsonFile(void* pManage, char* jsonPath);
+PELAGIA_API int plg_MngOrderStat(void* pManage, char* order, short orderLen, POrderStat pOrderStat);
+PELAGIA_API int plg_MngSetMetricsDump(void* pManage, char* jsonPath, unsigned int interval);
+PELAGIA_API void plg_MngSetLockProfile(void* pManage, unsigned char profile);
+PELAGIA_API void plg_MngSetCacheBudget(void* pManage, unsigned long long budget);
 
 //manage check API
 PELAGIA_API void plg_MngPrintAllStatus(void* pManage);
@@ -58,11 +123,32 @@ PELAGIA_API void* plg_JobCreateFunPtr(RoutingFun funPtr);
 PELAGIA_API void* plg_JobCreateLua(char* fileClass, short fileClassLen, char* fun, short funLen);
 PELAGIA_API void* plg_JobCreateDll(char* fileClass, short fileClassLen, char* fun, short funLen);
 PELAGIA_API void plg_JobSetWeight(void* pEventPorcess, unsigned int weight);
+PELAGIA_API void plg_JobSetAsync(void* pEventPorcess, unsigned char async);
+PELAGIA_API void plg_JobSetCoalesce(void* pEventPorcess, unsigned char mode);
+PELAGIA_API void plg_JobSetBroadcast(void* pEventPorcess, unsigned char broadcast);
+//each read of a read only order sees what is committed at that call, not a snapshot: two reads may see a transaction half applied
+PELAGIA_API void plg_JobSetReadOnly(void* pEventPorcess, unsigned char readOnly);
 
 //remotecall
 PELAGIA_API int plg_JobRemoteCall(void* order, unsigned short orderLen, void* value, unsigned short valueLen);
+PELAGIA_API unsigned int plg_JobOrderId(void* order, unsigned short orderLen);
+PELAGIA_API int plg_JobRemoteCallById(unsigned int orderId, void* value, unsigned short valueLen);
+PELAGIA_API int plg_JobRemoteCallBuffer(void* order, unsigned short orderLen, void* buffer, unsigned long long bufferLen, ReleaseBufferFun release);
+PELAGIA_API unsigned int plg_JobRemoteCallBatch(PRemoteCallItem pRemoteCallItem, unsigned int count);
+PELAGIA_API void* plg_JobCall(void* order, unsigned short orderLen, void* value, unsigned short valueLen);
+PELAGIA_API int plg_JobReply(void* value, unsigned int valueLen);
+
+//future of plg_MngCall and plg_JobCall
+PELAGIA_API int plg_FutureWait(void* pFuture, unsigned int milli);
+PELAGIA_API int plg_FutureIsReady(void* pFuture);
+PELAGIA_API void* plg_FutureValue(void* pFuture, unsigned int* valueLen);
+PELAGIA_API void plg_FutureRelease(void* pFuture);
+PELAGIA_API int plg_JobAwait(void* pFuture);
 PELAGIA_API char* plg_JobCurrentOrder();
+PELAGIA_API void* plg_JobCurrentBuffer(unsigned long long* bufferLen);
 PELAGIA_API void plg_JobAddTimer(unsigned int timer, void* order, unsigned short orderLen, void* value, unsigned short valueLen);
+PELAGIA_API unsigned long long plg_JobAddTimerMs(unsigned long long timer, void* order, unsigned short orderLen, void* value, unsigned short valueLen);
+PELAGIA_API int plg_JobCancelTimer(unsigned long long timerHandle);
 
 //namorl db
 PELAGIA_API unsigned int plg_JobSet(void* table, unsigned short tableLen, void* key, unsigned short keyLen, void* value, unsigned int valueLen);
@@ -229,7 +229,7 @@ void plg_LogDestroy() {
 
 void plg_LogSetError(int level, char* describe, const char* fileName, int line) {
 
-	plg_MutexLock(mutexHandle);
+	plg_MutexLock(mutexHandle, "log");
 	if (_errFun != NULL) {
 		char* time = plg_LogGetTimForm();
 		_errFun(level, describe, time, fileName, line);
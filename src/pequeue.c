@@ -19,11 +19,15 @@
 
 #include "plateform.h"
 #include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
 #include "padlist.h"
 #include "pelog.h"
 #include "pequeue.h"
 #include "psds.h"
 #include "plocks.h"
+#include "patomic.h"
+#include "ptimesys.h"
 
 #ifdef __APPLE__
 #include "psemaphore.h"
@@ -31,12 +35,69 @@
 #include <semaphore.h>
 #endif
 
+/*
+* Multi producer single consumer queue.
+* Producers claim a cell of a bounded ring with one atomic add on enqueuePos and publish
+* it through the cell sequence number (Vyukov's bounded queue), no lock is taken.
+* When the ring is full the value goes to the spill list under the mutex, and as long as
+* the spill list is not empty every producer keeps using it, so the order of one producer is kept.
+* The consumer only takes from the spill list once every claimed cell of the ring has been popped,
+* a cell claimed but not yet published holds the spill list back until its producer publishes and wakes it.
+* The consumer marks itself idle before sleeping, only the producer that observes
+* the idle flag posts the semaphore, so a busy consumer costs the producer no system call.
+*
+* depth counts the values pushed and not yet popped, peak is its highest value.
+* Producers that go through plg_eqPushLimit are held at highWater by the policy:
+* EQ_BLOCK waits on the space semaphore, the consumer posts it once when depth falls below highWater
+* and each woken producer passes it on to the next one waiting,
+* EQ_BUSY refuses the value, EQ_SHED drops the oldest value that shedFun allows, from the ring,
+* then from the spill list, then the new value itself, so depth stays at highWater.
+* A value shedFun allows is put in the ring with EQUEUE_SHEDTAG set, the values of such a queue must be aligned.
+* A producer sheds it by swapping the cell value to 0, the consumer takes values by swapping and skips empty cells.
+*
+* Control values take a second lane, a list under the mutex since they are few.
+* The consumer drains the control lane first but gives it at most three quarters of a batch
+* while normal values wait, so neither lane starves the other. The lanes are not ordered
+* against each other, only values that do not depend on the order of normal values may use it.
+*/
+#define EQUEUE_RINGSIZE 1024
+#define EQUEUE_RINGMASK (EQUEUE_RINGSIZE - 1)
+#define EQUEUE_SHEDTAG ((uintptr_t)1)
+
+typedef struct _QueueCell
+{
+	volatile long long sequence;
+	void* volatile value;
+} *PQueueCell, QueueCell;
+
 typedef struct _EventQueue
 {
 	void* mutexHandle;
 	sds objecName;
 	sem_t semaphore;
 	list* listQueue;
+	volatile long long spillCount;
+	list* listControl;
+	volatile long long controlCount;
+	volatile long idle;
+	volatile long long dequeuePos;
+	volatile long long enqueuePos;
+
+	//backpressure
+	volatile long long depth;
+	volatile long long peak;
+	unsigned int highWater;
+	int policy;
+	QueueShedFun shedFun;
+	void* shedCtx;
+	char tagged;
+	volatile long spaceWait;
+	sem_t space;
+	volatile long long busyCount;
+	volatile long long blockCount;
+	volatile long long shedCount;
+
+	QueueCell ring[EQUEUE_RINGSIZE];
 } *PEventQueue, EventQueue;
 
 
@@ -49,22 +110,449 @@ void* plg_eqCreate() {
 		elog(log_error, "semaphore init failut!");
 		return 0;
 	}
+	if (sem_init(&pEventQueue->space, PTHREAD_PROCESS_PRIVATE, 0) != 0) {
+		sem_destroy(&pEventQueue->semaphore);
+		free(pEventQueue);
+		elog(log_error, "semaphore init failut!");
+		return 0;
+	}
 	pEventQueue->listQueue = plg_listCreate(LIST_MIDDLE);
+	pEventQueue->listControl = plg_listCreate(LIST_MIDDLE);
+	pEventQueue->controlCount = 0;
 	pEventQueue->objecName = plg_sdsNew("equeue");
+	pEventQueue->spillCount = 0;
+	pEventQueue->idle = 0;
+	pEventQueue->dequeuePos = 0;
+	pEventQueue->enqueuePos = 0;
+	pEventQueue->depth = 0;
+	pEventQueue->peak = 0;
+	pEventQueue->highWater = 0;
+	pEventQueue->policy = EQ_BLOCK;
+	pEventQueue->shedFun = 0;
+	pEventQueue->shedCtx = 0;
+	pEventQueue->tagged = 0;
+	pEventQueue->spaceWait = 0;
+	pEventQueue->busyCount = 0;
+	pEventQueue->blockCount = 0;
+	pEventQueue->shedCount = 0;
+	for (long long l = 0; l < EQUEUE_RINGSIZE; l++) {
+		pEventQueue->ring[l].sequence = l;
+		pEventQueue->ring[l].value = 0;
+	}
 	return pEventQueue;
 }
 
+/*
+* The value as stored in the ring, tagged when a producer may shed it.
+*/
+static void* eq_RingValue(PEventQueue pEventQueue, void* value) {
+
+	if (pEventQueue->tagged && pEventQueue->shedFun(pEventQueue->shedCtx, value, 0)) {
+		return (void*)((uintptr_t)value | EQUEUE_SHEDTAG);
+	}
+	return value;
+}
+
+static int eq_RingPush(PEventQueue pEventQueue, void* value) {
+
+	value = eq_RingValue(pEventQueue, value);
+	long long pos = plg_AtomicLoad64(&pEventQueue->enqueuePos);
+	do {
+		PQueueCell pQueueCell = &pEventQueue->ring[pos & EQUEUE_RINGMASK];
+		long long dif = plg_AtomicLoad64(&pQueueCell->sequence) - pos;
+		if (dif == 0) {
+			if (plg_AtomicCas64(&pEventQueue->enqueuePos, pos, pos + 1)) {
+				pQueueCell->value = value;
+				plg_AtomicStore64(&pQueueCell->sequence, pos + 1);
+				return 1;
+			}
+		} else if (dif < 0) {
+			return 0;
+		}
+		pos = plg_AtomicLoad64(&pEventQueue->enqueuePos);
+	} while (1);
+}
+
+/*
+* Claims the free cells in front of enqueuePos with one compare and swap, returns how many were pushed.
+*/
+static unsigned int eq_RingPushBatch(PEventQueue pEventQueue, void** values, unsigned int count) {
+
+	long long pos = plg_AtomicLoad64(&pEventQueue->enqueuePos);
+	do {
+		unsigned int free = 0;
+		int retry = 0;
+		while (free < count && free < EQUEUE_RINGSIZE) {
+			long long dif = plg_AtomicLoad64(&pEventQueue->ring[(pos + free) & EQUEUE_RINGMASK].sequence) - (pos + free);
+			if (dif < 0) {
+				break;
+			} else if (dif > 0) {
+				retry = 1;
+				break;
+			}
+			free++;
+		}
+
+		if (!retry) {
+			if (free == 0) {
+				return 0;
+			}
+			if (plg_AtomicCas64(&pEventQueue->enqueuePos, pos, pos + free)) {
+				for (unsigned int l = 0; l < free; l++) {
+					PQueueCell pQueueCell = &pEventQueue->ring[(pos + l) & EQUEUE_RINGMASK];
+					pQueueCell->value = eq_RingValue(pEventQueue, values[l]);
+					plg_AtomicStore64(&pQueueCell->sequence, pos + l + 1);
+				}
+				return free;
+			}
+		}
+		pos = plg_AtomicLoad64(&pEventQueue->enqueuePos);
+	} while (1);
+}
+
+/*
+* Skips the cells whose value a producer has shed.
+*/
+static void* eq_RingPop(PEventQueue pEventQueue) {
+
+	do {
+		long long pos = pEventQueue->dequeuePos;
+		PQueueCell pQueueCell = &pEventQueue->ring[pos & EQUEUE_RINGMASK];
+		if (plg_AtomicLoad64(&pQueueCell->sequence) != pos + 1) {
+			return 0;
+		}
+		void* value = plg_AtomicExchangePtr(&pQueueCell->value, 0);
+		plg_AtomicStore64(&pQueueCell->sequence, pos + EQUEUE_RINGSIZE);
+		plg_AtomicStore64(&pEventQueue->dequeuePos, pos + 1);
+		if (value && pEventQueue->tagged) {
+			return (void*)((uintptr_t)value & ~EQUEUE_SHEDTAG);
+		} else if (value) {
+			return value;
+		}
+	} while (1);
+}
+
+/*
+* Only called by the consumer, the spill list may be popped when no cell of the ring is claimed.
+*/
+static int eq_SpillReady(PEventQueue pEventQueue) {
+
+	return plg_AtomicLoad64(&pEventQueue->spillCount) != 0 && plg_AtomicLoad64(&pEventQueue->enqueuePos) == pEventQueue->dequeuePos;
+}
+
+static int eq_IsEmpty(PEventQueue pEventQueue) {
+
+	PQueueCell pQueueCell = &pEventQueue->ring[pEventQueue->dequeuePos & EQUEUE_RINGMASK];
+	if (plg_AtomicLoad64(&pQueueCell->sequence) == pEventQueue->dequeuePos + 1) {
+		return 0;
+	}
+	return !eq_SpillReady(pEventQueue) && plg_AtomicLoad64(&pEventQueue->controlCount) == 0;
+}
+
+static void eq_Wakeup(PEventQueue pEventQueue) {
+
+	if (plg_AtomicExchange32(&pEventQueue->idle, 0) == 1) {
+		if (sem_post(&pEventQueue->semaphore) != 0) {
+			elog(log_error, "semaphore post failut!");
+		}
+	}
+}
+
+static void eq_AddDepth(PEventQueue pEventQueue, unsigned int count) {
+
+	long long depth = plg_AtomicAdd64(&pEventQueue->depth, count);
+	long long peak = plg_AtomicLoad64(&pEventQueue->peak);
+	while (depth > peak && !plg_AtomicCas64(&pEventQueue->peak, peak, depth)) {
+		peak = plg_AtomicLoad64(&pEventQueue->peak);
+	}
+}
+
 void plg_eqPush(void* pvEventQueue, void* value) {
 
 	PEventQueue pEventQueue = pvEventQueue;
+	eq_AddDepth(pEventQueue, 1);
+
+	if (plg_AtomicLoad64(&pEventQueue->spillCount) != 0 || !eq_RingPush(pEventQueue, value)) {
+		MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
+		plg_listAddNodeHead(pEventQueue->listQueue, value);
+		plg_AtomicAdd64(&pEventQueue->spillCount, 1);
+		MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	}
+
+	eq_Wakeup(pEventQueue);
+}
+
+/*
+* Control values are counted in depth but never held back by highWater.
+*/
+void plg_eqPushControl(void* pvEventQueue, void* value) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	eq_AddDepth(pEventQueue, 1);
+
 	MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
-	plg_listAddNodeHead(pEventQueue->listQueue, value);
+	plg_listAddNodeHead(pEventQueue->listControl, value);
+	plg_AtomicAdd64(&pEventQueue->controlCount, 1);
 	MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
 
-	if (sem_post(&pEventQueue->semaphore) != 0) {
-		elog(log_error, "semaphore post failut!");
+	eq_Wakeup(pEventQueue);
+}
+
+/*
+* The values keep their order, what does not fit in the ring goes to the spill list
+* under one lock, and the consumer is woken up once.
+*/
+void plg_eqPushBatch(void* pvEventQueue, void** values, unsigned int count) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	if (!count) {
 		return;
 	}
+	eq_AddDepth(pEventQueue, count);
+
+	unsigned int push = 0;
+	if (plg_AtomicLoad64(&pEventQueue->spillCount) == 0) {
+		push = eq_RingPushBatch(pEventQueue, values, count);
+	}
+
+	if (push < count) {
+		MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
+		for (unsigned int l = push; l < count; l++) {
+			plg_listAddNodeHead(pEventQueue->listQueue, values[l]);
+		}
+		plg_AtomicAdd64(&pEventQueue->spillCount, count - push);
+		MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	}
+
+	eq_Wakeup(pEventQueue);
+}
+
+/*
+* highWater 0 leaves the queue unbounded.
+* shedFun is called by the producers with drop 0 to ask whether a value may be shed,
+* and with drop 1 outside the queue lock to free the value that was shed.
+* Set before the queue is used, only an EQ_SHED queue with shedFun tags its ring values.
+*/
+void plg_eqSetLimit(void* pvEventQueue, unsigned int highWater, int policy, QueueShedFun shedFun, void* shedCtx) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	pEventQueue->highWater = highWater;
+	pEventQueue->policy = policy;
+	pEventQueue->shedFun = shedFun;
+	pEventQueue->shedCtx = shedCtx;
+	pEventQueue->tagged = (policy == EQ_SHED && shedFun);
+}
+
+/*
+* Takes the oldest value that may be shed out of the ring, a cell of a later round still holds a queued value.
+*/
+static void* eq_ShedRing(PEventQueue pEventQueue) {
+
+	if (!pEventQueue->tagged) {
+		return 0;
+	}
+
+	long long pos = plg_AtomicLoad64(&pEventQueue->dequeuePos);
+	long long end = plg_AtomicLoad64(&pEventQueue->enqueuePos);
+	for (; pos < end; pos++) {
+		PQueueCell pQueueCell = &pEventQueue->ring[pos & EQUEUE_RINGMASK];
+		void* value = plg_AtomicLoadPtr(&pQueueCell->value);
+		if (((uintptr_t)value & EQUEUE_SHEDTAG) && plg_AtomicCasPtr(&pQueueCell->value, value, 0)) {
+			return (void*)((uintptr_t)value & ~EQUEUE_SHEDTAG);
+		}
+	}
+	return 0;
+}
+
+/*
+* Takes the oldest value that may be shed out of the queue and frees it.
+*/
+static int eq_ShedOldest(PEventQueue pEventQueue) {
+
+	if (!pEventQueue->shedFun) {
+		return 0;
+	}
+
+	void* value = eq_ShedRing(pEventQueue);
+	if (value) {
+		plg_AtomicSub64(&pEventQueue->depth, 1);
+		plg_AtomicAdd64(&pEventQueue->shedCount, 1);
+		pEventQueue->shedFun(pEventQueue->shedCtx, value, 1);
+		return 1;
+	} else if (plg_AtomicLoad64(&pEventQueue->spillCount) == 0) {
+		return 0;
+	}
+
+	MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	listIter* iter = plg_listGetIterator(pEventQueue->listQueue, AL_START_TAIL);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		if (pEventQueue->shedFun(pEventQueue->shedCtx, listNodeValue(node), 0)) {
+			value = listNodeValue(node);
+			plg_listDelNode(pEventQueue->listQueue, node);
+			plg_AtomicSub64(&pEventQueue->spillCount, 1);
+			plg_AtomicSub64(&pEventQueue->depth, 1);
+			break;
+		}
+	}
+	plg_listReleaseIterator(iter);
+	MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+
+	if (!value) {
+		return 0;
+	}
+	plg_AtomicAdd64(&pEventQueue->shedCount, 1);
+	pEventQueue->shedFun(pEventQueue->shedCtx, value, 1);
+	return 1;
+}
+
+/*
+* Sheds the new value itself, returns 0 when it may not be shed and has to be pushed.
+*/
+static int eq_ShedNew(PEventQueue pEventQueue, void* value) {
+
+	if (!pEventQueue->shedFun || !pEventQueue->shedFun(pEventQueue->shedCtx, value, 0)) {
+		return 0;
+	}
+	plg_AtomicAdd64(&pEventQueue->shedCount, 1);
+	pEventQueue->shedFun(pEventQueue->shedCtx, value, 1);
+	return 1;
+}
+
+/*
+* Returns EQ_PUSH when the value was pushed or shed, EQ_FULL when the policy is EQ_BLOCK and the caller
+* has to plg_eqWaitSpace before trying again, EQ_REFUSE when the policy is EQ_BUSY.
+*/
+int plg_eqPushLimit(void* pvEventQueue, void* value) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	if (pEventQueue->highWater && plg_AtomicLoad64(&pEventQueue->depth) >= pEventQueue->highWater) {
+		if (pEventQueue->policy == EQ_BUSY) {
+			plg_AtomicAdd64(&pEventQueue->busyCount, 1);
+			return EQ_REFUSE;
+		} else if (pEventQueue->policy == EQ_SHED) {
+			if (!eq_ShedOldest(pEventQueue) && eq_ShedNew(pEventQueue, value)) {
+				return EQ_PUSH;
+			}
+		} else {
+			return EQ_FULL;
+		}
+	}
+
+	plg_eqPush(pEventQueue, value);
+	return EQ_PUSH;
+}
+
+/*
+* Same as plg_eqPushLimit for a group of values, the group is taken or refused as a whole,
+* so a blocked group may pass highWater by its size.
+* With EQ_SHED the values that do not fit are shed oldest first, from the spill list and then from the group,
+* the values left are pushed and moved to the front of values.
+*/
+int plg_eqPushBatchLimit(void* pvEventQueue, void** values, unsigned int count) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	if (pEventQueue->highWater) {
+		long long over = plg_AtomicLoad64(&pEventQueue->depth) + count - pEventQueue->highWater;
+		if (pEventQueue->policy == EQ_SHED) {
+			unsigned int keep = 0;
+			int oldest = 1;
+			for (unsigned int l = 0; l < count; l++) {
+				if (over > 0) {
+					if (oldest && (oldest = eq_ShedOldest(pEventQueue))) {
+						over -= 1;
+					} else if (eq_ShedNew(pEventQueue, values[l])) {
+						over -= 1;
+						continue;
+					}
+				}
+				values[keep++] = values[l];
+			}
+			count = keep;
+		} else if (over >= count) {
+			if (pEventQueue->policy == EQ_BUSY) {
+				plg_AtomicAdd64(&pEventQueue->busyCount, count);
+				return EQ_REFUSE;
+			}
+			return EQ_FULL;
+		}
+	}
+
+	plg_eqPushBatch(pEventQueue, values, count);
+	return EQ_PUSH;
+}
+
+/*
+* Blocks until the depth is below highWater.
+* spaceWait is raised before depth is read, so a consumer that takes depth below highWater
+* after that read sees the waiter and posts space. A woken waiter passes the post on
+* while others still wait and there is space, a post left over only costs one more check.
+*/
+void plg_eqWaitSpace(void* pvEventQueue) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	plg_AtomicAdd64(&pEventQueue->blockCount, 1);
+	plg_AtomicAdd32(&pEventQueue->spaceWait, 1);
+	while (pEventQueue->highWater && plg_AtomicLoad64(&pEventQueue->depth) >= pEventQueue->highWater) {
+		if (sem_wait(&pEventQueue->space) != 0 && errno != EINTR) {
+			elog(log_error, "semaphore wait failut!");
+			break;
+		}
+	}
+	if (plg_AtomicSub32(&pEventQueue->spaceWait, 1) > 0 && plg_AtomicLoad64(&pEventQueue->depth) < pEventQueue->highWater) {
+		sem_post(&pEventQueue->space);
+	}
+}
+
+void plg_eqStat(void* pvEventQueue, PQueueStat pQueueStat) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	pQueueStat->depth = plg_AtomicLoad64(&pEventQueue->depth);
+	pQueueStat->peak = plg_AtomicLoad64(&pEventQueue->peak);
+	pQueueStat->busy = plg_AtomicLoad64(&pEventQueue->busyCount);
+	pQueueStat->block = plg_AtomicLoad64(&pEventQueue->blockCount);
+	pQueueStat->shed = plg_AtomicLoad64(&pEventQueue->shedCount);
+}
+
+/*
+* Values waiting plus one while the consumer is awake, 0 means the consumer sleeps on an empty queue.
+*/
+unsigned long long plg_eqLoad(void* pvEventQueue) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	return plg_AtomicLoad64(&pEventQueue->depth) + (plg_AtomicLoad32(&pEventQueue->idle) ? 0 : 1);
+}
+
+/*
+* Only called by the consumer after it took count values, space is posted once when depth falls below highWater.
+*/
+static void eq_Popped(PEventQueue pEventQueue, unsigned int count) {
+
+	long long depth = plg_AtomicSub64(&pEventQueue->depth, count);
+	long long highWater = pEventQueue->highWater;
+	if (depth < highWater && depth + count >= highWater && plg_AtomicLoad32(&pEventQueue->spaceWait)) {
+		sem_post(&pEventQueue->space);
+	}
+}
+
+/*
+* Only called by the consumer.
+* Returns 1 when there is something to pop, 0 when the consumer must sleep.
+*/
+static int eq_PrepareWait(PEventQueue pEventQueue) {
+
+	if (!eq_IsEmpty(pEventQueue)) {
+		return 1;
+	}
+
+	//A plain store may pass the loads of eq_IsEmpty, the producer would then miss the idle flag.
+	plg_AtomicExchange32(&pEventQueue->idle, 1);
+	if (!eq_IsEmpty(pEventQueue)) {
+		//The producer may already have posted, a stale post only causes one more loop.
+		plg_AtomicExchange32(&pEventQueue->idle, 0);
+		return 1;
+	}
+	return 0;
 }
 
 int plg_eqTimeWait(void* pvEventQueue, long long sec, int nsec) {
@@ -73,35 +561,131 @@ int plg_eqTimeWait(void* pvEventQueue, long long sec, int nsec) {
 	struct timespec ts;
 	ts.tv_sec = sec;
 	ts.tv_nsec = nsec;
-	return sem_timedwait(&pEventQueue->semaphore, &ts);
+
+	while (!eq_PrepareWait(pEventQueue)) {
+		if (sem_timedwait(&pEventQueue->semaphore, &ts) != 0 && errno != EINTR) {
+			plg_AtomicExchange32(&pEventQueue->idle, 0);
+			return eq_IsEmpty(pEventQueue) ? -1 : 0;
+		}
+	}
+	return 0;
 }
 
 int plg_eqWait(void* pvEventQueue) {
+
 	PEventQueue pEventQueue = pvEventQueue;
-	return sem_wait(&pEventQueue->semaphore);
+	while (!eq_PrepareWait(pEventQueue)) {
+		if (sem_wait(&pEventQueue->semaphore) != 0 && errno != EINTR) {
+			plg_AtomicExchange32(&pEventQueue->idle, 0);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+* Only called by the consumer, returns the number of control values moved to values.
+*/
+static unsigned int eq_ControlPop(PEventQueue pEventQueue, void** values, unsigned int max) {
+
+	if (!max || plg_AtomicLoad64(&pEventQueue->controlCount) == 0) {
+		return 0;
+	}
+
+	unsigned int count = 0;
+	MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	while (count < max && listLength(pEventQueue->listControl) != 0) {
+		listNode *node = listLast(pEventQueue->listControl);
+		values[count++] = listNodeValue(node);
+		plg_listDelNode(pEventQueue->listControl, node);
+	}
+	plg_AtomicSub64(&pEventQueue->controlCount, count);
+	MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	return count;
 }
 
 void* plg_eqPop(void* pvEventQueue) {
+
 	PEventQueue pEventQueue = pvEventQueue;
 	void* value = 0;
+	if (eq_ControlPop(pEventQueue, &value, 1)) {
+		eq_Popped(pEventQueue, 1);
+		return value;
+	}
+
+	value = eq_RingPop(pEventQueue);
+	if (value || !eq_SpillReady(pEventQueue)) {
+		if (value) {
+			eq_Popped(pEventQueue, 1);
+		}
+		return value;
+	}
+
 	MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
 	if (listLength(pEventQueue->listQueue) != 0) {
 		listNode *node = listLast(pEventQueue->listQueue);
 		value = listNodeValue(node);
 		plg_listDelNode(pEventQueue->listQueue, node);
+		plg_AtomicSub64(&pEventQueue->spillCount, 1);
 	}
 	MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	if (value) {
+		eq_Popped(pEventQueue, 1);
+	}
 	return value;
 }
 
+unsigned int plg_eqPopBatch(void* pvEventQueue, void** values, unsigned int max) {
+
+	PEventQueue pEventQueue = pvEventQueue;
+	unsigned int count = eq_ControlPop(pEventQueue, values, max - max / 4);
+	while (count < max) {
+		void* value = eq_RingPop(pEventQueue);
+		if (!value) {
+			break;
+		}
+		values[count++] = value;
+	}
+
+	if (count < max && eq_SpillReady(pEventQueue)) {
+		MutexLock(pEventQueue->mutexHandle, pEventQueue->objecName);
+		while (count < max && listLength(pEventQueue->listQueue) != 0) {
+			listNode *node = listLast(pEventQueue->listQueue);
+			values[count++] = listNodeValue(node);
+			plg_listDelNode(pEventQueue->listQueue, node);
+			plg_AtomicSub64(&pEventQueue->spillCount, 1);
+		}
+		MutexUnlock(pEventQueue->mutexHandle, pEventQueue->objecName);
+	}
+
+	//the normal lane left room in the batch
+	count += eq_ControlPop(pEventQueue, values + count, max - count);
+
+	if (count) {
+		eq_Popped(pEventQueue, count);
+	}
+	return count;
+}
+
 void plg_eqDestory(void* pvEventQueue, QueuerDestroyFun fun) {
 	PEventQueue pEventQueue = pvEventQueue;
 	elog(log_fun, "plg_eqDestory:%U", pEventQueue);
+
+	void* value;
+	while ((value = eq_RingPop(pEventQueue)) != 0) {
+		if (fun) {
+			fun(value);
+		}
+	}
+
 	plg_sdsFree(pEventQueue->objecName);
 	listSetFreeMethod(pEventQueue->listQueue, fun);
 	plg_listRelease(pEventQueue->listQueue);
+	listSetFreeMethod(pEventQueue->listControl, fun);
+	plg_listRelease(pEventQueue->listControl);
 
 	sem_destroy(&pEventQueue->semaphore);
+	sem_destroy(&pEventQueue->space);
 	plg_MutexDestroyHandle(pEventQueue->mutexHandle);
 	free(pEventQueue);
-}
\ No newline at end of file
+}
@@ -21,11 +21,41 @@
 #define __EQUEUE_H
 
 typedef void(*QueuerDestroyFun)(void* value);
+typedef int(*QueueShedFun)(void* ctx, void* value, int drop);
+
+//policy of plg_eqSetLimit, values match enum QueuePolicy of pelagia.h
+#define EQ_BLOCK 1
+#define EQ_BUSY 2
+#define EQ_SHED 3
+
+//return of plg_eqPushLimit
+#define EQ_PUSH 1
+#define EQ_FULL 0
+#define EQ_REFUSE -1
+
+typedef struct _QueueStat
+{
+	unsigned long long depth;
+	unsigned long long peak;
+	unsigned long long busy;
+	unsigned long long block;
+	unsigned long long shed;
+} *PQueueStat, QueueStat;
+
 void* plg_eqCreate();
 void plg_eqPush(void* pEventQueue, void* value);
+void plg_eqPushControl(void* pEventQueue, void* value);
+void plg_eqSetLimit(void* pEventQueue, unsigned int highWater, int policy, QueueShedFun shedFun, void* shedCtx);
+int plg_eqPushLimit(void* pEventQueue, void* value);
+void plg_eqPushBatch(void* pEventQueue, void** values, unsigned int count);
+int plg_eqPushBatchLimit(void* pEventQueue, void** values, unsigned int count);
+void plg_eqWaitSpace(void* pEventQueue);
+void plg_eqStat(void* pEventQueue, PQueueStat pQueueStat);
+unsigned long long plg_eqLoad(void* pEventQueue);
 int plg_eqTimeWait(void* pEventQueue, long long sec, int nsec);
 int plg_eqWait(void* pEventQueue);
 void* plg_eqPop(void* pEventQueue);
+unsigned int plg_eqPopBatch(void* pEventQueue, void** values, unsigned int max);
 void plg_eqDestory(void* pEventQueue, QueuerDestroyFun fun);
 
 #endif
\ No newline at end of file
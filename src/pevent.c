@@ -36,6 +36,9 @@ void plg_EventDestroyHandle(void* pEventHandle) {
 
 void plg_EventSend(void* pEventHandle, const char* value, unsigned int valueLen) {
 	sds sdsvalue = plg_sdsNewLen(value, valueLen);
+	if (job_HoldEvent(pEventHandle, sdsvalue)) {
+		return;
+	}
 	plg_eqPush(pEventHandle, sdsvalue);
 }
 
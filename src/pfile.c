@@ -28,6 +28,7 @@
 #include "pmemorylist.h"
 #include "pfilesys.h"
 #include "pelagia.h"
+#include "patomic.h"
 
 #define FileName(filePath) (strrchr(filePath, '\\') ? (strrchr(filePath, '\\') + 1):filePath)
 
@@ -50,7 +51,7 @@ void* plg_FileJobHandle(void* pvFileHandle) {
 
 static int OrderDestroy(char* value, short valueLen) {
 	elog(log_fun, "file.OrderDestroy");
-	plg_JobSendOrder(job_ManageEqueue(), "destroycount", value, valueLen);
+	plg_JobSendControl(job_ManageEqueue(), "destroycount", value, valueLen);
 	plg_JobSExitThread(1);
 	return 1;
 }
@@ -64,24 +65,28 @@ void file_FreePageArrary(void* pvFileHandle, void** memArrary, unsigned int size
 	free(memArrary);
 }
 
+static void file_WritePage(PFileHandle pFileHandle, unsigned int pageAddr, void* page) {
+
+	//check length
+	fseek_t(pFileHandle->fileHandle, 0, SEEK_END);
+	unsigned long long fileLength = ftell_t(pFileHandle->fileHandle);
+	unsigned long long newFileLength = pageAddr * pFileHandle->fullPageSize + pFileHandle->fullPageSize;
+	if (fileLength < newFileLength) {
+		plg_SysSetFileLength(pFileHandle->fileHandle, newFileLength);
+	}
+
+	//write to file ftruncate
+	fseek_t(pFileHandle->fileHandle, pageAddr * pFileHandle->fullPageSize, SEEK_SET);
+	fwrite(page, 1, pFileHandle->fullPageSize, pFileHandle->fileHandle);
+}
+
 unsigned int plg_FileInsideFlushPage(void* pvFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize) {
 
 	elog(log_fun, "plg_FileInsideFlushPage");
 	PFileHandle pFileHandle = pvFileHandle;
 
 	for (unsigned int l = 0; l < pageArrarySize; l++) {
-
-		//check length
-		fseek_t(pFileHandle->fileHandle, 0, SEEK_END);
-		unsigned long long fileLength = ftell_t(pFileHandle->fileHandle);
-		unsigned long long newFileLength = pageAddr[l] * pFileHandle->fullPageSize + pFileHandle->fullPageSize;
-		if (fileLength < newFileLength) {
-			plg_SysSetFileLength(pFileHandle->fileHandle, newFileLength);
-		}
-
-		//write to file ftruncate
-		fseek_t(pFileHandle->fileHandle, pageAddr[l] * pFileHandle->fullPageSize, SEEK_SET);
-		fwrite(pageArrary[l], 1, pFileHandle->fullPageSize, pFileHandle->fileHandle);
+		file_WritePage(pFileHandle, pageAddr[l], pageArrary[l]);
 	}
 
 	//close file
@@ -106,6 +111,71 @@ static int OrderFlushPage(char* value, short valueLen) {
 	return 1;
 }
 
+/*
+A page of a shared flush.
+released:the sender will change or free page, set once by plg_FileFlushDetach.
+own:page is a copy made by plg_FileFlushDetach, the file thread frees it.
+written:page is in the file.
+*/
+typedef struct _FileFlushPage
+{
+	struct _FileFlush* pFileFlush;
+	unsigned int pageAddr;
+	void* page;
+	unsigned char released;
+	unsigned char own;
+	unsigned char written;
+} *PFileFlushPage, FileFlushPage;
+
+/*
+Pages written by the file thread straight from the buffers of the sender.
+The sender must not change a page before it has called plg_FileFlushDetach on it.
+ref:one for the sender and one for the file thread, the last plg_FileFlushRelease frees the flush.
+The sender only touches the flush itself, never pFileHandle, the file may be destroyed first at shutdown.
+pFlushPrepare:run by the file thread on each page just before it is written, such as the checksum.
+done:every page is in the file, set under mutexHandle, see plg_FileFlushIsDone.
+*/
+typedef struct _FileFlush
+{
+	PFileHandle pFileHandle;
+	void* mutexHandle;
+	unsigned int fullPageSize;
+	FlushPrepare pFlushPrepare;
+	PFileFlushPage pageArrary;
+	unsigned int pageArrarySize;
+	unsigned int ref;
+	unsigned char done;
+} *PFileFlush, FileFlush;
+
+static int OrderFlushShare(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PFileFlush pFileFlush = *(PFileFlush*)value;
+	PFileHandle pFileHandle = pFileFlush->pFileHandle;
+	elog(log_fun, "file.OrderFlushShare");
+
+	for (unsigned int l = 0; l < pFileFlush->pageArrarySize; l++) {
+		PFileFlushPage pFileFlushPage = &pFileFlush->pageArrary[l];
+		MutexLock(pFileFlush->mutexHandle, pFileHandle->objName);
+		if (pFileFlush->pFlushPrepare) {
+			pFileFlush->pFlushPrepare(pFileFlushPage->page, pFileHandle->fullPageSize);
+		}
+		file_WritePage(pFileHandle, pFileFlushPage->pageAddr, pFileFlushPage->page);
+		pFileFlushPage->written = 1;
+		if (pFileFlushPage->own) {
+			free(pFileFlushPage->page);
+		}
+		pFileFlushPage->page = 0;
+		MutexUnlock(pFileFlush->mutexHandle, pFileHandle->objName);
+	}
+
+	fflush(pFileHandle->fileHandle);
+	MutexLock(pFileFlush->mutexHandle, pFileHandle->objName);
+	pFileFlush->done = 1;
+	MutexUnlock(pFileFlush->mutexHandle, pFileHandle->objName);
+	plg_FileFlushRelease(pFileFlush);
+	return 1;
+}
+
 void* plg_FileCreateHandle(char* fullPath, void* pManageEqueue, unsigned int fullPageSize) {
 	PFileHandle pFileHandle = malloc(sizeof(FileHandle));
 	pFileHandle->filePath = fullPath;
@@ -128,6 +198,7 @@ void* plg_FileCreateHandle(char* fullPath, void* pManageEqueue, unsigned int ful
 	//order process
 	plg_JobAddAdmOrderProcess(pFileHandle->pJobHandle, "destroy", plg_JobCreateFunPtr(OrderDestroy));
 	plg_JobAddAdmOrderProcess(pFileHandle->pJobHandle, "flush", plg_JobCreateFunPtr(OrderFlushPage));
+	plg_JobAddAdmOrderProcess(pFileHandle->pJobHandle, "flushshare", plg_JobCreateFunPtr(OrderFlushShare));
 	return pFileHandle;
 }
 
@@ -210,4 +281,99 @@ unsigned int plg_FileFlushPage(void* pvFileHandle, unsigned int* pageAddr, void*
 
 	plg_JobSendOrder(plg_JobEqueueHandle(pFileHandle->pJobHandle), "flush", (char*)&orderFlushPageValue, sizeof(OrderFlushPageValue));
 	return 1;
-}
\ No newline at end of file
+}
+
+/*
+Write the pages without copying them, the pages stay owned by the caller.
+The file thread calls pFlushPrepare on each page, the caller only hands over the pages.
+Returns the flush with one reference for the caller, see plg_FileFlushSlot and plg_FileFlushRelease.
+*/
+void* plg_FileFlushShare(void* pvFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize, FlushPrepare pFlushPrepare) {
+
+	PFileHandle pFileHandle = pvFileHandle;
+	PFileFlush pFileFlush = malloc(sizeof(FileFlush));
+	pFileFlush->pFileHandle = pFileHandle;
+	pFileFlush->mutexHandle = plg_MutexCreateHandle(3);
+	pFileFlush->fullPageSize = pFileHandle->fullPageSize;
+	pFileFlush->pFlushPrepare = pFlushPrepare;
+	pFileFlush->pageArrary = malloc(pageArrarySize * sizeof(FileFlushPage));
+	pFileFlush->pageArrarySize = pageArrarySize;
+	pFileFlush->ref = 2;
+	pFileFlush->done = 0;
+	for (unsigned int l = 0; l < pageArrarySize; l++) {
+		PFileFlushPage pFileFlushPage = &pFileFlush->pageArrary[l];
+		pFileFlushPage->pFileFlush = pFileFlush;
+		pFileFlushPage->pageAddr = pageAddr[l];
+		pFileFlushPage->page = pageArrary[l];
+		pFileFlushPage->released = 0;
+		pFileFlushPage->own = 0;
+		pFileFlushPage->written = 0;
+	}
+
+	plg_JobSendOrder(plg_JobEqueueHandle(pFileHandle->pJobHandle), "flushshare", (char*)&pFileFlush, sizeof(PFileFlush));
+	return pFileFlush;
+}
+
+/*
+The page of index l, valid while the caller holds its reference.
+*/
+void* plg_FileFlushSlot(void* pvFileFlush, unsigned int l) {
+	PFileFlush pFileFlush = pvFileFlush;
+	return &pFileFlush->pageArrary[l];
+}
+
+unsigned int plg_FileFlushLength(void* pvFileFlush) {
+	PFileFlush pFileFlush = pvFileFlush;
+	return pFileFlush->pageArrarySize;
+}
+
+unsigned int plg_FileFlushAddr(void* pvFileFlush, unsigned int l) {
+	PFileFlush pFileFlush = pvFileFlush;
+	return pFileFlush->pageArrary[l].pageAddr;
+}
+
+/*
+1 once the file thread has written every page of this flush, flushes of other senders do not count.
+*/
+int plg_FileFlushIsDone(void* pvFileFlush) {
+
+	PFileFlush pFileFlush = pvFileFlush;
+	MutexLock(pFileFlush->mutexHandle, "flush");
+	int done = pFileFlush->done;
+	MutexUnlock(pFileFlush->mutexHandle, "flush");
+	return done;
+}
+
+/*
+The caller is about to change or free the page of the slot.
+If it is not written yet the file thread gets its own copy, so a new version is only made for pages changed in flight.
+*/
+void plg_FileFlushDetach(void* pvFileFlushPage) {
+
+	PFileFlushPage pFileFlushPage = pvFileFlushPage;
+	if (pFileFlushPage->released) {
+		return;
+	}
+
+	PFileFlush pFileFlush = pFileFlushPage->pFileFlush;
+	MutexLock(pFileFlush->mutexHandle, "flush");
+	if (pFileFlushPage->written == 0) {
+		void* page = malloc(pFileFlush->fullPageSize);
+		memcpy(page, pFileFlushPage->page, pFileFlush->fullPageSize);
+		pFileFlushPage->page = page;
+		pFileFlushPage->own = 1;
+	}
+	pFileFlushPage->released = 1;
+	MutexUnlock(pFileFlush->mutexHandle, "flush");
+}
+
+void plg_FileFlushRelease(void* pvFileFlush) {
+
+	PFileFlush pFileFlush = pvFileFlush;
+	if (plg_AtomicSub32(&pFileFlush->ref, 1) != 0) {
+		return;
+	}
+	plg_MutexDestroyHandle(pFileFlush->mutexHandle);
+	free(pFileFlush->pageArrary);
+	free(pFileFlush);
+}
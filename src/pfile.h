@@ -20,6 +20,7 @@
 #define __FILE_H
 
 typedef unsigned int(*FlushCallBack)(void* pFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize);
+typedef void(*FlushPrepare)(void* page, unsigned int fullPageSize);
 
 unsigned int plg_FileInsideFlushPage(void* pFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize);
 unsigned int plg_FileFlushPage(void* pFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize);
@@ -28,5 +29,12 @@ void* plg_FileCreateHandle(char* fullPath, void* pManageEqueue, unsigned int pag
 void plg_FileDestoryHandle(void* pFileHandle);
 void* plg_FileJobHandle(void* pFileHandle);
 void plg_FileMallocPageArrary(void* pFileHandle, void*** memArrary, unsigned int size);
+void* plg_FileFlushShare(void* pFileHandle, unsigned int* pageAddr, void** pageArrary, unsigned int pageArrarySize, FlushPrepare pFlushPrepare);
+void* plg_FileFlushSlot(void* pFileFlush, unsigned int l);
+unsigned int plg_FileFlushLength(void* pFileFlush);
+unsigned int plg_FileFlushAddr(void* pFileFlush, unsigned int l);
+int plg_FileFlushIsDone(void* pFileFlush);
+void plg_FileFlushDetach(void* pFileFlushPage);
+void plg_FileFlushRelease(void* pFileFlush);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,296 @@
+/* future.c - Reply slots of plg_MngCall and plg_JobCall
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+
+#include "plateform.h"
+#include <pthread.h>
+#include <errno.h>
+#include "pelog.h"
+#include "patomic.h"
+#include "ptimesys.h"
+#include "pfuture.h"
+
+#ifdef __APPLE__
+#include "psemaphore.h"
+#else
+#include <semaphore.h>
+#endif
+
+/*
+A future is the reply slot of one call, allocated by the caller and carried by the packet.
+The handler writes the reply with plg_FutureSetReply, the job completes the future when it frees
+the packet, so a group commit publishes the reply only after the commit and a packet dropped
+without reply completes it as well.
+refCount is one for the caller and one for the packet, whoever drops it to zero gives it back.
+A waiter set with plg_FutureSetWaiter is called once by the thread completing the future,
+waiter moves 0 -> 1 when it is set and to 2 on completion, whoever sees the other side acts,
+a waiter that was called moves on to 3 when it returns.
+Replies up to FUTURE_INLINESIZE use the slot itself, larger ones are allocated.
+The pool works like the packet pool: only the owner allocates, any thread gives back on returnStack.
+*/
+#define FUTURE_INLINESIZE 256
+#define FUTURE_MAXFREE 256
+
+#define FUTURE_WAIT 0
+#define FUTURE_DONE 1
+
+#define WAITER_NONE 0
+#define WAITER_SET 1
+#define WAITER_DONE 2
+#define WAITER_CALLED 3
+
+typedef struct _Future
+{
+	sem_t semaphore;
+	volatile long state;
+	volatile long refCount;
+	volatile long waiter;
+	FutureWaiterFun waiterFun;
+	void* waiterCtx;
+	char replied;
+	unsigned int valueLen;
+	char* value;
+	void* pFuturePool;
+	struct _Future* next;
+	char slot[FUTURE_INLINESIZE];
+} *PFuture, Future;
+
+typedef struct _FuturePool
+{
+	PFuture freeList;
+	unsigned int freeCount;
+	PFuture volatile returnStack;
+	volatile long long refCount;
+} *PFuturePool, FuturePool;
+
+void* plg_FuturePoolCreate() {
+
+	PFuturePool pFuturePool = malloc(sizeof(FuturePool));
+	pFuturePool->freeList = 0;
+	pFuturePool->freeCount = 0;
+	pFuturePool->returnStack = 0;
+	pFuturePool->refCount = 1;
+	return pFuturePool;
+}
+
+static void future_FreeList(PFuture pFuture) {
+
+	while (pFuture) {
+		PFuture next = pFuture->next;
+		sem_destroy(&pFuture->semaphore);
+		free(pFuture);
+		pFuture = next;
+	}
+}
+
+static void future_PoolRelease(PFuturePool pFuturePool) {
+
+	if (plg_AtomicSub64(&pFuturePool->refCount, 1) == 0) {
+		future_FreeList(pFuturePool->freeList);
+		future_FreeList(pFuturePool->returnStack);
+		free(pFuturePool);
+	}
+}
+
+void plg_FuturePoolDestroy(void* pvFuturePool) {
+
+	PFuturePool pFuturePool = pvFuturePool;
+	if (pFuturePool) {
+		future_PoolRelease(pFuturePool);
+	}
+}
+
+void* plg_FutureAlloc(void* pvFuturePool) {
+
+	PFuturePool pFuturePool = pvFuturePool;
+	if (!pFuturePool->freeList) {
+		pFuturePool->freeList = plg_AtomicExchangePtr(&pFuturePool->returnStack, 0);
+		pFuturePool->freeCount = 0;
+		for (PFuture pFuture = pFuturePool->freeList; pFuture; pFuture = pFuture->next) {
+			if (++pFuturePool->freeCount == FUTURE_MAXFREE) {
+				future_FreeList(pFuture->next);
+				pFuture->next = 0;
+				break;
+			}
+		}
+	}
+
+	PFuture pFuture = pFuturePool->freeList;
+	if (pFuture) {
+		pFuturePool->freeList = pFuture->next;
+		pFuturePool->freeCount -= 1;
+	} else {
+		pFuture = malloc(sizeof(Future));
+		if (sem_init(&pFuture->semaphore, PTHREAD_PROCESS_PRIVATE, 0) != 0) {
+			free(pFuture);
+			elog(log_error, "semaphore init failut!");
+			return 0;
+		}
+	}
+
+	plg_AtomicAdd64(&pFuturePool->refCount, 1);
+	pFuture->pFuturePool = pFuturePool;
+	pFuture->state = FUTURE_WAIT;
+	pFuture->refCount = 2;
+	pFuture->waiter = WAITER_NONE;
+	pFuture->replied = 0;
+	pFuture->valueLen = 0;
+	pFuture->value = pFuture->slot;
+	pFuture->next = 0;
+	return pFuture;
+}
+
+static void future_Release(PFuture pFuture) {
+
+	if (plg_AtomicSub32(&pFuture->refCount, 1) != 0) {
+		return;
+	}
+
+	//the post of the completion may not have been waited for
+	while (sem_trywait(&pFuture->semaphore) == 0);
+	if (pFuture->value != pFuture->slot) {
+		free(pFuture->value);
+	}
+
+	PFuturePool pFuturePool = pFuture->pFuturePool;
+	PFuture head;
+	do {
+		head = plg_AtomicLoadPtr(&pFuturePool->returnStack);
+		pFuture->next = head;
+	} while (!plg_AtomicCasPtr(&pFuturePool->returnStack, head, pFuture));
+
+	future_PoolRelease(pFuturePool);
+}
+
+/*
+Called by the handler, a later reply replaces the earlier one.
+*/
+void plg_FutureSetReply(void* pvFuture, char* value, unsigned int valueLen) {
+
+	PFuture pFuture = pvFuture;
+	if (pFuture->value != pFuture->slot) {
+		free(pFuture->value);
+		pFuture->value = pFuture->slot;
+	}
+	if (valueLen > FUTURE_INLINESIZE) {
+		pFuture->value = malloc(valueLen);
+	}
+	memcpy(pFuture->value, value, valueLen);
+	pFuture->valueLen = valueLen;
+	pFuture->replied = 1;
+}
+
+/*
+Called once when the packet carrying the future is freed, drops the reference of the packet.
+*/
+void plg_FutureComplete(void* pvFuture) {
+
+	PFuture pFuture = pvFuture;
+	plg_AtomicStore32(&pFuture->state, FUTURE_DONE);
+	if (sem_post(&pFuture->semaphore) != 0) {
+		elog(log_error, "semaphore post failut!");
+	}
+	if (plg_AtomicExchange32(&pFuture->waiter, WAITER_DONE) == WAITER_SET) {
+		pFuture->waiterFun(pFuture->waiterCtx);
+		plg_AtomicStore32(&pFuture->waiter, WAITER_CALLED);
+	}
+	future_Release(pFuture);
+}
+
+/*
+milli 0 waits until the future is complete, returns 1 when it is complete and 0 on timeout.
+*/
+int plg_FutureWait(void* pvFuture, unsigned int milli) {
+
+	PFuture pFuture = pvFuture;
+	if (milli == 0) {
+		while (plg_AtomicLoad32(&pFuture->state) != FUTURE_DONE) {
+			sem_wait(&pFuture->semaphore);
+		}
+		return 1;
+	}
+
+	unsigned long long deadline = plg_GetCurrentMilli() + milli;
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000;
+	ts.tv_nsec = (deadline % 1000) * 1000000;
+	while (plg_AtomicLoad32(&pFuture->state) != FUTURE_DONE) {
+		if (sem_timedwait(&pFuture->semaphore, &ts) != 0 && errno != EINTR) {
+			return plg_AtomicLoad32(&pFuture->state) == FUTURE_DONE;
+		}
+	}
+	return 1;
+}
+
+/*
+Only one waiter per future, returns 0 without calling it when the future is already complete.
+*/
+int plg_FutureSetWaiter(void* pvFuture, FutureWaiterFun fun, void* ctx) {
+
+	PFuture pFuture = pvFuture;
+	pFuture->waiterFun = fun;
+	pFuture->waiterCtx = ctx;
+	return plg_AtomicCas32(&pFuture->waiter, (long)WAITER_NONE, (long)WAITER_SET);
+}
+
+/*
+Takes the waiter back before the future completes, returns 0 when it was already called or is being called.
+*/
+int plg_FutureClearWaiter(void* pvFuture) {
+
+	PFuture pFuture = pvFuture;
+	return plg_AtomicCas32(&pFuture->waiter, (long)WAITER_SET, (long)WAITER_NONE);
+}
+
+/*
+After plg_FutureClearWaiter returned 0 for a waiter that was set, spins until the waiter has returned.
+*/
+void plg_FutureWaitWaiter(void* pvFuture) {
+
+	PFuture pFuture = pvFuture;
+	while (plg_AtomicLoad32(&pFuture->waiter) != WAITER_CALLED);
+}
+
+int plg_FutureIsReady(void* pvFuture) {
+
+	PFuture pFuture = pvFuture;
+	return plg_AtomicLoad32(&pFuture->state) == FUTURE_DONE;
+}
+
+/*
+The reply stays valid until plg_FutureRelease, 0 when the future is not complete or the handler did not reply.
+*/
+void* plg_FutureValue(void* pvFuture, unsigned int* valueLen) {
+
+	PFuture pFuture = pvFuture;
+	if (plg_AtomicLoad32(&pFuture->state) != FUTURE_DONE || !pFuture->replied) {
+		*valueLen = 0;
+		return 0;
+	}
+	*valueLen = pFuture->valueLen;
+	return pFuture->value;
+}
+
+/*
+Drops the reference of the caller, the future may still be waiting for its packet.
+*/
+void plg_FutureRelease(void* pvFuture) {
+
+	future_Release(pvFuture);
+}
@@ -0,0 +1,38 @@
+/* future.h - Reply slots of plg_MngCall and plg_JobCall
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FUTURE_H
+#define __FUTURE_H
+
+typedef void(*FutureWaiterFun)(void* ctx);
+
+void* plg_FuturePoolCreate();
+void plg_FuturePoolDestroy(void* pFuturePool);
+void* plg_FutureAlloc(void* pFuturePool);
+void plg_FutureSetReply(void* pFuture, char* value, unsigned int valueLen);
+void plg_FutureComplete(void* pFuture);
+int plg_FutureWait(void* pFuture, unsigned int milli);
+int plg_FutureSetWaiter(void* pFuture, FutureWaiterFun fun, void* ctx);
+int plg_FutureClearWaiter(void* pFuture);
+void plg_FutureWaitWaiter(void* pFuture);
+int plg_FutureIsReady(void* pFuture);
+void* plg_FutureValue(void* pFuture, unsigned int* valueLen);
+void plg_FutureRelease(void* pFuture);
+
+#endif
@@ -0,0 +1,164 @@
+/* histogram.c - Log-linear latency histogram
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#include "plateform.h"
+#include "phistogram.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+HDR style buckets: values below 8 have a bucket each, above that every power of two
+is split in 8 linear buckets, so a value is known within 12.5% over the whole 64 bit range
+and 496 counters of 8 bytes cover it. The owner records, others read a merged copy.
+*/
+#define HG_SUBBITS 3
+#define HG_SUBSIZE (1 << HG_SUBBITS)
+#define HG_BUCKETS ((64 - HG_SUBBITS + 1) * HG_SUBSIZE)
+
+typedef struct _Histogram
+{
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long max;
+	unsigned long long bucket[HG_BUCKETS];
+} *PHistogram, Histogram;
+
+static unsigned int hg_Msb(unsigned long long value) {
+
+#if defined(_MSC_VER)
+	unsigned long index;
+	if (value >> 32) {
+		_BitScanReverse(&index, (unsigned long)(value >> 32));
+		return index + 32;
+	}
+	_BitScanReverse(&index, (unsigned long)value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static unsigned int hg_Index(unsigned long long value) {
+
+	if (value < HG_SUBSIZE) {
+		return (unsigned int)value;
+	}
+
+	unsigned int shift = hg_Msb(value) - HG_SUBBITS;
+	return ((shift + 1) << HG_SUBBITS) + (unsigned int)((value >> shift) & (HG_SUBSIZE - 1));
+}
+
+//highest value counted by the bucket
+static unsigned long long hg_Value(unsigned int index) {
+
+	if (index < HG_SUBSIZE) {
+		return index;
+	}
+
+	unsigned int shift = (index >> HG_SUBBITS) - 1;
+	unsigned long long lower = (unsigned long long)(HG_SUBSIZE + (index & (HG_SUBSIZE - 1))) << shift;
+	return lower + ((1ULL << shift) - 1);
+}
+
+void* plg_HistogramCreate() {
+
+	return calloc(1, sizeof(Histogram));
+}
+
+void plg_HistogramDestroy(void* pHistogram) {
+
+	free(pHistogram);
+}
+
+void plg_HistogramRecord(void* pvHistogram, unsigned long long value) {
+
+	PHistogram pHistogram = pvHistogram;
+	pHistogram->bucket[hg_Index(value)] += 1;
+	pHistogram->count += 1;
+	pHistogram->sum += value;
+	if (value > pHistogram->max) {
+		pHistogram->max = value;
+	}
+}
+
+void plg_HistogramMerge(void* pvHistogram, void* pvSrcHistogram) {
+
+	PHistogram pHistogram = pvHistogram;
+	PHistogram pSrcHistogram = pvSrcHistogram;
+	if (!pSrcHistogram->count) {
+		return;
+	}
+
+	for (unsigned int l = 0; l < HG_BUCKETS; l++) {
+		pHistogram->bucket[l] += pSrcHistogram->bucket[l];
+	}
+	pHistogram->count += pSrcHistogram->count;
+	pHistogram->sum += pSrcHistogram->sum;
+	if (pSrcHistogram->max > pHistogram->max) {
+		pHistogram->max = pSrcHistogram->max;
+	}
+}
+
+unsigned long long plg_HistogramCount(void* pvHistogram) {
+
+	PHistogram pHistogram = pvHistogram;
+	return pHistogram->count;
+}
+
+unsigned long long plg_HistogramMean(void* pvHistogram) {
+
+	PHistogram pHistogram = pvHistogram;
+	return pHistogram->count ? pHistogram->sum / pHistogram->count : 0;
+}
+
+unsigned long long plg_HistogramMax(void* pvHistogram) {
+
+	PHistogram pHistogram = pvHistogram;
+	return pHistogram->max;
+}
+
+/*
+percentile from 0 to 100, the value returned is not below the real one by more than the bucket width.
+*/
+unsigned long long plg_HistogramPercentile(void* pvHistogram, double percentile) {
+
+	PHistogram pHistogram = pvHistogram;
+	if (!pHistogram->count) {
+		return 0;
+	}
+
+	unsigned long long rank = (unsigned long long)(percentile / 100 * pHistogram->count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > pHistogram->count) {
+		rank = pHistogram->count;
+	}
+
+	unsigned long long sum = 0;
+	for (unsigned int l = 0; l < HG_BUCKETS; l++) {
+		sum += pHistogram->bucket[l];
+		if (sum >= rank) {
+			unsigned long long value = hg_Value(l);
+			return value < pHistogram->max ? value : pHistogram->max;
+		}
+	}
+	return pHistogram->max;
+}
@@ -0,0 +1,32 @@
+/* histogram.h - Log-linear latency histogram
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+void* plg_HistogramCreate();
+void plg_HistogramDestroy(void* pHistogram);
+void plg_HistogramRecord(void* pHistogram, unsigned long long value);
+void plg_HistogramMerge(void* pHistogram, void* pSrcHistogram);
+unsigned long long plg_HistogramCount(void* pHistogram);
+unsigned long long plg_HistogramMean(void* pHistogram);
+unsigned long long plg_HistogramMax(void* pHistogram);
+unsigned long long plg_HistogramPercentile(void* pHistogram, double percentile);
+
+#endif
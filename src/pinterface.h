@@ -196,9 +196,30 @@ typedef struct _DiskTableUsingPage
 	DiskTableUsing element[];
 } *PDiskTableUsingPage, DiskTableUsingPage;
 
+/*
+order and value are sds stored inline after the packet head, see ppacket.c
+flags: PACKET_FORWARD when a job passed the packet on after its order migrated,
+PACKET_CONTROL when the packet goes through the control lane of the queue, see plg_eqPushControl,
+PACKET_BROADCAST when the same packet is in the queue of every job, ref is then the number of queues still holding it,
+PACKET_BUFFER when the value is a PacketBuffer handing over a buffer of the caller, see plg_PacketAllocBuffer
+pFuture: reply slot of plg_MngCall or plg_JobCall, completed when the packet is freed
+stamp: nanosecond the packet was made, the queue wait of the job metrics starts there
+*/
+#define PACKET_FORWARD 1
+#define PACKET_CONTROL 2
+#define PACKET_BROADCAST 4
+#define PACKET_BUFFER 8
+
 typedef struct _OrderPacket {
 	void* order;
 	void* value;
+	void* pPacketPool;
+	struct _OrderPacket* next;
+	void* pFuture;
+	unsigned int orderId;
+	unsigned int flags;
+	unsigned long long stamp;
+	volatile long ref;
 } *POrderPacket, OrderPacket;
 
 typedef struct _DiskBigValue
@@ -17,8 +17,14 @@
 * along with this program.If not, see < https://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 #include "plateform.h"
 #include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
 #include "psds.h"
 #include "pdict.h"
 #include "pjob.h"
@@ -35,6 +41,14 @@
 #include "plvm.h"
 #include "pquicksort.h"
 #include "pelagia.h"
+#include "ppacket.h"
+#include "pfuture.h"
+#include "ptimewheel.h"
+#include "pcoroutine.h"
+#include "phistogram.h"
+#include "patomic.h"
+#include "pdictset.h"
+#include "pjson.h"
 
 /*
 ߳ģͿԷΪ첽ַͬʽ.
@@ -46,6 +60,11 @@ manage
 fileΪٵӲде߳.
 */
 #define NORET
+#define JOB_POPBATCH 64
+#define JOB_SUSPEND -1
+#ifndef JOB_COSTACK
+#define JOB_COSTACK (256 * 1024)
+#endif
 #define CheckUsingThread(r) if (plg_JobCheckUsingThread()) {elog(log_error, "Cannot run job interface in non job environment"); return r;}
 
 enum ScriptType {
@@ -61,11 +80,68 @@ typedef struct _EventPorcess
 	sds function;
 	RoutingFun functionPoint;
 	unsigned int weight;
+	unsigned char async;
+	unsigned char coalesce;
+	unsigned char broadcast;
+	unsigned char readOnly;
 }*PEventPorcess, EventPorcess;
 
+/*
+Pending packets of an order set by plg_JobSetCoalesce, shared through the route so it follows the order when it migrates.
+value_packet: the value of each pending packet under CM_SAME, the key is the sds inside the packet
+pLatest: the last packet pushed under CM_LATEST, the older ones are dropped when they come to run
+*/
+typedef struct _Coalesce
+{
+	void* mutexHandle;
+	sds objName;
+	unsigned char mode;
+	dict* value_packet;
+	void* pLatest;
+}*PCoalesce, Coalesce;
+
+/*
+An async process runs on a coroutine of the job, plg_JobAwait suspends it
+and the job goes on with its queue until "resume" brings the reply.
+pOrderPacket: packet of the process, freed when the process returns
+pFuture: future awaited while the coroutine is suspended
+node: node of the coroutine in coWait
+runTime: nanoseconds the process ran so far
+readOnly: the process is of a read only order, restored on the job when it resumes
+*/
+typedef struct _JobCo
+{
+	void* co;
+	void* pJobHandle;
+	POrderPacket pOrderPacket;
+	RoutingFun fun;
+	void* pFuture;
+	listNode* node;
+	int ret;
+	unsigned long long runTime;
+	unsigned char readOnly;
+	struct _JobCo* next;
+}*PJobCo, JobCo;
+
+/*
+Metrics of one order id on this job, made by its first packet.
+exec: nanoseconds in the process, for an async process the sum of its runs between awaits
+wait: nanoseconds from plg_PacketAlloc until the process starts
+rollback: number of times the process asked for a rollback
+*/
+typedef struct _OrderMetric
+{
+	void* exec;
+	void* wait;
+	unsigned long long rollback;
+}*POrderMetric, OrderMetric;
+
 static void PtrFreeCallback(void *privdata, void *val) {
 	DICT_NOTUSED(privdata);
-	plg_CacheDestroyHandle(val);
+	//a cache migrated to another job leaves a null value behind
+	if (val) {
+		plg_CacheDestroyHandle(val);
+	}
 }
 
 static int sdsCompareCallback(void *privdata, const void *key1, const void *key2) {
@@ -111,6 +187,36 @@ flush_lastStamp: 
 flush_interval: ύļ
 flush_lastCount: ύĴ
 flush_count: ܴ
+packetPool: recycling pool of the packets sent by this thread
+order_id: order name to the id given by plg_MngAddOrder, resolved once for name based callers
+orderRoute: route table shared with manage, indexed by order id
+orderProcess: process of this job indexed by order id
+orderCount: number of packets processed by this job for each order id, read by manage for rebalancing
+orderHold: order ids migrating into this job, their packets wait in holdPacket until the source job hands over
+pStartPorcess, pFinishPorcess: "start" and "finish" process called around each packet
+orderId: id of the order being processed, 0 for admin orders
+orderTime: nanoseconds spent in the process of each order id
+orderCall: remote calls made by each order id to each order id, created on the first call
+orderTouch: table last used by each order id, touch keeps all of them for plg_MngPlanJob
+core: cpu the thread is pinned to when it starts, -1 lets the system schedule it
+commitCount, commitTime: group commit, the packets drained from the queue are committed once every
+commitCount packets or commitTime microseconds, commitCount below 2 commits after each packet
+commitPacket: packets of the open group, run again one by one when one of them rolls back
+commitSend: packets sent by the open group, pushed when the group commits, calls waiting for a reply are sent at once
+commitOpen: a packet of the group is running, its remote calls go to commitSend
+commitEvent: plg_EventSend of the open group, pushed when the group commits
+commitTimer, commitTimerCount, commitTimerSize: handles of the timers added by the open group, cancelled when it replays
+commitGroup: serial of the open group, a timer of it that fires before the commit sends its call with the group
+commitReplay: the group runs again after a rollback, its packets were counted on their first run
+futurePool: reply slots of plg_JobCall
+pPacket: packet being processed, plg_JobReply writes to its future
+readOnly: pPacket is of a read only order, every read sees the last commit and none can be written
+pCo: coroutine running, 0 on the stack of the thread
+coFree: coroutines whose process returned, kept for the next async packet
+coWait: suspended coroutines waiting for their future
+orderMetric: metrics of each order id, see OrderMetric
+commitMetric: nanoseconds of each commit, packetCount and rollbackCount are the user packets run and the transactions undone
+metricStamp: nanosecond the job was created, rates are measured from it
 */
 typedef struct _JobHandle
 {
@@ -118,7 +224,7 @@ typedef struct _JobHandle
 	void* pManageEqueue;
 	void* privateData;
 	void* eQueue;
-	dict* order_equeue;
+	dict* order_id;
 	dict* dictCache;
 	dict* order_process;
 	dict* tableName_cacheHandle;
@@ -144,8 +250,65 @@ typedef struct _JobHandle
 	//order;
 	char* pOrderName;
 
-	//intervalometer
-	list* pListIntervalometer;
+	//intervalometer, a timing wheel of PIntervalometer in milliseconds
+	void* timeWheel;
+
+	//packet
+	void* packetPool;
+
+	//order id
+	POrderRoute orderRoute;
+	PEventPorcess* orderProcess;
+	unsigned int orderSize;
+
+	//migrate
+	unsigned long long* orderCount;
+	unsigned char* orderHold;
+	list* holdPacket;
+
+	PEventPorcess pStartPorcess;
+	PEventPorcess pFinishPorcess;
+
+	//load
+	unsigned int orderId;
+	unsigned long long* orderTime;
+	unsigned int* orderCall;
+	void** orderTouch;
+	PDictSet touch;
+
+	//affinity
+	int core;
+
+	//group commit
+	unsigned int commitCount;
+	unsigned int commitTime;
+	unsigned long long commitStamp;
+	list* commitPacket;
+	list* commitSend;
+	char commitOpen;
+	list* commitEvent;
+	unsigned long long* commitTimer;
+	unsigned int commitTimerCount;
+	unsigned int commitTimerSize;
+	unsigned int commitGroup;
+	char commitReplay;
+
+	//call
+	void* futurePool;
+	POrderPacket pPacket;
+	unsigned char readOnly;
+
+	//async
+	PJobCo pCo;
+	PJobCo coFree;
+	list* coWait;
+
+	//metrics
+	POrderMetric* orderMetric;
+	void* commitMetric;
+	unsigned long long packetCount;
+	unsigned long long rollbackCount;
+	unsigned long long metricStamp;
 
 } *PJobHandle, JobHandle;
 
@@ -158,6 +321,10 @@ void* plg_JobCreateFunPtr(RoutingFun funPtr) {
 	pEventPorcess->scriptType = ST_PTR;
 	pEventPorcess->functionPoint = funPtr;
 	pEventPorcess->weight = 1;
+	pEventPorcess->async = 0;
+	pEventPorcess->coalesce = CM_NONE;
+	pEventPorcess->broadcast = 0;
+	pEventPorcess->readOnly = 0;
 	return pEventPorcess;
 }
 
@@ -168,6 +335,10 @@ void* plg_JobCreateLua(char* fileClass, short fileClassLen, char* fun, short fun
 	pEventPorcess->fileClass = plg_sdsNewLen(fileClass, fileClassLen);
 	pEventPorcess->function = plg_sdsNewLen(fun, funLen);
 	pEventPorcess->weight = 1;
+	pEventPorcess->async = 0;
+	pEventPorcess->coalesce = CM_NONE;
+	pEventPorcess->broadcast = 0;
+	pEventPorcess->readOnly = 0;
 	return pEventPorcess;
 }
 
@@ -178,6 +349,10 @@ void* plg_JobCreateDll(char* fileClass, short fileClassLen, char* fun, short fun
 	pEventPorcess->fileClass = plg_sdsNewLen(fileClass, fileClassLen);
 	pEventPorcess->function = plg_sdsNewLen(fun, funLen);
 	pEventPorcess->weight = 1;
+	pEventPorcess->async = 0;
+	pEventPorcess->coalesce = CM_NONE;
+	pEventPorcess->broadcast = 0;
+	pEventPorcess->readOnly = 0;
 	return pEventPorcess;
 }
 
@@ -186,6 +361,213 @@ void plg_JobSetWeight(void* pvEventPorcess, unsigned int weight) {
 	pEventPorcess->weight = weight;
 }
 
+/*
+Run the process on a coroutine so it can use plg_JobAwait, lua processes share the state of the job and stay synchronous.
+*/
+void plg_JobSetAsync(void* pvEventPorcess, unsigned char async) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	if (async && pEventPorcess->scriptType == ST_LUA) {
+		elog(log_warn, "plg_JobSetAsync.lua process:%s runs synchronously", pEventPorcess->function);
+	}
+	pEventPorcess->async = async;
+}
+
+/*
+Idempotent orders merge a new packet into a pending one of the same order, the process runs once for all of them.
+CM_SAME drops a packet when one with the same value is pending, CM_LATEST only runs the last packet pushed.
+Calls waiting on a future and timer calls are never merged.
+*/
+void plg_JobSetCoalesce(void* pvEventPorcess, unsigned char mode) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	pEventPorcess->coalesce = mode;
+}
+
+/*
+A broadcast order runs on every job, each call is one packet shared by the queues of all jobs.
+It has no tables of its own, does not migrate and can not be called with a future.
+*/
+void plg_JobSetBroadcast(void* pvEventPorcess, unsigned char broadcast) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	pEventPorcess->broadcast = broadcast;
+}
+
+unsigned char plg_JobIsBroadcast(void* pvEventPorcess) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	return pEventPorcess->broadcast;
+}
+
+/*
+A read only order runs on whichever job is least loaded, several of its packets run at once on different jobs.
+It reads the committed data of the caches of its tables, which must be shared, and can not write.
+Every read is committed on its own, reads of one packet are not pinned to one version,
+so a read only order may see a transaction of several keys half applied.
+*/
+void plg_JobSetReadOnly(void* pvEventPorcess, unsigned char readOnly) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	pEventPorcess->readOnly = readOnly;
+}
+
+unsigned char plg_JobIsReadOnly(void* pvEventPorcess) {
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	return pEventPorcess->readOnly;
+}
+
+/*
+The queue a packet of the route goes to, the first idle job for a read only order
+or else the one with the fewest packets waiting.
+*/
+void* plg_JobRouteQueue(POrderRoute pOrderRoute) {
+
+	if (!pOrderRoute->readOnly) {
+		return plg_AtomicLoadPtr(&pOrderRoute->eQueue);
+	}
+
+	void* eQueue = pOrderRoute->eQueue;
+	unsigned long long load = ULLONG_MAX;
+	for (unsigned int l = 0; l < pOrderRoute->jobQueueSize; l++) {
+		unsigned long long queueLoad = plg_eqLoad(pOrderRoute->jobQueue[l]);
+		if (queueLoad < load) {
+			load = queueLoad;
+			eQueue = pOrderRoute->jobQueue[l];
+			if (load == 0) {
+				break;
+			}
+		}
+	}
+	return eQueue;
+}
+
+/*
+Returns 0 when the process does not coalesce, a broadcast order never does.
+*/
+void* plg_JobCoalesceCreate(void* pvEventPorcess) {
+
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	if (pEventPorcess->coalesce == CM_NONE || pEventPorcess->broadcast) {
+		return 0;
+	}
+
+	PCoalesce pCoalesce = malloc(sizeof(Coalesce));
+	pCoalesce->mutexHandle = plg_MutexCreateHandle(4);
+	pCoalesce->objName = plg_sdsNew("coalesce");
+	pCoalesce->mode = pEventPorcess->coalesce;
+	pCoalesce->value_packet = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pCoalesce->pLatest = 0;
+	return pCoalesce;
+}
+
+void plg_JobCoalesceDestroy(void* pvCoalesce) {
+
+	PCoalesce pCoalesce = pvCoalesce;
+	if (!pCoalesce) {
+		return;
+	}
+	plg_dictRelease(pCoalesce->value_packet);
+	plg_sdsFree(pCoalesce->objName);
+	plg_MutexDestroyHandle(pCoalesce->mutexHandle);
+	free(pCoalesce);
+}
+
+/*
+Called by the sender before the packet is pushed, returns 1 when the packet was merged and freed.
+*/
+int plg_JobCoalescePut(void* pvCoalesce, void* pvOrderPacket) {
+
+	PCoalesce pCoalesce = pvCoalesce;
+	POrderPacket pOrderPacket = pvOrderPacket;
+	if (!pCoalesce || pOrderPacket->pFuture || (pOrderPacket->flags & PACKET_CONTROL)) {
+		return 0;
+	}
+
+	int merge = 0;
+	MutexLock(pCoalesce->mutexHandle, pCoalesce->objName);
+	if (pCoalesce->mode == CM_SAME) {
+		if (plg_dictFind(pCoalesce->value_packet, pOrderPacket->value)) {
+			merge = 1;
+		} else {
+			plg_dictAdd(pCoalesce->value_packet, pOrderPacket->value, pOrderPacket);
+		}
+	} else {
+		pCoalesce->pLatest = pOrderPacket;
+	}
+	MutexUnlock(pCoalesce->mutexHandle, pCoalesce->objName);
+
+	if (merge) {
+		plg_PacketFree(pOrderPacket);
+	}
+	return merge;
+}
+
+/*
+Called before the packet runs or when it is freed without running, the packet is no longer pending.
+Returns 1 when a later packet replaced it and it must not run.
+*/
+int plg_JobCoalesceTake(void* pvCoalesce, void* pvOrderPacket) {
+
+	PCoalesce pCoalesce = pvCoalesce;
+	POrderPacket pOrderPacket = pvOrderPacket;
+	if (!pCoalesce || pOrderPacket->pFuture) {
+		return 0;
+	}
+
+	int stale = 0;
+	MutexLock(pCoalesce->mutexHandle, pCoalesce->objName);
+	if (pCoalesce->mode == CM_SAME) {
+		dictEntry* entry = plg_dictFind(pCoalesce->value_packet, pOrderPacket->value);
+		if (entry && dictGetVal(entry) == pOrderPacket) {
+			plg_dictDelete(pCoalesce->value_packet, pOrderPacket->value);
+		}
+	} else if (pCoalesce->pLatest == pOrderPacket) {
+		pCoalesce->pLatest = 0;
+	} else if (pCoalesce->pLatest) {
+		stale = 1;
+	}
+	MutexUnlock(pCoalesce->mutexHandle, pCoalesce->objName);
+	return stale;
+}
+
+static void* job_Coalesce(PJobHandle pJobHandle, unsigned int orderId) {
+
+	if (orderId && orderId < pJobHandle->orderSize) {
+		return pJobHandle->orderRoute[orderId].pCoalesce;
+	}
+	return 0;
+}
+
+/*
+Describes the process in the order object of the json config, a function pointer only keeps its weight.
+*/
+void plg_JobProcessToJson(void* pvEventPorcess, void* jsonRoot) {
+
+	PEventPorcess pEventPorcess = pvEventPorcess;
+	pJSON* root = jsonRoot;
+	if (pEventPorcess->scriptType == ST_LUA) {
+		pJson_AddStringToObject(root, "orderType", "lua");
+	} else if (pEventPorcess->scriptType == ST_DLL) {
+		pJson_AddStringToObject(root, "orderType", "dll");
+	}
+
+	if (pEventPorcess->scriptType != ST_PTR) {
+		pJson_AddStringToObject(root, "file", pEventPorcess->fileClass);
+		pJson_AddStringToObject(root, "fun", pEventPorcess->function);
+	}
+	pJson_AddNumberToObject(root, "weight", pEventPorcess->weight);
+	if (pEventPorcess->async) {
+		pJson_AddNumberToObject(root, "async", pEventPorcess->async);
+	}
+	if (pEventPorcess->coalesce == CM_SAME) {
+		pJson_AddStringToObject(root, "coalesce", "same");
+	} else if (pEventPorcess->coalesce == CM_LATEST) {
+		pJson_AddStringToObject(root, "coalesce", "latest");
+	}
+	if (pEventPorcess->broadcast) {
+		pJson_AddNumberToObject(root, "broadcast", pEventPorcess->broadcast);
+	}
+	if (pEventPorcess->readOnly) {
+		pJson_AddNumberToObject(root, "readonly", pEventPorcess->readOnly);
+	}
+}
+
 void plg_JobProcessDestory(void* pvEventPorcess) {
 
 	PEventPorcess pEventPorcess = pvEventPorcess;
@@ -200,13 +582,29 @@ static void listSdsFree(void *ptr) {
 	plg_sdsFree(ptr);
 }
 
+//admin: the order is sent to the job itself by name, see plg_JobAddAdmTimer
+//group: commitGroup of the open group that added the timer, 0 outside a group
 typedef struct __Intervalometer {
-	unsigned long long tim;
 	sds Order;
 	sds Value;
+	unsigned char admin;
+	unsigned int group;
 }*PIntervalometer, Intervalometer;
 
-static void listIntervalometerFree(void *ptr) {
+//an event of the open group, see commitEvent
+typedef struct _HoldEvent {
+	void* pEventHandle;
+	sds value;
+}*PHoldEvent, HoldEvent;
+
+static void HoldEventFree(void* ptr) {
+	PHoldEvent pHoldEvent = ptr;
+	plg_sdsFree(pHoldEvent->value);
+	free(pHoldEvent);
+}
+
+static void IntervalometerFree(void *ptr, void* ctx) {
+	NOTUSED(ctx);
 	PIntervalometer pPIntervalometer = (PIntervalometer)ptr;
 	plg_sdsFree(pPIntervalometer->Order);
 	plg_sdsFree(pPIntervalometer->Value);
@@ -217,12 +615,35 @@ static void listProcessFree(void *ptr) {
 	plg_JobProcessDestory(ptr);
 }
 
+static void OrderFree(void* ptr) {
+
+	plg_PacketFree(ptr);
+}
+
 void* job_Handle() {
 
 	CheckUsingThread(0);
 	return plg_LocksGetSpecific();
 }
 
+/*
+plg_EventSend from a packet of the open group, the event waits in commitEvent until the group commits.
+Returns 0 when the event can be pushed at once.
+*/
+int job_HoldEvent(void* pEventHandle, void* value) {
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	if (!pJobHandle || !pJobHandle->commitOpen) {
+		return 0;
+	}
+
+	PHoldEvent pHoldEvent = malloc(sizeof(HoldEvent));
+	pHoldEvent->pEventHandle = pEventHandle;
+	pHoldEvent->value = value;
+	plg_listAddNodeTail(pJobHandle->commitEvent, pHoldEvent);
+	return 1;
+}
+
 void* job_ManageEqueue() {
 
 	CheckUsingThread(0);
@@ -266,6 +687,7 @@ void job_Commit(void* pvJobHandle) {
 void job_Rollback(void* pvJobHandle) {
 
 	PJobHandle pJobHandle = pvJobHandle;
+	pJobHandle->rollbackCount += 1;
 	listIter* iter = plg_listGetIterator(pJobHandle->tranCache, AL_START_HEAD);
 	listNode* node;
 	while ((node = plg_listNext(iter)) != NULL) {
@@ -277,7 +699,7 @@ void job_Rollback(void* pvJobHandle) {
 
 static int OrderDestroy(char* value, short valueLen) {
 	elog(log_fun, "job.OrderDestroy");
-	plg_JobSendOrder(job_ManageEqueue(), "destroycount", value, valueLen);
+	plg_JobSendControl(job_ManageEqueue(), "destroycount", value, valueLen);
 	plg_JobSExitThread(1);
 	return 1;
 }
@@ -307,6 +729,200 @@ static int OrderJobFinish(char* value, short valueLen) {
 	return 1;
 }
 
+/*
+Source job: detach the group from this job, packets of the group still queued here are forwarded to the target.
+Every job then answers "migratebarrier", after which no packet sent on the old route can still arrive.
+*/
+static int OrderMigrateOut(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobMigrate pJobMigrate = *(PJobMigrate*)value;
+
+	job_Commit(pJobHandle);
+	job_Flush(pJobHandle);
+
+	for (unsigned int l = 0; l < pJobMigrate->orderLength; l++) {
+		unsigned int orderId = pJobMigrate->orderId[l];
+		PEventPorcess process = pJobHandle->orderProcess[orderId];
+		pJobMigrate->process[l] = process;
+		if (process) {
+			pJobHandle->orderProcess[orderId] = 0;
+			plg_dictDelete(pJobHandle->order_process, pJobMigrate->order[l]);
+			pJobHandle->allWeight -= process->weight;
+		}
+	}
+
+	for (unsigned int l = 0; l < pJobMigrate->tableLength; l++) {
+		pJobMigrate->cache[l] = 0;
+		dictEntry* entry = plg_dictUnlink(pJobHandle->dictCache, pJobMigrate->table[l]);
+		if (entry) {
+			pJobMigrate->cache[l] = dictGetVal(entry);
+			entry->v.val = 0;
+			plg_dictFreeUnlinkedEntry(pJobHandle->dictCache, entry);
+		}
+
+		if (pJobMigrate->noShare[l]) {
+			plg_dictDelete(pJobHandle->tableName_cacheHandle, pJobMigrate->table[l]);
+		}
+	}
+
+	plg_JobSendOrder(plg_JobEqueueHandle(pJobMigrate->pTargetJob), "migratein", (char*)&pJobMigrate, sizeof(PJobMigrate));
+
+	pJobMigrate->barrier = pJobMigrate->jobLength;
+	for (unsigned int l = 0; l < pJobMigrate->jobLength; l++) {
+		plg_JobSendOrder(plg_JobEqueueHandle(pJobMigrate->job[l]), "migratebarrier", (char*)&pJobMigrate, sizeof(PJobMigrate));
+	}
+	return 1;
+}
+
+static int OrderMigrateBarrier(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobMigrate pJobMigrate = *(PJobMigrate*)value;
+	plg_JobSendOrder(plg_JobEqueueHandle(pJobMigrate->pSourceJob), "migratemark", value, valueLen);
+	return 1;
+}
+
+static int OrderMigrateMark(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobMigrate pJobMigrate = *(PJobMigrate*)value;
+	if (--pJobMigrate->barrier == 0) {
+		plg_JobSendOrder(plg_JobEqueueHandle(pJobMigrate->pTargetJob), "migratedone", value, valueLen);
+	}
+	return 1;
+}
+
+/*
+Target job: take over the caches and processes, the packets sent on the new route wait in holdPacket
+until the packets forwarded by the source job are done, see plg_JobHoldOrder.
+*/
+static int OrderMigrateIn(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobMigrate pJobMigrate = *(PJobMigrate*)value;
+
+	for (unsigned int l = 0; l < pJobMigrate->tableLength; l++) {
+		if (pJobMigrate->cache[l] == 0) {
+			continue;
+		}
+
+		plg_dictAdd(pJobHandle->dictCache, pJobMigrate->table[l], pJobMigrate->cache[l]);
+		if (pJobMigrate->noShare[l]) {
+			plg_JobAddTableCache(pJobHandle, pJobMigrate->table[l], pJobMigrate->cache[l]);
+		}
+	}
+
+	for (unsigned int l = 0; l < pJobMigrate->orderLength; l++) {
+		unsigned int orderId = pJobMigrate->orderId[l];
+		if (pJobMigrate->process[l]) {
+			plg_JobAddEventProcess(pJobHandle, pJobMigrate->order[l], orderId, pJobMigrate->process[l]);
+		}
+	}
+	return 1;
+}
+
+static void job_ProcessPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket, int group);
+
+static int OrderMigrateDone(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobMigrate pJobMigrate = *(PJobMigrate*)value;
+
+	for (unsigned int l = 0; l < pJobMigrate->orderLength; l++) {
+		pJobHandle->orderHold[pJobMigrate->orderId[l]] = 0;
+	}
+
+	list* holdPacket = pJobHandle->holdPacket;
+	pJobHandle->holdPacket = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->holdPacket, OrderFree);
+
+	listIter* iter = plg_listGetIterator(holdPacket, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		job_ProcessPacket(pJobHandle, listNodeValue(node), 0);
+	}
+	plg_listReleaseIterator(iter);
+	listSetFreeMethod(holdPacket, NULL);
+	plg_listRelease(holdPacket);
+
+	void* pManage = pJobMigrate->pManage;
+	free(pJobMigrate);
+	plg_MngMigrateFinish(pManage);
+	return 1;
+}
+
+/*
+Adds the load measured by this job to the JobLoad of plg_MngPlanJob.
+*/
+static int OrderLoadReport(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobLoad pJobLoad = *(PJobLoad*)value;
+
+	unsigned int orderSize = pJobHandle->orderSize < pJobLoad->orderSize ? pJobHandle->orderSize : pJobLoad->orderSize;
+	for (unsigned int l = 0; l < orderSize; l++) {
+		pJobLoad->count[l] += pJobHandle->orderCount[l];
+		pJobLoad->time[l] += pJobHandle->orderTime[l];
+		if (pJobHandle->orderCall) {
+			for (unsigned int c = 0; c < orderSize; c++) {
+				pJobLoad->call[l * pJobLoad->orderSize + c] += pJobHandle->orderCall[l * pJobHandle->orderSize + c];
+			}
+		}
+	}
+
+	dictIterator* orderIter = plg_dictGetSafeIterator(plg_DictSetDict(pJobHandle->touch));
+	dictEntry* orderNode;
+	while ((orderNode = plg_dictNext(orderIter)) != NULL) {
+		dictIterator* tableIter = plg_dictGetSafeIterator(dictGetVal(orderNode));
+		dictEntry* tableNode;
+		while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+			plg_DictSetAdd(pJobLoad->touch, dictGetKey(orderNode), dictGetKey(tableNode));
+		}
+		plg_dictReleaseIterator(tableIter);
+	}
+	plg_dictReleaseIterator(orderIter);
+
+	plg_EventSend(pJobLoad->pEvent, NULL, 0);
+	return 1;
+}
+
+/*
+Adds the metrics of this job to the JobMetric of the report and passes it to the next job.
+*/
+static int OrderMetricReport(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobMetric pJobMetric = *(PJobMetric*)value;
+
+	unsigned int orderSize = pJobHandle->orderSize < pJobMetric->orderSize ? pJobHandle->orderSize : pJobMetric->orderSize;
+	for (unsigned int l = 0; pJobHandle->orderMetric && l < orderSize; l++) {
+		POrderMetric pOrderMetric = pJobHandle->orderMetric[l];
+		if (pOrderMetric) {
+			plg_HistogramMerge(pJobMetric->exec[l], pOrderMetric->exec);
+			plg_HistogramMerge(pJobMetric->wait[l], pOrderMetric->wait);
+			pJobMetric->rollback[l] += pOrderMetric->rollback;
+			pJobMetric->orderJob[l] = pJobMetric->jobIndex + 1;
+		}
+	}
+
+	unsigned int jobIndex = pJobMetric->jobIndex;
+	plg_HistogramMerge(pJobMetric->commit[jobIndex], pJobHandle->commitMetric);
+	pJobMetric->jobCount[jobIndex] = pJobHandle->packetCount;
+	pJobMetric->jobRollback[jobIndex] = pJobHandle->rollbackCount;
+	pJobMetric->jobElapsed[jobIndex] = plg_GetCurrentNano() - pJobHandle->metricStamp;
+
+	pJobMetric->jobIndex += 1;
+	if (pJobMetric->jobIndex < pJobMetric->jobLength) {
+		plg_JobSendControl(plg_JobEqueueHandle(pJobMetric->job[pJobMetric->jobIndex]), "metricsreport", (char*)&pJobMetric, sizeof(PJobMetric));
+	} else if (pJobMetric->pEvent) {
+		plg_EventSend(pJobMetric->pEvent, NULL, 0);
+	} else {
+		plg_JobSendControl(job_ManageEqueue(), "metricswrite", (char*)&pJobMetric, sizeof(PJobMetric));
+	}
+	return 1;
+}
+
+static int OrderResume(char* value, short valueLen);
+
 static void InitProcessCommend(void* pvJobHandle) {
 
 	//event process
@@ -314,6 +930,14 @@ static void InitProcessCommend(void* pvJobHandle) {
 	plg_JobAddAdmOrderProcess(pJobHandle, "destroy", plg_JobCreateFunPtr(OrderDestroy));
 	plg_JobAddAdmOrderProcess(pJobHandle, "destroyjob", plg_JobCreateFunPtr(OrderDestroyJob));
 	plg_JobAddAdmOrderProcess(pJobHandle, "finish", plg_JobCreateFunPtr(OrderJobFinish));
+	plg_JobAddAdmOrderProcess(pJobHandle, "migrateout", plg_JobCreateFunPtr(OrderMigrateOut));
+	plg_JobAddAdmOrderProcess(pJobHandle, "migratebarrier", plg_JobCreateFunPtr(OrderMigrateBarrier));
+	plg_JobAddAdmOrderProcess(pJobHandle, "migratemark", plg_JobCreateFunPtr(OrderMigrateMark));
+	plg_JobAddAdmOrderProcess(pJobHandle, "migratein", plg_JobCreateFunPtr(OrderMigrateIn));
+	plg_JobAddAdmOrderProcess(pJobHandle, "migratedone", plg_JobCreateFunPtr(OrderMigrateDone));
+	plg_JobAddAdmOrderProcess(pJobHandle, "loadreport", plg_JobCreateFunPtr(OrderLoadReport));
+	plg_JobAddAdmOrderProcess(pJobHandle, "metricsreport", plg_JobCreateFunPtr(OrderMetricReport));
+	plg_JobAddAdmOrderProcess(pJobHandle, "resume", plg_JobCreateFunPtr(OrderResume));
 }
 
 void plg_JobSPrivate(void* pvJobHandle, void* privateData) {
@@ -328,11 +952,42 @@ void* plg_JobGetPrivate() {
 	return pJobHandle->privateData;
 }
 
+static void job_FreeOrderMetric(PJobHandle pJobHandle) {
+
+	if (!pJobHandle->orderMetric) {
+		return;
+	}
+
+	for (unsigned int l = 0; l < pJobHandle->orderSize; l++) {
+		POrderMetric pOrderMetric = pJobHandle->orderMetric[l];
+		if (pOrderMetric) {
+			plg_HistogramDestroy(pOrderMetric->exec);
+			plg_HistogramDestroy(pOrderMetric->wait);
+			free(pOrderMetric);
+		}
+	}
+	free(pJobHandle->orderMetric);
+	pJobHandle->orderMetric = 0;
+}
+
+static POrderMetric job_OrderMetric(PJobHandle pJobHandle, unsigned int orderId) {
+
+	POrderMetric pOrderMetric = pJobHandle->orderMetric[orderId];
+	if (!pOrderMetric) {
+		pOrderMetric = malloc(sizeof(OrderMetric));
+		pOrderMetric->exec = plg_HistogramCreate();
+		pOrderMetric->wait = plg_HistogramCreate();
+		pOrderMetric->rollback = 0;
+		pJobHandle->orderMetric[orderId] = pOrderMetric;
+	}
+	return pOrderMetric;
+}
+
 void* plg_JobCreateHandle(void* pManageEqueue, enum ThreadType threadType, char* luaPath, char* luaDllPath, char* dllPath) {
 
 	PJobHandle pJobHandle = malloc(sizeof(JobHandle));
 	pJobHandle->eQueue = plg_eqCreate();
-	pJobHandle->order_equeue = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pJobHandle->order_id = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
 	pJobHandle->order_process = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
 	pJobHandle->tableName_cacheHandle = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
 	pJobHandle->dictCache = plg_dictCreate(&PtrDictType, NULL, DICT_MIDDLE);
@@ -370,191 +1025,1065 @@ void* plg_JobCreateHandle(void* pManageEqueue, enum ThreadType threadType, char*
 		pJobHandle->luaHandle = 0;
 	}
 
-	SDS_CHECK(pJobHandle->allWeight, pJobHandle->luaHandle);
-	pJobHandle->pListIntervalometer = plg_listCreate(LIST_MIDDLE);
-	listSetFreeMethod(pJobHandle->pListIntervalometer, listIntervalometerFree);
+	SDS_CHECK(pJobHandle->allWeight, pJobHandle->luaHandle);
+	pJobHandle->timeWheel = plg_TimeWheelCreate(plg_GetCurrentMilli());
+	pJobHandle->packetPool = plg_PacketPoolCreate();
+	pJobHandle->orderRoute = 0;
+	pJobHandle->orderProcess = 0;
+	pJobHandle->orderSize = 0;
+	pJobHandle->orderCount = 0;
+	pJobHandle->orderHold = 0;
+	pJobHandle->holdPacket = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->holdPacket, OrderFree);
+	pJobHandle->pStartPorcess = 0;
+	pJobHandle->pFinishPorcess = 0;
+	pJobHandle->orderId = 0;
+	pJobHandle->orderTime = 0;
+	pJobHandle->orderCall = 0;
+	pJobHandle->orderTouch = 0;
+	pJobHandle->touch = plg_DictSetCreate(plg_DefaultSdsDictPtr(), DICT_MIDDLE, plg_DefaultSdsDictPtr(), DICT_MIDDLE);
+	pJobHandle->core = -1;
+	pJobHandle->commitCount = 0;
+	pJobHandle->commitTime = 0;
+	pJobHandle->commitStamp = 0;
+	pJobHandle->commitPacket = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->commitPacket, OrderFree);
+	pJobHandle->commitSend = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->commitSend, OrderFree);
+	pJobHandle->commitOpen = 0;
+	pJobHandle->commitEvent = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->commitEvent, HoldEventFree);
+	pJobHandle->commitTimer = 0;
+	pJobHandle->commitTimerCount = 0;
+	pJobHandle->commitTimerSize = 0;
+	pJobHandle->commitGroup = 1;
+	pJobHandle->commitReplay = 0;
+	pJobHandle->futurePool = plg_FuturePoolCreate();
+	pJobHandle->pPacket = 0;
+	pJobHandle->readOnly = 0;
+	pJobHandle->pCo = 0;
+	pJobHandle->coFree = 0;
+	pJobHandle->coWait = plg_listCreate(LIST_MIDDLE);
+	pJobHandle->orderMetric = 0;
+	pJobHandle->commitMetric = plg_HistogramCreate();
+	pJobHandle->packetCount = 0;
+	pJobHandle->rollbackCount = 0;
+	pJobHandle->metricStamp = plg_GetCurrentNano();
+
+	if (pJobHandle->threadType == TT_PROCESS) {
+		InitProcessCommend(pJobHandle);
+	}
+
+	elog(log_fun, "plg_JobCreateHandle:%U", pJobHandle);
+	return pJobHandle;
+}
+
+void plg_JobDestoryHandle(void* pvJobHandle) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	elog(log_fun, "plg_JobDestoryHandle:%U", pJobHandle);
+
+	//suspended processes are dropped, their callers see a call without reply
+	//a waiter already running pushes its resume order, so the queue goes after it returns
+	listIter* iter = plg_listGetIterator(pJobHandle->coWait, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		PJobCo pJobCo = listNodeValue(node);
+		if (!plg_FutureClearWaiter(pJobCo->pFuture)) {
+			plg_FutureWaitWaiter(pJobCo->pFuture);
+		}
+		plg_FutureRelease(pJobCo->pFuture);
+		plg_PacketFree(pJobCo->pOrderPacket);
+		pJobCo->next = pJobHandle->coFree;
+		pJobHandle->coFree = pJobCo;
+	}
+	plg_listReleaseIterator(iter);
+	plg_listRelease(pJobHandle->coWait);
+	while (pJobHandle->coFree) {
+		PJobCo pJobCo = pJobHandle->coFree;
+		pJobHandle->coFree = pJobCo->next;
+		plg_CoDestroy(pJobCo->co);
+		free(pJobCo);
+	}
+
+	plg_eqDestory(pJobHandle->eQueue, OrderFree);
+	plg_dictRelease(pJobHandle->order_id);
+	free(pJobHandle->orderProcess);
+	free(pJobHandle->orderCount);
+	free(pJobHandle->orderHold);
+	free(pJobHandle->orderTime);
+	free(pJobHandle->orderCall);
+	free(pJobHandle->orderTouch);
+	job_FreeOrderMetric(pJobHandle);
+	plg_HistogramDestroy(pJobHandle->commitMetric);
+	plg_DictSetDestroy(pJobHandle->touch);
+	plg_listRelease(pJobHandle->holdPacket);
+	plg_dictRelease(pJobHandle->dictCache);
+	plg_listRelease(pJobHandle->tranCache);
+	plg_listRelease(pJobHandle->tranFlush);
+	plg_dictRelease(pJobHandle->order_process);
+	plg_dictRelease(pJobHandle->tableName_cacheHandle);
+	plg_listRelease(pJobHandle->userEvent);
+	plg_listRelease(pJobHandle->userProcess);
+	plg_TimeWheelDestroy(pJobHandle->timeWheel, IntervalometerFree, 0);
+	plg_listRelease(pJobHandle->commitPacket);
+	plg_listRelease(pJobHandle->commitSend);
+	plg_listRelease(pJobHandle->commitEvent);
+	free(pJobHandle->commitTimer);
+
+	plg_PacketPoolDestroy(pJobHandle->packetPool);
+	plg_FuturePoolDestroy(pJobHandle->futurePool);
+
+	if (pJobHandle->luaHandle) {
+		plg_LvmDestory(pJobHandle->luaHandle);
+	}
+	
+	if (pJobHandle->dllHandle) {
+		plg_SysLibUnload(pJobHandle->dllHandle);
+	}
+	free(pJobHandle);
+}
+
+unsigned char plg_JobFindTableName(void* pvJobHandle, sds tableName) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	dictEntry * entry = plg_dictFind(pJobHandle->dictCache, tableName);
+	if (entry != 0) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+/*
+Must be called before plg_JobAddEventProcess, orderSize is the length of orderRoute.
+*/
+void plg_JobSetOrderRoute(void* pvJobHandle, void* pvOrderRoute, unsigned int orderSize) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	free(pJobHandle->orderProcess);
+	free(pJobHandle->orderCount);
+	free(pJobHandle->orderHold);
+	free(pJobHandle->orderTime);
+	free(pJobHandle->orderCall);
+	free(pJobHandle->orderTouch);
+	job_FreeOrderMetric(pJobHandle);
+	plg_DictSetEmpty(pJobHandle->touch);
+	pJobHandle->orderRoute = pvOrderRoute;
+	pJobHandle->orderSize = orderSize;
+	pJobHandle->orderProcess = calloc(orderSize, sizeof(PEventPorcess));
+	pJobHandle->orderCount = calloc(orderSize, sizeof(unsigned long long));
+	pJobHandle->orderHold = calloc(orderSize, sizeof(unsigned char));
+	pJobHandle->orderTime = calloc(orderSize, sizeof(unsigned long long));
+	pJobHandle->orderCall = 0;
+	pJobHandle->orderTouch = calloc(orderSize, sizeof(void*));
+	pJobHandle->orderMetric = calloc(orderSize, sizeof(POrderMetric));
+}
+
+/*
+Called by manage to start the migration, the job itself receives the group in "migrateout".
+*/
+void plg_JobMigrateOut(void* pvJobHandle, void* pvJobMigrate) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	plg_JobSendOrder(pJobHandle->eQueue, "migrateout", (char*)&pvJobMigrate, sizeof(void*));
+}
+
+/*
+Called by manage on the target job before the route of orderId is switched to it,
+the packets of the order wait in holdPacket until "migratedone".
+*/
+void plg_JobHoldOrder(void* pvJobHandle, unsigned int orderId) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	pJobHandle->orderHold[orderId] = 1;
+}
+
+unsigned long long plg_JobOrderCount(void* pvJobHandle, unsigned int orderId) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	if (orderId < pJobHandle->orderSize) {
+		return plg_AtomicLoad64(&pJobHandle->orderCount[orderId]);
+	}
+	return 0;
+}
+
+void plg_JobAddOrderId(void* pvJobHandle, sds nevent, unsigned int orderId) {
+	PJobHandle pJobHandle = pvJobHandle;
+	plg_dictAdd(pJobHandle->order_id, nevent, (void*)(size_t)orderId);
+}
+
+void plg_JobAddEventProcess(void* pvJobHandle, sds nevent, unsigned int orderId, void* pvProcess) {
+
+	PEventPorcess process = pvProcess;
+	PJobHandle pJobHandle = pvJobHandle;
+	plg_dictAdd(pJobHandle->order_process, nevent, process);
+	if (orderId < pJobHandle->orderSize) {
+		pJobHandle->orderProcess[orderId] = process;
+	}
+	pJobHandle->allWeight += process->weight;
+}
+
+/*
+ҪcachediskصľٲѯΪʱִtableʼ
+*/
+void* plg_JobNewTableCache(void* pvJobHandle, char* table, void* pDiskHandle) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, table);
+	if (valueEntry == 0) {
+		void* pCacheHandle = plg_CacheCreateHandle(pDiskHandle);
+		plg_dictAdd(pJobHandle->dictCache, table, pCacheHandle);
+		return pCacheHandle;
+	} else {
+		return dictGetVal(valueEntry);
+	}
+}
+
+void plg_JobAddTableCache(void* pvJobHandle, char* table, void* pCacheHandle) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, table);
+	if (valueEntry == 0) {
+		plg_dictAdd(pJobHandle->tableName_cacheHandle, table, pCacheHandle);
+	}
+}
+
+void* plg_JobEqueueHandle(void* pvJobHandle) {
+	PJobHandle pJobHandle = pvJobHandle;
+	return pJobHandle->eQueue;
+}
+
+/*
+Only user orders are shed, admin orders such as "finish" or "migrateout" and timer calls always run.
+Called by the producer thread, ctx is the job of the queue.
+*/
+static int job_ShedPacket(void* ctx, void* value, int drop) {
+
+	POrderPacket pOrderPacket = value;
+	if (!drop) {
+		return pOrderPacket->orderId && !(pOrderPacket->flags & PACKET_CONTROL);
+	}
+	plg_JobCoalesceTake(job_Coalesce(ctx, pOrderPacket->orderId), pOrderPacket);
+	plg_PacketFree(pOrderPacket);
+	return 1;
+}
+
+void plg_JobSetQueueLimit(void* pvJobHandle, unsigned int highWater, int policy) {
+	PJobHandle pJobHandle = pvJobHandle;
+	plg_eqSetLimit(pJobHandle->eQueue, highWater, policy, job_ShedPacket, pJobHandle);
+}
+
+unsigned int  plg_JobAllWeight(void* pvJobHandle) {
+	PJobHandle pJobHandle = pvJobHandle;
+	return pJobHandle->allWeight;
+}
+
+unsigned int  plg_JobIsEmpty(void* pvJobHandle) {
+	PJobHandle pJobHandle = pvJobHandle;
+	return dictSize(pJobHandle->order_process);
+}
+
+/*
+û vmʹ
+*/
+static void job_PushQueue(void* eQueue, POrderPacket pOrderPacket) {
+
+	if (pOrderPacket->flags & PACKET_CONTROL) {
+		plg_eqPushControl(eQueue, pOrderPacket);
+	} else {
+		plg_eqPush(eQueue, pOrderPacket);
+	}
+}
+
+/*
+Every queue holds a reference on the packet, which is freed by the last job done with it.
+*/
+static int job_SendBroadcast(POrderRoute pOrderRoute, POrderPacket pOrderPacket) {
+
+	if (pOrderPacket->pFuture) {
+		elog(log_error, "job_SendBroadcast.Broadcast order:%s can not be called with a future", pOrderRoute->order);
+		plg_PacketFree(pOrderPacket);
+		return 0;
+	}
+
+	pOrderPacket->flags |= PACKET_BROADCAST;
+	pOrderPacket->ref = pOrderRoute->jobQueueSize;
+	for (unsigned int l = 0; l < pOrderRoute->jobQueueSize; l++) {
+		job_PushQueue(pOrderRoute->jobQueue[l], pOrderPacket);
+	}
+	return 1;
+}
+
+static int job_SendPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket) {
+
+	void* eQueue = 0;
+	if (pOrderPacket->orderId < pJobHandle->orderSize) {
+		if (pJobHandle->orderRoute[pOrderPacket->orderId].broadcast) {
+			return job_SendBroadcast(&pJobHandle->orderRoute[pOrderPacket->orderId], pOrderPacket);
+		}
+		eQueue = plg_JobRouteQueue(&pJobHandle->orderRoute[pOrderPacket->orderId]);
+	}
+
+	if (eQueue) {
+		if (!plg_JobCoalescePut(job_Coalesce(pJobHandle, pOrderPacket->orderId), pOrderPacket)) {
+			job_PushQueue(eQueue, pOrderPacket);
+		}
+		return 1;
+	} else {
+		elog(log_error, "job_PushPacket.OrderId:%i not found", pOrderPacket->orderId);
+		plg_PacketFree(pOrderPacket);
+		return 0;
+	}
+}
+
+static void job_CountCall(PJobHandle pJobHandle, unsigned int orderId) {
+
+	if (pJobHandle->orderId && !pJobHandle->commitReplay) {
+		if (!pJobHandle->orderCall) {
+			pJobHandle->orderCall = calloc(pJobHandle->orderSize * pJobHandle->orderSize, sizeof(unsigned int));
+		}
+		pJobHandle->orderCall[pJobHandle->orderId * pJobHandle->orderSize + orderId] += 1;
+	}
+}
+
+static int job_PushPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket) {
+
+	if (pOrderPacket->orderId < pJobHandle->orderSize) {
+		job_CountCall(pJobHandle, pOrderPacket->orderId);
+	} else {
+		return job_SendPacket(pJobHandle, pOrderPacket);
+	}
+
+	//a call with a future may be waited on before the group commits, it can not be held back
+	if (pJobHandle->commitOpen && !pOrderPacket->pFuture) {
+		plg_listAddNodeTail(pJobHandle->commitSend, pOrderPacket);
+		return 1;
+	}
+	return job_SendPacket(pJobHandle, pOrderPacket);
+}
+
+static int job_RemoteCall(PJobHandle pJobHandle, void* order, unsigned short orderLen, void* value, unsigned short valueLen, unsigned int flags) {
+
+	//The inline name of the packet is the sds used to resolve the id, no extra allocation.
+	POrderPacket pOrderPacket = plg_PacketAlloc(pJobHandle->packetPool, 0, order, orderLen, value, valueLen);
+	pOrderPacket->flags |= flags;
+
+	dictEntry* entry = plg_dictFind(pJobHandle->order_id, pOrderPacket->order);
+	if (entry) {
+		pOrderPacket->orderId = (unsigned int)(size_t)dictGetVal(entry);
+		return job_PushPacket(pJobHandle, pOrderPacket);
+	} else {
+		elog(log_error, "plg_JobRemoteCall.Order:%s not found", order);
+		plg_PacketFree(pOrderPacket);
+		return 0;
+	}
+}
+
+int plg_JobRemoteCall(void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
+
+	CheckUsingThread(0);
+	return job_RemoteCall(plg_LocksGetSpecific(), order, orderLen, value, valueLen, 0);
+}
+
+/*
+Hands buffer over to the job of the order without copying it, release is called with it
+once that job is done with the packet, also when the call fails.
+*/
+int plg_JobRemoteCallBuffer(void* order, unsigned short orderLen, void* buffer, unsigned long long bufferLen, ReleaseBufferFun release) {
+
+	CheckUsingThread(0);
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	POrderPacket pOrderPacket = plg_PacketAllocBuffer(pJobHandle->packetPool, 0, order, orderLen, buffer, bufferLen, release);
+
+	dictEntry* entry = plg_dictFind(pJobHandle->order_id, pOrderPacket->order);
+	if (entry) {
+		pOrderPacket->orderId = (unsigned int)(size_t)dictGetVal(entry);
+		return job_PushPacket(pJobHandle, pOrderPacket);
+	} else {
+		elog(log_error, "plg_JobRemoteCallBuffer.Order:%s not found", order);
+		plg_PacketFree(pOrderPacket);
+		return 0;
+	}
+}
+
+/*
+Same as plg_JobRemoteCall but returns a future completed when the called job is done with the packet,
+carrying what its process gave to plg_JobReply. 0 when the order is not found.
+Waiting on the future in a job blocks the job, a call to an order of the same job never completes,
+unless the process is async and waits with plg_JobAwait.
+The packet is sent at once even inside a group commit, so a rollback of the caller does not take the call back.
+*/
+void* plg_JobCall(void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
+
+	CheckUsingThread(0);
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	POrderPacket pOrderPacket = plg_PacketAlloc(pJobHandle->packetPool, 0, order, orderLen, value, valueLen);
+	void* pFuture = plg_FutureAlloc(pJobHandle->futurePool);
+	pOrderPacket->pFuture = pFuture;
+
+	dictEntry* entry = plg_dictFind(pJobHandle->order_id, pOrderPacket->order);
+	if (entry) {
+		pOrderPacket->orderId = (unsigned int)(size_t)dictGetVal(entry);
+		if (job_PushPacket(pJobHandle, pOrderPacket)) {
+			return pFuture;
+		}
+	} else {
+		elog(log_error, "plg_JobCall.Order:%s not found", order);
+		plg_PacketFree(pOrderPacket);
+	}
+	plg_FutureRelease(pFuture);
+	return 0;
+}
+
+/*
+Reply to the plg_MngCall or plg_JobCall of the packet being processed, returns 0 if it was not called that way.
+*/
+int plg_JobReply(void* value, unsigned int valueLen) {
+
+	CheckUsingThread(0);
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	if (!pJobHandle->pPacket || !pJobHandle->pPacket->pFuture) {
+		return 0;
+	}
+	plg_FutureSetReply(pJobHandle->pPacket->pFuture, value, valueLen);
+	return 1;
+}
+
+/*
+Sends count calls, the packets of each job queue are pushed together with one wakeup.
+Returns the number of calls sent.
+*/
+unsigned int plg_JobRemoteCallBatch(PRemoteCallItem pRemoteCallItem, unsigned int count) {
+
+	CheckUsingThread(0);
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	void** packets = malloc(count * sizeof(void*) * 3);
+	void** queues = packets + count;
+	void** group = queues + count;
+	unsigned int size = 0, r = 0;
+
+	for (unsigned int l = 0; l < count; l++) {
+		POrderPacket pOrderPacket = plg_PacketAlloc(pJobHandle->packetPool, 0, pRemoteCallItem[l].order, pRemoteCallItem[l].orderLen,
+			pRemoteCallItem[l].value, pRemoteCallItem[l].valueLen);
+
+		void* eQueue = 0;
+		dictEntry* entry = plg_dictFind(pJobHandle->order_id, pOrderPacket->order);
+		if (entry) {
+			pOrderPacket->orderId = (unsigned int)(size_t)dictGetVal(entry);
+			if (pOrderPacket->orderId < pJobHandle->orderSize) {
+				job_CountCall(pJobHandle, pOrderPacket->orderId);
+				eQueue = plg_JobRouteQueue(&pJobHandle->orderRoute[pOrderPacket->orderId]);
+			}
+		}
+
+		if (!eQueue) {
+			elog(log_error, "plg_JobRemoteCallBatch.Order:%s not found", pOrderPacket->order);
+			plg_PacketFree(pOrderPacket);
+		} else if (pJobHandle->commitOpen) {
+			plg_listAddNodeTail(pJobHandle->commitSend, pOrderPacket);
+			r++;
+		} else if (pJobHandle->orderRoute[pOrderPacket->orderId].broadcast) {
+			r += job_SendBroadcast(&pJobHandle->orderRoute[pOrderPacket->orderId], pOrderPacket);
+		} else if (plg_JobCoalescePut(job_Coalesce(pJobHandle, pOrderPacket->orderId), pOrderPacket)) {
+			r++;
+		} else {
+			packets[size] = pOrderPacket;
+			queues[size++] = eQueue;
+		}
+	}
+
+	//one push per queue, the order of the calls to the same queue is kept
+	for (unsigned int l = 0; l < size; l++) {
+		void* eQueue = queues[l];
+		if (!eQueue) {
+			continue;
+		}
+		unsigned int groupSize = 0;
+		for (unsigned int c = l; c < size; c++) {
+			if (queues[c] == eQueue) {
+				group[groupSize++] = packets[c];
+				queues[c] = 0;
+			}
+		}
+		plg_eqPushBatch(eQueue, group, groupSize);
+		r += groupSize;
+	}
+
+	free(packets);
+	return r;
+}
+
+int plg_JobRemoteCallById(unsigned int orderId, void* value, unsigned short valueLen) {
+
+	CheckUsingThread(0);
+
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	if (orderId == 0) {
+		elog(log_error, "plg_JobRemoteCallById.OrderId:0 not found");
+		return 0;
+	}
+	return job_PushPacket(pJobHandle, plg_PacketAlloc(pJobHandle->packetPool, orderId, 0, 0, value, valueLen));
+}
+
+unsigned int plg_JobOrderId(void* order, unsigned short orderLen) {
+
+	CheckUsingThread(0);
+
+	unsigned int orderId = 0;
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	sds sdsOrder = plg_sdsNewLen(order, orderLen);
+	dictEntry* entry = plg_dictFind(pJobHandle->order_id, sdsOrder);
+	if (entry) {
+		orderId = (unsigned int)(size_t)dictGetVal(entry);
+	}
+	plg_sdsFree(sdsOrder);
+	return orderId;
+}
+
+/*
+User orders are dispatched by id, admin orders such as "destroy" or "flush" keep the name.
+*/
+static PEventPorcess job_OrderProcess(PJobHandle pJobHandle, POrderPacket pOrderPacket) {
+
+	if (pOrderPacket->orderId) {
+		if (pOrderPacket->orderId < pJobHandle->orderSize) {
+			return pJobHandle->orderProcess[pOrderPacket->orderId];
+		}
+		return 0;
+	}
+
+	dictEntry* entry = plg_dictFind(pJobHandle->order_process, pOrderPacket->order);
+	if (entry) {
+		return (PEventPorcess)dictGetVal(entry);
+	}
+	return 0;
+}
+
+static char job_IsCacheAllowWrite(void* pvJobHandle, char* PtrCache) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	if (pJobHandle->readOnly) {
+		return 0;
+	}
+	dictEntry* entry = plg_dictFind(pJobHandle->dictCache, PtrCache);
+	if (entry != 0)
+		return 1;
+	else
+		return 0;
+}
+
+static void IntervalometerCall(void* ptr, void* ctx) {
+
+	PJobHandle pJobHandle = ctx;
+	PIntervalometer pPIntervalometer = (PIntervalometer)ptr;
+	if (pPIntervalometer->admin) {
+		plg_JobSendControl(pJobHandle->eQueue, pPIntervalometer->Order, pPIntervalometer->Value, plg_sdsLen(pPIntervalometer->Value));
+	} else if (pPIntervalometer->group == pJobHandle->commitGroup) {
+		//the group that added the timer has not committed yet, the call waits in commitSend
+		char commitOpen = pJobHandle->commitOpen;
+		pJobHandle->commitOpen = 1;
+		job_RemoteCall(pJobHandle, pPIntervalometer->Order, plg_sdsLen(pPIntervalometer->Order), pPIntervalometer->Value, plg_sdsLen(pPIntervalometer->Value), PACKET_CONTROL);
+		pJobHandle->commitOpen = commitOpen;
+	} else {
+		job_RemoteCall(pJobHandle, pPIntervalometer->Order, plg_sdsLen(pPIntervalometer->Order), pPIntervalometer->Value, plg_sdsLen(pPIntervalometer->Value), PACKET_CONTROL);
+	}
+	IntervalometerFree(ptr, ctx);
+}
+
+/*
+Run the due timers, return the millisecond to wake up for the next one or 0 if there is none.
+*/
+static unsigned long long plg_JogActIntervalometer(void* pvJobHandle) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	if (!plg_TimeWheelCount(pJobHandle->timeWheel)) {
+		return 0;
+	}
+
+	plg_TimeWheelExpire(pJobHandle->timeWheel, plg_GetCurrentMilli(), IntervalometerCall, pJobHandle);
+	return plg_TimeWheelNext(pJobHandle->timeWheel);
+}
+
+/*
+The process of a PACKET_BUFFER packet gets the buffer itself,
+valueLen is -1 when it does not fit in a short, plg_JobCurrentBuffer gives the whole length.
+*/
+static int job_CallFun(RoutingFun fun, POrderPacket pOrderPacket) {
+
+	unsigned long long bufferLen;
+	void* buffer = plg_PacketBuffer(pOrderPacket, &bufferLen);
+	if (buffer) {
+		return 0 != fun(buffer, bufferLen > SHRT_MAX ? -1 : (short)bufferLen);
+	}
+	return 0 != fun(pOrderPacket->value, plg_sdsLen(pOrderPacket->value));
+}
+
+static void job_CoEntry(void* arg) {
+
+	PJobCo pJobCo = arg;
+	pJobCo->ret = job_CallFun(pJobCo->fun, pJobCo->pOrderPacket);
+}
+
+static int job_CoResume(PJobHandle pJobHandle, PJobCo pJobCo) {
+
+	PJobCo pCo = pJobHandle->pCo;
+	unsigned char readOnly = pJobHandle->readOnly;
+	pJobHandle->pCo = pJobCo;
+	pJobHandle->readOnly = pJobCo->readOnly;
+	int done = plg_CoResume(pJobCo->co);
+	pJobHandle->pCo = pCo;
+	pJobHandle->readOnly = readOnly;
+	return done;
+}
+
+/*
+Start the process on a coroutine, returns JOB_SUSPEND when it waits in plg_JobAwait.
+*/
+static int job_CallAsync(PJobHandle pJobHandle, RoutingFun fun, POrderPacket pOrderPacket) {
+
+	PJobCo pJobCo = pJobHandle->coFree;
+	if (pJobCo) {
+		pJobHandle->coFree = pJobCo->next;
+	} else {
+		void* co = plg_CoCreate(JOB_COSTACK);
+		if (!co) {
+			return job_CallFun(fun, pOrderPacket);
+		}
+		pJobCo = malloc(sizeof(JobCo));
+		pJobCo->co = co;
+		pJobCo->pJobHandle = pJobHandle;
+	}
+	pJobCo->pOrderPacket = pOrderPacket;
+	pJobCo->fun = fun;
+	pJobCo->pFuture = 0;
+	pJobCo->ret = 1;
+	pJobCo->readOnly = pJobHandle->readOnly;
+
+	PJobCo pCo = pJobHandle->pCo;
+	pJobHandle->pCo = pJobCo;
+	unsigned long long startTime = plg_GetCurrentNano();
+	int done = plg_CoStart(pJobCo->co, job_CoEntry, pJobCo);
+	pJobCo->runTime = plg_GetCurrentNano() - startTime;
+	pJobHandle->pCo = pCo;
+	if (!done) {
+		return JOB_SUSPEND;
+	}
+
+	pJobCo->next = pJobHandle->coFree;
+	pJobHandle->coFree = pJobCo;
+	return pJobCo->ret;
+}
+
+/*
+A packet whose order migrated away is forwarded to the new route,
+a packet of an order migrating in waits in holdPacket unless the source job forwarded it.
+*/
+static int job_CallProcess(PJobHandle pJobHandle, PEventPorcess pEventPorcess, POrderPacket pOrderPacket) {
+
+	RoutingFun fun = 0;
+	if (pEventPorcess->scriptType == ST_PTR) {
+		fun = pEventPorcess->functionPoint;
+	} else if (pEventPorcess->scriptType == ST_DLL && pJobHandle->dllHandle) {
+		fun = plg_SysLibSym(pJobHandle->dllHandle, pEventPorcess->function);
+	} else if (pEventPorcess->scriptType == ST_LUA && pJobHandle->luaHandle)  {
+
+		sds file = plg_sdsCatFmt(plg_sdsEmpty(), "%s/%s", pJobHandle->luaPath, pEventPorcess->fileClass);
+		unsigned long long bufferLen;
+		void* buffer = plg_PacketBuffer(pOrderPacket, &bufferLen);
+		if (buffer) {
+			return 0 != plg_LvmCallFile(pJobHandle->luaHandle, file, pEventPorcess->function, buffer, bufferLen);
+		}
+		return 0 != plg_LvmCallFile(pJobHandle->luaHandle, file, pEventPorcess->function, pOrderPacket->value, plg_sdsLen(pOrderPacket->value));
+	}
+
+	if (!fun) {
+		return 1;
+	} else if (pEventPorcess->async) {
+		return job_CallAsync(pJobHandle, fun, pOrderPacket);
+	}
+	return job_CallFun(fun, pOrderPacket);
+}
+
+/*
+Run the process of the packet without commit or rollback, returns 0 if the process asks for a rollback
+and JOB_SUSPEND if an async process waits, the packet then belongs to its coroutine.
+*/
+static int job_RunPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket) {
+
+	unsigned int orderId = pOrderPacket->orderId;
+	if (orderId && orderId < pJobHandle->orderSize) {
+		pJobHandle->pOrderName = pJobHandle->orderRoute[orderId].order;
+	} else {
+		pJobHandle->pOrderName = pOrderPacket->order;
+	}
+	elog(log_details, "ThreadType:%i.plg_JobThreadRouting.order:%s", pJobHandle->threadType, pJobHandle->pOrderName);
+
+	//start
+	if (pJobHandle->pStartPorcess && pJobHandle->pStartPorcess->scriptType == ST_PTR) {
+		pJobHandle->pStartPorcess->functionPoint(NULL, 0);
+	}
+
+	int ret = 1;
+	pJobHandle->pPacket = pOrderPacket;
+	PEventPorcess pEventPorcess = job_OrderProcess(pJobHandle, pOrderPacket);
+	if (pEventPorcess) {
+		unsigned long long startTime = 0;
+		POrderMetric pOrderMetric = 0;
+		pJobHandle->orderId = orderId;
+		if (orderId && !pJobHandle->commitReplay) {
+			plg_AtomicStore64(&pJobHandle->orderCount[orderId], pJobHandle->orderCount[orderId] + 1);
+			startTime = plg_GetCurrentNano();
+			pOrderMetric = job_OrderMetric(pJobHandle, orderId);
+			plg_HistogramRecord(pOrderMetric->wait, startTime > pOrderPacket->stamp ? startTime - pOrderPacket->stamp : 0);
+			pJobHandle->packetCount += 1;
+		}
+
+		pJobHandle->readOnly = pEventPorcess->readOnly;
+		ret = job_CallProcess(pJobHandle, pEventPorcess, pOrderPacket);
+		pJobHandle->readOnly = 0;
+
+		pJobHandle->orderId = 0;
+		if (pOrderMetric) {
+			unsigned long long runTime = plg_GetCurrentNano() - startTime;
+			pJobHandle->orderTime[orderId] += runTime;
+			if (0 == ret) {
+				pOrderMetric->rollback += 1;
+			}
+			if (JOB_SUSPEND != ret) {
+				plg_HistogramRecord(pOrderMetric->exec, runTime);
+			}
+		}
+	}
+	pJobHandle->pOrderName = 0;
+	pJobHandle->pPacket = 0;
+	return ret;
+}
+
+static void job_FinishPacket(PJobHandle pJobHandle) {
 
-	if (pJobHandle->threadType == TT_PROCESS) {
-		InitProcessCommend(pJobHandle);
+	//finish
+	if (pJobHandle->pFinishPorcess && pJobHandle->pFinishPorcess->scriptType == ST_PTR) {
+		unsigned long long startTime = plg_GetCurrentNano();
+		pJobHandle->pFinishPorcess->functionPoint(NULL, 0);
+		plg_HistogramRecord(pJobHandle->commitMetric, plg_GetCurrentNano() - startTime);
 	}
 
-	elog(log_fun, "plg_JobCreateHandle:%U", pJobHandle);
-	return pJobHandle;
+	elog(log_details, "plg_JobThreadRouting.finish!");
 }
 
-static void OrderFree(void* ptr) {
+static int job_GroupEmpty(PJobHandle pJobHandle) {
 
-	POrderPacket pOrderPacket = ptr;
-	plg_sdsFree(pOrderPacket->order);
-	plg_sdsFree(pOrderPacket->value);
-	free(pOrderPacket);
+	return !listLength(pJobHandle->commitPacket) && !listLength(pJobHandle->commitSend) &&
+		!listLength(pJobHandle->commitEvent) && !pJobHandle->commitTimerCount;
 }
 
-void plg_JobDestoryHandle(void* pvJobHandle) {
+/*
+Commit the open group once and release the remote calls and events it made, its timers become ordinary timers.
+*/
+static void job_GroupCommit(PJobHandle pJobHandle) {
 
-	PJobHandle pJobHandle = pvJobHandle;
-	elog(log_fun, "plg_JobDestoryHandle:%U", pJobHandle);
-	plg_eqDestory(pJobHandle->eQueue, OrderFree);
-	plg_dictRelease(pJobHandle->order_equeue);
-	plg_dictRelease(pJobHandle->dictCache);
-	plg_listRelease(pJobHandle->tranCache);
-	plg_listRelease(pJobHandle->tranFlush);
-	plg_dictRelease(pJobHandle->order_process);
-	plg_dictRelease(pJobHandle->tableName_cacheHandle);
-	plg_listRelease(pJobHandle->userEvent);
-	plg_listRelease(pJobHandle->userProcess);
-	plg_listRelease(pJobHandle->pListIntervalometer);
+	if (job_GroupEmpty(pJobHandle)) {
+		return;
+	}
 
-	if (pJobHandle->luaHandle) {
-		plg_LvmDestory(pJobHandle->luaHandle);
+	job_FinishPacket(pJobHandle);
+
+	listIter* iter = plg_listGetIterator(pJobHandle->commitSend, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		job_SendPacket(pJobHandle, listNodeValue(node));
 	}
-	
-	if (pJobHandle->dllHandle) {
-		plg_SysLibUnload(pJobHandle->dllHandle);
+	plg_listReleaseIterator(iter);
+	listSetFreeMethod(pJobHandle->commitSend, NULL);
+	plg_listEmpty(pJobHandle->commitSend);
+	listSetFreeMethod(pJobHandle->commitSend, OrderFree);
+
+	iter = plg_listGetIterator(pJobHandle->commitEvent, AL_START_HEAD);
+	while ((node = plg_listNext(iter)) != NULL) {
+		PHoldEvent pHoldEvent = listNodeValue(node);
+		plg_eqPush(pHoldEvent->pEventHandle, pHoldEvent->value);
+		pHoldEvent->value = 0;
 	}
-	free(pJobHandle);
-}
+	plg_listReleaseIterator(iter);
+	plg_listEmpty(pJobHandle->commitEvent);
 
-unsigned char plg_JobFindTableName(void* pvJobHandle, sds tableName) {
+	pJobHandle->commitTimerCount = 0;
+	pJobHandle->commitGroup += 1;
+	plg_listEmpty(pJobHandle->commitPacket);
+}
 
-	PJobHandle pJobHandle = pvJobHandle;
-	dictEntry * entry = plg_dictFind(pJobHandle->dictCache, tableName);
-	if (entry != 0) {
-		return 1;
-	} else {
-		return 0;
+/*
+A packet of the group rolled back: drop the whole group and run every packet again with its own commit.
+The side effects of the group that a rollback does not undo were held back and are dropped with it:
+remote calls in commitSend, events in commitEvent and timers in commitTimer. Replies are only published
+when a packet is freed, so the replay overwrites them, and the counters skip the replay with commitReplay.
+Globals a process changes outside the tables are not held back and see the packet run again.
+*/
+static void job_GroupReplay(PJobHandle pJobHandle) {
+
+	job_Rollback(pJobHandle);
+	plg_listEmpty(pJobHandle->commitSend);
+	plg_listEmpty(pJobHandle->commitEvent);
+	for (unsigned int l = 0; l < pJobHandle->commitTimerCount; l++) {
+		void* ptr = plg_TimeWheelCancel(pJobHandle->timeWheel, pJobHandle->commitTimer[l]);
+		if (ptr) {
+			IntervalometerFree(ptr, 0);
+		}
 	}
-}
+	pJobHandle->commitTimerCount = 0;
+	pJobHandle->commitGroup += 1;
 
-void plg_JobAddEventEqueue(void* pvJobHandle, sds nevent, void* equeue) {
-	PJobHandle pJobHandle = pvJobHandle;
-	plg_dictAdd(pJobHandle->order_equeue, nevent, equeue);
+	list* commitPacket = pJobHandle->commitPacket;
+	pJobHandle->commitPacket = plg_listCreate(LIST_MIDDLE);
+	listSetFreeMethod(pJobHandle->commitPacket, OrderFree);
+
+	pJobHandle->commitReplay = 1;
+	listIter* iter = plg_listGetIterator(commitPacket, AL_START_HEAD);
+	listNode* node;
+	while ((node = plg_listNext(iter)) != NULL) {
+		int ret = job_RunPacket(pJobHandle, listNodeValue(node));
+		if (JOB_SUSPEND == ret) {
+			continue;
+		} else if (0 == ret) {
+			job_Rollback(pJobHandle);
+		}
+		job_FinishPacket(pJobHandle);
+		plg_PacketFree(listNodeValue(node));
+	}
+	plg_listReleaseIterator(iter);
+	pJobHandle->commitReplay = 0;
+	listSetFreeMethod(commitPacket, NULL);
+	plg_listRelease(commitPacket);
 }
 
-void plg_JobAddEventProcess(void* pvJobHandle, sds nevent, void* pvProcess) {
+static void job_GroupPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket) {
 
-	PEventPorcess process = pvProcess;
-	PJobHandle pJobHandle = pvJobHandle;
-	plg_dictAdd(pJobHandle->order_process, nevent, process);
-	pJobHandle->allWeight += process->weight;
+	if (!listLength(pJobHandle->commitPacket)) {
+		pJobHandle->commitStamp = plg_GetCurrentNano();
+	}
+	plg_listAddNodeTail(pJobHandle->commitPacket, pOrderPacket);
+
+	pJobHandle->commitOpen = 1;
+	int ret = job_RunPacket(pJobHandle, pOrderPacket);
+	pJobHandle->commitOpen = 0;
+
+	if (JOB_SUSPEND == ret) {
+		return;
+	} else if (0 == ret) {
+		job_GroupReplay(pJobHandle);
+	} else if (listLength(pJobHandle->commitPacket) >= pJobHandle->commitCount ||
+		plg_GetCurrentNano() - pJobHandle->commitStamp >= (unsigned long long)pJobHandle->commitTime * 1000) {
+		job_GroupCommit(pJobHandle);
+	}
 }
 
 /*
-ҪcachediskصľٲѯΪʱִtableʼ
+group: the packet comes from the queue and may join the group commit.
 */
-void* plg_JobNewTableCache(void* pvJobHandle, char* table, void* pDiskHandle) {
+static void job_ProcessPacket(PJobHandle pJobHandle, POrderPacket pOrderPacket, int group) {
+
+	unsigned int orderId = pOrderPacket->orderId;
+	if (orderId && orderId < pJobHandle->orderSize) {
+		if (pJobHandle->orderProcess[orderId] == 0) {
+			void* eQueue = plg_AtomicLoadPtr(&pJobHandle->orderRoute[orderId].eQueue);
+			if (eQueue && eQueue != pJobHandle->eQueue) {
+				pOrderPacket->flags |= PACKET_FORWARD;
+				job_PushQueue(eQueue, pOrderPacket);
+				return;
+			}
+		}
 
-	PJobHandle pJobHandle = pvJobHandle;
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, table);
-	if (valueEntry == 0) {
-		void* pCacheHandle = plg_CacheCreateHandle(pDiskHandle);
-		plg_dictAdd(pJobHandle->dictCache, table, pCacheHandle);
-		return pCacheHandle;
-	} else {
-		return dictGetVal(valueEntry);
-	}
-}
+		if (!(pOrderPacket->flags & PACKET_FORWARD) && pJobHandle->orderHold[orderId]) {
+			plg_listAddNodeTail(pJobHandle->holdPacket, pOrderPacket);
+			return;
+		}
 
-void plg_JobAddTableCache(void* pvJobHandle, char* table, void* pCacheHandle) {
+		if (pJobHandle->orderProcess[orderId] == 0) {
+			elog(log_error, "job_ProcessPacket.Order:%s not found", pJobHandle->orderRoute[orderId].order);
+			plg_JobCoalesceTake(pJobHandle->orderRoute[orderId].pCoalesce, pOrderPacket);
+			plg_PacketFree(pOrderPacket);
+			return;
+		}
 
-	PJobHandle pJobHandle = pvJobHandle;
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, table);
-	if (valueEntry == 0) {
-		plg_dictAdd(pJobHandle->tableName_cacheHandle, table, pCacheHandle);
+		if (plg_JobCoalesceTake(pJobHandle->orderRoute[orderId].pCoalesce, pOrderPacket)) {
+			plg_PacketFree(pOrderPacket);
+			return;
+		}
+
+		//a read only packet writes nothing, it does not join a group that could replay it
+		if (group && pJobHandle->commitCount > 1 && !pJobHandle->orderRoute[orderId].readOnly) {
+			job_GroupPacket(pJobHandle, pOrderPacket);
+			return;
+		}
 	}
-}
 
-void* plg_JobEqueueHandle(void* pvJobHandle) {
-	PJobHandle pJobHandle = pvJobHandle;
-	return pJobHandle->eQueue;
-}
+	//admin orders see everything committed before them
+	job_GroupCommit(pJobHandle);
 
-unsigned int  plg_JobAllWeight(void* pvJobHandle) {
-	PJobHandle pJobHandle = pvJobHandle;
-	return pJobHandle->allWeight;
+	int ret = job_RunPacket(pJobHandle, pOrderPacket);
+	if (JOB_SUSPEND == ret) {
+		return;
+	} else if (0 == ret) {
+		job_Rollback(pJobHandle);
+	}
+	job_FinishPacket(pJobHandle);
+	plg_PacketFree(pOrderPacket);
 }
 
-unsigned int  plg_JobIsEmpty(void* pvJobHandle) {
-	PJobHandle pJobHandle = pvJobHandle;
-	return dictSize(pJobHandle->order_process);
+static void job_AwaitDone(void* ctx) {
+
+	PJobCo pJobCo = ctx;
+	plg_JobSendControl(plg_JobEqueueHandle(pJobCo->pJobHandle), "resume", (char*)&pJobCo, sizeof(PJobCo));
 }
 
 /*
-û vmʹ
+Wait for a future of plg_JobCall or plg_MngCall, returns 1 when it is complete.
+In an async process the work done so far is committed and its remote calls are sent,
+the coroutine is suspended and the job processes other packets until the future completes.
+A rollback after the await only undoes the work done after it.
+Anywhere else the thread blocks as in plg_FutureWait.
 */
-int plg_JobRemoteCall(void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
-
-	CheckUsingThread(0);
+int plg_JobAwait(void* pFuture) {
 
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
-	POrderPacket pOrderPacket = malloc(sizeof(OrderPacket));
-	pOrderPacket->order = plg_sdsNewLen(order, orderLen);
-	pOrderPacket->value = plg_sdsNewLen(value, valueLen);
-	
-	dictEntry* entry = plg_dictFind(pJobHandle->order_equeue, pOrderPacket->order);
-	if (entry) {
-		plg_eqPush(dictGetVal(entry), pOrderPacket);
+	if (!pJobHandle || !pJobHandle->pCo) {
+		return plg_FutureWait(pFuture, 0);
+	} else if (plg_FutureIsReady(pFuture)) {
 		return 1;
-	} else {
-		elog(log_error, "plg_JobRemoteCall.Order:%s not found", order);
-		return 0;
 	}
-}
 
-static char job_IsCacheAllowWrite(void* pvJobHandle, char* PtrCache) {
+	PJobCo pJobCo = pJobHandle->pCo;
+	char commitOpen = pJobHandle->commitOpen;
+	if (commitOpen) {
+		//the packet leaves the group, the rest of the group commits with it
+		listNode* node = listLast(pJobHandle->commitPacket);
+		if (node && listNodeValue(node) == pJobCo->pOrderPacket) {
+			listSetFreeMethod(pJobHandle->commitPacket, NULL);
+			plg_listDelNode(pJobHandle->commitPacket, node);
+			listSetFreeMethod(pJobHandle->commitPacket, OrderFree);
+		}
+		pJobHandle->commitOpen = 0;
+	}
 
-	PJobHandle pJobHandle = pvJobHandle;
-	dictEntry* entry = plg_dictFind(pJobHandle->dictCache, PtrCache);
-	if (entry != 0)
+	if (!job_GroupEmpty(pJobHandle)) {
+		job_GroupCommit(pJobHandle);
+	} else {
+		job_FinishPacket(pJobHandle);
+	}
+
+	if (!plg_FutureSetWaiter(pFuture, job_AwaitDone, pJobCo)) {
+		//completed meanwhile, the packet goes on in a new group
+		if (commitOpen) {
+			pJobHandle->commitStamp = plg_GetCurrentNano();
+			plg_listAddNodeTail(pJobHandle->commitPacket, pJobCo->pOrderPacket);
+			pJobHandle->commitOpen = 1;
+		}
 		return 1;
-	else
-		return 0;
-}
+	}
 
-static int IntervalometerCmpFun(void* value1, void* value2) {
+	pJobCo->pFuture = pFuture;
+	plg_listAddNodeTail(pJobHandle->coWait, pJobCo);
+	pJobCo->node = listLast(pJobHandle->coWait);
+	plg_CoYield(pJobCo->co);
+	return 1;
+}
 
-	PIntervalometer pi1 = (PIntervalometer)value1;
-	PIntervalometer pi2 = (PIntervalometer)value2;
+/*
+The future awaited by a coroutine completed, run it until it returns or waits again.
+An order migrated away while its process waits finishes here without its tables.
+*/
+static int OrderResume(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobHandle pJobHandle = job_Handle();
+	PJobCo pJobCo = *(PJobCo*)value;
+	plg_listDelNode(pJobHandle->coWait, pJobCo->node);
+	pJobCo->pFuture = 0;
+
+	POrderPacket pPacket = pJobHandle->pPacket;
+	char* pOrderName = pJobHandle->pOrderName;
+	POrderPacket pOrderPacket = pJobCo->pOrderPacket;
+	unsigned int orderId = pOrderPacket->orderId;
+	if (orderId && orderId < pJobHandle->orderSize) {
+		pJobHandle->pOrderName = pJobHandle->orderRoute[orderId].order;
+	} else {
+		pJobHandle->pOrderName = pOrderPacket->order;
+	}
+	pJobHandle->pPacket = pOrderPacket;
+	pJobHandle->orderId = orderId;
+
+	unsigned long long startTime = plg_GetCurrentNano();
+	int done = job_CoResume(pJobHandle, pJobCo);
+	unsigned long long runTime = plg_GetCurrentNano() - startTime;
+	pJobCo->runTime += runTime;
+	POrderMetric pOrderMetric = 0;
+	if (orderId && orderId < pJobHandle->orderSize) {
+		pJobHandle->orderTime[orderId] += runTime;
+		pOrderMetric = job_OrderMetric(pJobHandle, orderId);
+	}
 
-	if (pi1->tim > pi2->tim) {
+	pJobHandle->orderId = 0;
+	pJobHandle->pOrderName = pOrderName;
+	pJobHandle->pPacket = pPacket;
+	if (!done) {
 		return 1;
-	} else if (pi1->tim == pi2->tim) {
-		return 0;
-	} else {
-		return -1;
 	}
-}
 
-static long long plg_JogActIntervalometer(void* pvJobHandle) {
+	if (pOrderMetric) {
+		plg_HistogramRecord(pOrderMetric->exec, pJobCo->runTime);
+	}
+	if (0 == pJobCo->ret) {
+		if (pOrderMetric) {
+			pOrderMetric->rollback += 1;
+		}
+		job_Rollback(pJobHandle);
+	}
+	job_FinishPacket(pJobHandle);
+	plg_PacketFree(pOrderPacket);
+
+	pJobCo->next = pJobHandle->coFree;
+	pJobHandle->coFree = pJobCo;
+	return 1;
+}
 
+void plg_JobSetGroupCommit(void* pvJobHandle, unsigned int commitCount, unsigned int commitTime) {
 	PJobHandle pJobHandle = pvJobHandle;
-	if (!listLength(pJobHandle->pListIntervalometer)) {
-		return 0;
-	}
+	pJobHandle->commitCount = commitCount;
+	pJobHandle->commitTime = commitTime;
+}
 
-	plg_SortList(pJobHandle->pListIntervalometer, IntervalometerCmpFun);
-	
-	unsigned long long sec = plg_GetCurrentSec();
-	listIter* iter = plg_listGetIterator(pJobHandle->pListIntervalometer, AL_START_HEAD);
-	listNode* node;
-	while ((node = plg_listNext(iter)) != NULL) {
+/*
+Pin the calling thread, memory first written by the thread is then placed on the node of the core.
+*/
+static void job_SetThreadCore(int core) {
 
-		PIntervalometer pPIntervalometer = (PIntervalometer)node->value;
-		if (pPIntervalometer->tim <= sec) {
-			plg_JobRemoteCall(pPIntervalometer->Order, plg_sdsLen(pPIntervalometer->Order), pPIntervalometer->Value, plg_sdsLen(pPIntervalometer->Value));
-			plg_listDelNode(pJobHandle->pListIntervalometer, node);
-		} else {
-			break;
-		}
+	if (core < 0) {
+		return;
 	}
-	plg_listReleaseIterator(iter);
 
-	if (listLength(pJobHandle->pListIntervalometer)) {
-		PIntervalometer pPIntervalometer = (PIntervalometer)listNodeValue(listFirst(pJobHandle->pListIntervalometer));
-		return pPIntervalometer->tim - sec;
-	} else {
-		return 0;
+#ifdef _WIN32
+	if (core >= (int)(sizeof(DWORD_PTR) * 8) || 0 == SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core)) {
+		elog(log_error, "job_SetThreadCore.core:%i", core);
 	}
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(core, &cpuSet);
+	if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet)) {
+		elog(log_error, "job_SetThreadCore.core:%i", core);
+	}
+#else
+	elog(log_warn, "job_SetThreadCore.core:%i thread affinity not supported", core);
+#endif
+}
+
+void plg_JobSetCore(void* pvJobHandle, int core) {
+	PJobHandle pJobHandle = pvJobHandle;
+	pJobHandle->core = core;
 }
 
 static void* plg_JobThreadRouting(void* pvJobHandle) {
@@ -562,6 +2091,7 @@ static void* plg_JobThreadRouting(void* pvJobHandle) {
 	elog(log_fun, "plg_JobThreadRouting");
 
 	PJobHandle pJobHandle = pvJobHandle;
+	job_SetThreadCore(pJobHandle->core);
 	plg_LocksSetSpecific(pJobHandle);
 
 	//init
@@ -577,19 +2107,17 @@ static void* plg_JobThreadRouting(void* pvJobHandle) {
 
 	//start
 	sdsKey = plg_sdsNew("start");
-	PEventPorcess pStartPorcess = 0;
 	entry = plg_dictFind(pJobHandle->order_process, sdsKey);
 	if (entry) {
-		pStartPorcess = (PEventPorcess)dictGetVal(entry);
+		pJobHandle->pStartPorcess = (PEventPorcess)dictGetVal(entry);
 	}
 	plg_sdsFree(sdsKey);
 
 	//finish
 	sdsKey = plg_sdsNew("finish");
-	PEventPorcess pFinishPorcess = 0;
 	entry = plg_dictFind(pJobHandle->order_process, sdsKey);
 	if (entry) {
-		pFinishPorcess = (PEventPorcess)dictGetVal(entry);
+		pJobHandle->pFinishPorcess = (PEventPorcess)dictGetVal(entry);
 	}
 	plg_sdsFree(sdsKey);
 	unsigned long long timer = 0;
@@ -598,75 +2126,31 @@ static void* plg_JobThreadRouting(void* pvJobHandle) {
 		if (timer == 0) {
 			plg_eqWait(pJobHandle->eQueue);
 		} else {
-			if (-1 == plg_eqTimeWait(pJobHandle->eQueue, timer, 0)) {
-				timer = plg_GetCurrentSec();
-				unsigned long long sec = plg_JogActIntervalometer(pJobHandle);
-				if (0 == sec) {
-					timer = 0;
-				} else {
-					timer += sec;
-				}
+			if (-1 == plg_eqTimeWait(pJobHandle->eQueue, timer / 1000, (timer % 1000) * 1000000)) {
+				timer = plg_JogActIntervalometer(pJobHandle);
 				continue;
 			}
 		}
 		
 		do {
-			POrderPacket pOrderPacket = (POrderPacket)plg_eqPop(pJobHandle->eQueue);
-
-			if (pOrderPacket != 0) {
-				elog(log_details, "ThreadType:%i.plg_JobThreadRouting.order:%s", pJobHandle->threadType, (char*)pOrderPacket->order);
-				pJobHandle->pOrderName = pOrderPacket->order;
-
-				//start
-				if (pStartPorcess && pStartPorcess->scriptType == ST_PTR) {
-					pStartPorcess->functionPoint(NULL, 0);
-				}
+			void* packets[JOB_POPBATCH];
+			unsigned int count = plg_eqPopBatch(pJobHandle->eQueue, packets, JOB_POPBATCH);
+			if (count == 0) {
+				job_GroupCommit(pJobHandle);
+				break;
+			}
 
-				entry = plg_dictFind(pJobHandle->order_process, pOrderPacket->order);
-				if (entry) {
-					PEventPorcess pEventPorcess = (PEventPorcess)dictGetVal(entry);
-					if (pEventPorcess->scriptType == ST_PTR) {
-						if (0 == pEventPorcess->functionPoint(pOrderPacket->value, plg_sdsLen(pOrderPacket->value))) {
-							job_Rollback(pJobHandle);
-						}
-					} else if (pEventPorcess->scriptType == ST_DLL && pJobHandle->dllHandle) {
-
-						RoutingFun fun = plg_SysLibSym(pJobHandle->dllHandle, pEventPorcess->function);
-						if (fun) {
-							if (0 == fun(pOrderPacket->value, plg_sdsLen(pOrderPacket->value))) {
-								job_Rollback(pJobHandle);
-							}
-						}
-					} else if (pEventPorcess->scriptType == ST_LUA && pJobHandle->luaHandle)  {
-
-						sds file = plg_sdsCatFmt(plg_sdsEmpty(), "%s/%s", pJobHandle->luaPath, pEventPorcess->fileClass);
-						if (0 == plg_LvmCallFile(pJobHandle->luaHandle, file, pEventPorcess->function, pOrderPacket->value, plg_sdsLen(pOrderPacket->value))) {
-							job_Rollback(pJobHandle);
-						}
-					}
-				}
-				pJobHandle->pOrderName = 0;
-				plg_sdsFree(pOrderPacket->order);
-				plg_sdsFree(pOrderPacket->value);
-				free(pOrderPacket);
-
-				//finish
-				if (pFinishPorcess && pFinishPorcess->scriptType == ST_PTR) {
-					pFinishPorcess->functionPoint(NULL, 0);
-				}
+			for (unsigned int l = 0; l < count; l++) {
+				job_ProcessPacket(pJobHandle, (POrderPacket)packets[l], 1);
+			}
 
-				elog(log_details, "plg_JobThreadRouting.finish!");
-			} else {
-				break; 
+			//due timers go to the control lane without waiting for the backlog to drain
+			if (plg_TimeWheelCount(pJobHandle->timeWheel)) {
+				plg_TimeWheelExpire(pJobHandle->timeWheel, plg_GetCurrentMilli(), IntervalometerCall, pJobHandle);
 			}
 		} while (1);
 
-		long long sec = plg_JogActIntervalometer(pJobHandle);
-		if (0 == sec) {
-			timer = 0;
-		} else {
-			timer += sec;
-		}
+		timer = plg_JogActIntervalometer(pJobHandle);
 
 		if (pJobHandle->exitThread == 1) {
 			elog(log_details, "ThreadType:%i.plg_JobThreadRouting.exitThread:%i", pJobHandle->threadType, pJobHandle->exitThread);
@@ -698,11 +2182,22 @@ manage
 */
 void plg_JobSendOrder(void* eQueue, char* order, char* value, short valueLen) {
 
-	POrderPacket POrderPacket = malloc(sizeof(OrderPacket));
-	POrderPacket->order = plg_sdsNew(order);
-	POrderPacket->value = plg_sdsNewLen(value, valueLen);
+	//Threads outside the job environment have no pool, plg_PacketAlloc falls back to malloc.
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	void* pOrderPacket = plg_PacketAlloc(pJobHandle ? pJobHandle->packetPool : 0, 0, order, strlen(order), value, valueLen);
+	plg_eqPush(eQueue, pOrderPacket);
+}
+
+/*
+Same as plg_JobSendOrder through the control lane, it runs before the queued user orders.
+Only for orders that do not need to come after what was sent before, not the migration or "destroy".
+*/
+void plg_JobSendControl(void* eQueue, char* order, char* value, short valueLen) {
 
-	plg_eqPush(eQueue, POrderPacket);
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	POrderPacket pOrderPacket = plg_PacketAlloc(pJobHandle ? pJobHandle->packetPool : 0, 0, order, strlen(order), value, valueLen);
+	pOrderPacket->flags |= PACKET_CONTROL;
+	plg_eqPushControl(eQueue, pOrderPacket);
 }
 
 void plg_JobAddAdmOrderProcess(void* pvJobHandle, char* nameOrder, void* pvProcess) {
@@ -749,8 +2244,8 @@ char plg_JobCheckUsingThread() {
 void plg_JobPrintStatus(void* pvJobHandle) {
 
 	PJobHandle pJobHandle = pvJobHandle;
-	printf("order_equeue:%d lcache:%d o_process:%d table_cache:%d aweight:%d uevent:%d uprocess:%d\n",
-		dictSize(pJobHandle->order_equeue),
+	printf("order_id:%d lcache:%d o_process:%d table_cache:%d aweight:%d uevent:%d uprocess:%d\n",
+		dictSize(pJobHandle->order_id),
 		dictSize(pJobHandle->dictCache),
 		dictSize(pJobHandle->order_process),
 		dictSize(pJobHandle->tableName_cacheHandle),
@@ -780,15 +2275,30 @@ void plg_JobPrintDetails(void* pvJobHandle) {
 	plg_dictReleaseIterator(dictIter);
 	printf("<pJobHandle->dictCache\n");
 
-	printf("pJobHandle->order_equeue>\n");
-	dictIter = plg_dictGetSafeIterator(pJobHandle->order_equeue);
+	printf("pJobHandle->order_id>\n");
+	dictIter = plg_dictGetSafeIterator(pJobHandle->order_id);
 	while ((dictNode = plg_dictNext(dictIter)) != NULL) {
-		printf("%s %p\n", (char*)dictGetKey(dictNode), dictGetVal(dictNode));
+		unsigned int orderId = (unsigned int)(size_t)dictGetVal(dictNode);
+		printf("%s %u %p\n", (char*)dictGetKey(dictNode), orderId, orderId < pJobHandle->orderSize ? pJobHandle->orderRoute[orderId].eQueue : 0);
 	}
 	plg_dictReleaseIterator(dictIter);
-	printf("<pJobHandle->order_equeue\n");
+	printf("<pJobHandle->order_id\n");
 }
 
+/*
+Tables used by the current order are remembered for plg_MngPlanJob,
+orderTouch skips the set when the order uses the same table again.
+*/
+static dictEntry* job_FindTableCache(PJobHandle pJobHandle, sds sdsTable) {
+
+	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	unsigned int orderId = pJobHandle->orderId;
+	if (valueEntry && orderId && pJobHandle->orderTouch[orderId] != dictGetKey(valueEntry)) {
+		pJobHandle->orderTouch[orderId] = dictGetKey(valueEntry);
+		plg_DictSetAdd(pJobHandle->touch, pJobHandle->orderRoute[orderId].order, dictGetKey(valueEntry));
+	}
+	return valueEntry;
+}
 
 /*
 ҪȲ鱾л
@@ -800,7 +2310,7 @@ unsigned int plg_JobSet(void* table, unsigned short tableLen, void* key, unsigne
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableAdd(dictGetVal(valueEntry), sdsTable, sdsKye, value, valueLen);
@@ -830,7 +2340,7 @@ void* plg_JobGet(void* table, unsigned short tableLen, void* key, unsigned short
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		void* pDictExten = plg_DictExtenCreate();
 		if (0 <= plg_CacheTableFind(dictGetVal(valueEntry), sdsTable, sdsKye, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)))) {
@@ -863,7 +2373,7 @@ unsigned int plg_JobDel(void* table, unsigned short tableLen, void* key, unsigne
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableDel(dictGetVal(valueEntry), sdsTable, sdsKye);
@@ -888,7 +2398,7 @@ unsigned int plg_JobLength(void* table, unsigned short tableLen) {
 	CheckUsingThread(0);
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		len = plg_CacheTableLength(dictGetVal(valueEntry), sdsTable, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -906,7 +2416,7 @@ unsigned int plg_JobSIfNoExit(void* table, unsigned short tableLen, void* key, u
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableAddIfNoExist(dictGetVal(valueEntry), sdsTable, sdsKey, value, valueLen);
@@ -932,7 +2442,7 @@ unsigned int plg_JobIsKeyExist(void* table, unsigned short tableLen, void* key,
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		r = plg_CacheTableIsKeyExist(dictGetVal(valueEntry), sdsTable, sdsKye, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -953,7 +2463,7 @@ unsigned int plg_JobRename(void* table, unsigned short tableLen, void* key, unsi
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 	sds sdsNewKye = plg_sdsNewLen(newKey, newKeyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableRename(dictGetVal(valueEntry), sdsTable, sdsKye, sdsNewKye);
@@ -980,7 +2490,7 @@ void plg_JobLimite(void* table, unsigned short tableLen, void* key, unsigned sho
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableLimite(dictGetVal(valueEntry), sdsTable, sdsKye, left, right, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -996,7 +2506,7 @@ void plg_JobOrder(void* table, unsigned short tableLen, short order, unsigned in
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableOrder(dictGetVal(valueEntry), sdsTable, order, limite, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1013,7 +2523,7 @@ void plg_JobRang(void* table, unsigned short tableLen, void* beginKey, unsigned
 	sds sdsBeginKey = plg_sdsNewLen(beginKey, beginKeyLen);
 	sds sdsEndKey = plg_sdsNewLen(endKey, endKeyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableRang(dictGetVal(valueEntry), sdsTable, sdsBeginKey, sdsEndKey, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1033,7 +2543,7 @@ void plg_JobPattern(void* table, unsigned short tableLen, void* beginKey, unsign
 	sds sdsEndKey = plg_sdsNewLen(endKey, endKeyLen);
 	sds sdsPattern = plg_sdsNewLen(pattern, patternLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTablePattern(dictGetVal(valueEntry), sdsTable, sdsBeginKey, sdsEndKey, sdsPattern, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1054,7 +2564,7 @@ unsigned int plg_JobMultiSet(void* table, unsigned short tableLen, void* pDictEx
 	CheckUsingThread(0);
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableMultiAdd(dictGetVal(valueEntry), sdsTable, pDictExten);
@@ -1077,7 +2587,7 @@ void plg_JobMultiGet(void* table, unsigned short tableLen, void* pKeyDictExten,
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableMultiFind(dictGetVal(valueEntry), sdsTable, pKeyDictExten, pValueDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1093,7 +2603,7 @@ void* plg_JobRand(void* table, unsigned short tableLen, unsigned int* valueLen)
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 
 		void* pDictExten = plg_DictExtenCreate();
@@ -1125,7 +2635,7 @@ void plg_JobTableClear(void* table, unsigned short tableLen) {
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableClear(dictGetVal(valueEntry), sdsTable);
@@ -1148,7 +2658,7 @@ unsigned int plg_JobSAdd(void* table, unsigned short tableLen, void* key, unsign
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 	sds sdsValue = plg_sdsNewLen(value, valueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			r = plg_CacheTableSetAdd(dictGetVal(valueEntry), sdsTable, sdsKye, sdsValue);
@@ -1177,7 +2687,7 @@ void plg_JobSRang(void* table, unsigned short tableLen, void* key, unsigned shor
 	sds sdsBeginKey = plg_sdsNewLen(beginValue, beginValueLen);
 	sds sdsEndKey = plg_sdsNewLen(endValue, endValueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetRang(dictGetVal(valueEntry), sdsTable, sdsKey, sdsBeginKey, sdsEndKey, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1197,7 +2707,7 @@ void plg_JobSLimite(void* table, unsigned short tableLen, void* key, unsigned sh
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 	sds sdsValue = plg_sdsNewLen(value, valueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetLimite(dictGetVal(valueEntry), sdsTable, sdsKey, sdsValue, left, right, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1216,7 +2726,7 @@ unsigned int plg_JobSLength(void* table, unsigned short tableLen, void* key, uns
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		len = plg_CacheTableSetLength(dictGetVal(valueEntry), sdsTable, sdsKey, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1237,7 +2747,7 @@ unsigned int plg_JobSIsKeyExist(void* table, unsigned short tableLen, void* key,
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 	sds sdsValue = plg_sdsNewLen(value, valueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		r = plg_CacheTableSetIsKeyExist(dictGetVal(valueEntry), sdsTable, sdsKey, sdsValue, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1257,7 +2767,7 @@ void plg_JobSMembers(void* table, unsigned short tableLen, void* key, unsigned s
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetMembers(dictGetVal(valueEntry), sdsTable, sdsKey, pDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1275,7 +2785,7 @@ void* plg_JobSRand(void* table, unsigned short tableLen, void* key, unsigned sho
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 
 		void* pDictExten = plg_DictExtenCreate();
@@ -1309,7 +2819,7 @@ void plg_JobSDel(void* table, unsigned short tableLen, void* key, unsigned short
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableSetDel(dictGetVal(valueEntry), sdsTable, sdsKey, pValueDictExten);
@@ -1332,7 +2842,7 @@ void* plg_JobSPop(void* table, unsigned short tableLen, void* key, unsigned shor
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKey = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 
 		void* pDictExten = plg_DictExtenCreate();
@@ -1370,7 +2880,7 @@ unsigned int plg_JobSRangCount(void* table, unsigned short tableLen, void* key,
 	sds sdsBeginKey = plg_sdsNewLen(beginValue, beginValueLen);
 	sds sdsEndKey = plg_sdsNewLen(endValue, endValueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		r = plg_CacheTableSetRangCount(dictGetVal(valueEntry), sdsTable, sdsKey, sdsBeginKey, sdsEndKey, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1390,7 +2900,7 @@ void plg_JobSUion(void* table, unsigned short tableLen, void* pSetDictExten, voi
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetUion(dictGetVal(valueEntry), sdsTable, pSetDictExten, pKeyDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1406,7 +2916,7 @@ void plg_JobSUionStore(void* table, unsigned short tableLen, void* pSetDictExten
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableSetUionStore(dictGetVal(valueEntry), sdsTable, pSetDictExten, sdsKye);
@@ -1427,7 +2937,7 @@ void plg_JobSInter(void* table, unsigned short tableLen, void* pSetDictExten, vo
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetInter(dictGetVal(valueEntry), sdsTable, pSetDictExten, pKeyDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1443,7 +2953,7 @@ void plg_JobSInterStore(void* table, unsigned short tableLen, void* pSetDictExte
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableSetInterStore(dictGetVal(valueEntry), sdsTable, pSetDictExten, sdsKye);
@@ -1464,7 +2974,7 @@ void plg_JobSDiff(void* table, unsigned short tableLen, void* pSetDictExten, voi
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableSetDiff(dictGetVal(valueEntry), sdsTable, pSetDictExten, pKeyDictExten, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1480,7 +2990,7 @@ void plg_JobSDiffStore(void* table, unsigned short tableLen, void* pSetDictExten
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 	sds sdsKye = plg_sdsNewLen(key, keyLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableSetDiffStore(dictGetVal(valueEntry), sdsTable, pSetDictExten, sdsKye);
@@ -1504,7 +3014,7 @@ void plg_JobSMove(void* table, unsigned short tableLen, void* srcKey, unsigned s
 	sds sdsDesKye = plg_sdsNewLen(desKey, desKeyLen);
 	sds sdsValue = plg_sdsNewLen(value, valueLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		if (job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry))) {
 			plg_CacheTableSetMove(dictGetVal(valueEntry), sdsTable, sdsSrcKye, sdsDesKye, sdsValue);
@@ -1528,7 +3038,7 @@ void plg_JobTableMembersWithJson(void* table, unsigned short tableLen, void* jso
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	sds sdsTable = plg_sdsNewLen(table, tableLen);
 
-	dictEntry* valueEntry = plg_dictFind(pJobHandle->tableName_cacheHandle, sdsTable);
+	dictEntry* valueEntry = job_FindTableCache(pJobHandle, sdsTable);
 	if (valueEntry != 0) {
 		plg_CacheTableMembersWithJson(dictGetVal(valueEntry), sdsTable, jsonRoot, job_IsCacheAllowWrite(pJobHandle, dictGetKey(valueEntry)));
 	} else {
@@ -1543,17 +3053,80 @@ char* plg_JobCurrentOrder() {
 	return pJobHandle->pOrderName;
 }
 
-void plg_JobAddTimer(unsigned int timer, void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
-	CheckUsingThread(NORET);
+/*
+The buffer handed over to the packet being processed, 0 if it was not sent with plg_MngRemoteCallBuffer
+or plg_JobRemoteCallBuffer. It stays valid until the process returns, a rolled back packet runs again with it.
+*/
+void* plg_JobCurrentBuffer(unsigned long long* bufferLen) {
+	CheckUsingThread(0);
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	if (!pJobHandle->pPacket) {
+		return 0;
+	}
+	return plg_PacketBuffer(pJobHandle->pPacket, bufferLen);
+}
+
+/*
+Call order with value from this job after timer milliseconds.
+Returns the handle for plg_JobCancelTimer, it is only valid in the job that added the timer.
+*/
+unsigned long long plg_JobAddTimerMs(unsigned long long timer, void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
+	CheckUsingThread(0);
 
-	unsigned long long sec = plg_GetCurrentSec();
 	PJobHandle pJobHandle = plg_LocksGetSpecific();
 	PIntervalometer pPIntervalometer = malloc(sizeof(Intervalometer));
 	pPIntervalometer->Order = plg_sdsNewLen(order, orderLen);
 	pPIntervalometer->Value = plg_sdsNewLen(value, valueLen);
-	pPIntervalometer->tim = sec + timer;
+	pPIntervalometer->admin = 0;
+	pPIntervalometer->group = pJobHandle->commitOpen ? pJobHandle->commitGroup : 0;
+
+	unsigned long long now = plg_GetCurrentMilli();
+	unsigned long long expire = now + timer;
+	if (expire < now) {
+		expire = ~0ULL;
+	}
+	unsigned long long timerHandle = plg_TimeWheelAdd(pJobHandle->timeWheel, now, expire, pPIntervalometer);
+	if (pPIntervalometer->group) {
+		if (pJobHandle->commitTimerCount == pJobHandle->commitTimerSize) {
+			pJobHandle->commitTimerSize = pJobHandle->commitTimerSize ? pJobHandle->commitTimerSize * 2 : 16;
+			pJobHandle->commitTimer = realloc(pJobHandle->commitTimer, pJobHandle->commitTimerSize * sizeof(unsigned long long));
+		}
+		pJobHandle->commitTimer[pJobHandle->commitTimerCount++] = timerHandle;
+	}
+	return timerHandle;
+}
+
+/*
+Send the admin order to pJobHandle itself after timer milliseconds, for manage and file jobs which have no route.
+Only the thread of pJobHandle may call it.
+*/
+unsigned long long plg_JobAddAdmTimer(void* pvJobHandle, unsigned int timer, char* order, char* value, short valueLen) {
+
+	PJobHandle pJobHandle = pvJobHandle;
+	PIntervalometer pPIntervalometer = malloc(sizeof(Intervalometer));
+	pPIntervalometer->Order = plg_sdsNew(order);
+	pPIntervalometer->Value = plg_sdsNewLen(value, valueLen);
+	pPIntervalometer->admin = 1;
+	pPIntervalometer->group = 0;
+
+	unsigned long long now = plg_GetCurrentMilli();
+	return plg_TimeWheelAdd(pJobHandle->timeWheel, now, now + timer, pPIntervalometer);
+}
+
+void plg_JobAddTimer(unsigned int timer, void* order, unsigned short orderLen, void* value, unsigned short valueLen) {
+	plg_JobAddTimerMs((unsigned long long)timer * 1000, order, orderLen, value, valueLen);
+}
+
+int plg_JobCancelTimer(unsigned long long timerHandle) {
+	CheckUsingThread(0);
 
-	plg_listAddNodeHead(pJobHandle->pListIntervalometer, pPIntervalometer);
+	PJobHandle pJobHandle = plg_LocksGetSpecific();
+	void* ptr = plg_TimeWheelCancel(pJobHandle->timeWheel, timerHandle);
+	if (!ptr) {
+		return 0;
+	}
+	IntervalometerFree(ptr, 0);
+	return 1;
 }
 
 #undef NORET
@@ -28,18 +28,109 @@ enum ThreadType {
 	TT_FILE = 4
 };
 
+/*
+Route of an order id, owned by manage and shared read only by all jobs.
+jobQueue: queues of all jobs when the order runs on every job (broadcast, see plg_JobSetBroadcast)
+or on the least loaded one (readOnly, see plg_JobSetReadOnly), eQueue is then the first of them and pJobHandle is 0
+*/
+typedef struct _OrderRoute {
+	void* eQueue;
+	char* order;
+	void* pJobHandle;
+	void* pCoalesce;
+	void** jobQueue;
+	unsigned int jobQueueSize;
+	unsigned char broadcast;
+	unsigned char readOnly;
+} *POrderRoute, OrderRoute;
+
+/*
+Order group moved by plg_MngMigrateOrder, passed from manage to the source job and then to the target job.
+order, table and noShare are filled by manage, process and cache by the source job.
+barrier is the number of "migratemark" the source job waits for before it hands over.
+*/
+typedef struct _JobMigrate {
+	void* pManage;
+	void* pSourceJob;
+	void* pTargetJob;
+	unsigned int orderLength;
+	unsigned int* orderId;
+	char** order;
+	void** process;
+	unsigned int tableLength;
+	char** table;
+	unsigned char* noShare;
+	void** cache;
+	unsigned int jobLength;
+	void** job;
+	unsigned int barrier;
+} *PJobMigrate, JobMigrate;
+
+/*
+Measured load of the orders, summed over all jobs by "loadreport" for plg_MngPlanJob.
+count, time and call are indexed by order id, call by caller id * orderSize + callee id.
+time is the nanoseconds spent in the process of the order.
+touch: order name to the names of the tables the order really used.
+*/
+typedef struct _JobLoad {
+	void* pEvent;
+	unsigned int orderSize;
+	unsigned long long* count;
+	unsigned long long* time;
+	unsigned long long* call;
+	void* touch;
+} *PJobLoad, JobLoad;
+
+/*
+Metrics of all jobs, "metricsreport" passes it from job to job and each job adds its own.
+exec, wait and rollback are indexed by order id, orderJob is the index + 1 of the last job running the order.
+commit, jobCount, jobRollback and jobElapsed are indexed by the job, jobElapsed is nanoseconds since the job started.
+The last job sends pEvent when a caller waits for it, else "metricswrite" to the queue of manage.
+*/
+typedef struct _JobMetric {
+	void* pEvent;
+	void* pManage;
+	unsigned int generation;
+	unsigned int orderSize;
+	unsigned int jobLength;
+	unsigned int jobIndex;
+	void** job;
+	void** exec;
+	void** wait;
+	unsigned long long* rollback;
+	unsigned int* orderJob;
+	void** commit;
+	unsigned long long* jobCount;
+	unsigned long long* jobRollback;
+	unsigned long long* jobElapsed;
+} *PJobMetric, JobMetric;
+
 void plg_JobProcessDestory(void* pEventPorcess);
+void plg_JobProcessToJson(void* pEventPorcess, void* jsonRoot);
 void* plg_JobCreateHandle(void* pManage, enum ThreadType threadType, char* luaPath, char* luaDllPath, char* dllPath);
 void plg_JobDestoryHandle(void* pJobHandle);
 unsigned char plg_JobFindTableName(void* pJobHandle, char* tableName);
-void plg_JobAddEventEqueue(void* pJobHandle, char* nevent, void* equeue);
-void plg_JobAddEventProcess(void* pJobHandle, char* nevent, void* process);
+unsigned char plg_JobIsBroadcast(void* pEventPorcess);
+unsigned char plg_JobIsReadOnly(void* pEventPorcess);
+void* plg_JobRouteQueue(POrderRoute pOrderRoute);
+void* plg_JobCoalesceCreate(void* pEventPorcess);
+void plg_JobCoalesceDestroy(void* pCoalesce);
+int plg_JobCoalescePut(void* pCoalesce, void* pOrderPacket);
+int plg_JobCoalesceTake(void* pCoalesce, void* pOrderPacket);
+void plg_JobSetOrderRoute(void* pJobHandle, void* pOrderRoute, unsigned int orderSize);
+void plg_JobAddOrderId(void* pJobHandle, char* nevent, unsigned int orderId);
+void plg_JobAddEventProcess(void* pJobHandle, char* nevent, unsigned int orderId, void* process);
+void plg_JobMigrateOut(void* pJobHandle, void* pJobMigrate);
+void plg_JobHoldOrder(void* pJobHandle, unsigned int orderId);
+unsigned long long plg_JobOrderCount(void* pJobHandle, unsigned int orderId);
 void* plg_JobNewTableCache(void* pJobHandle, char* table, void* pDiskHandle);
 void plg_JobAddTableCache(void* pJobHandle, char* table, void* pCacheHandle);
 void* plg_JobEqueueHandle(void* pJobHandle);
 unsigned int plg_JobAllWeight(void* pJobHandle);
 unsigned int  plg_JobIsEmpty(void* pJobHandle);
 void plg_JobSendOrder(void* eQueue, char* order, char* value, short valueLen);
+void plg_JobSendControl(void* eQueue, char* order, char* value, short valueLen);
+unsigned long long plg_JobAddAdmTimer(void* pJobHandle, unsigned int timer, char* order, char* value, short valueLen);
 void plg_JobAddAdmOrderProcess(void* pJobHandle, char* nevent, void* process);
 char plg_JobCheckIsType(enum ThreadType threadType);
 char plg_JobCheckUsingThread();
@@ -49,6 +140,7 @@ void plg_JobPrintDetails(void* pJobHandle);
 
 //Operating system interface
 void* job_Handle();
+int job_HoldEvent(void* pEventHandle, void* value);
 void plg_JobSExitThread(char value);
 void* job_ManageEqueue();
 void plg_JobSPrivate(void* pJobHandle, void* privateData);
@@ -56,5 +148,8 @@ void* plg_JobGetPrivate();
 
 void plg_JobTableMembersWithJson(void* table, unsigned short tableLen, void* jsonRoot);
 
+void plg_JobSetCore(void* pJobHandle, int core);
+void plg_JobSetQueueLimit(void* pJobHandle, unsigned int highWater, int policy);
+void plg_JobSetGroupCommit(void* pJobHandle, unsigned int commitCount, unsigned int commitTime);
 int plg_jobStartRouting(void* pvJobHandle);
 #endif
\ No newline at end of file
@@ -60,6 +60,32 @@ static int LRemoteCall(lua_State* L)
 	return 1;
 }
 
+static int LOrderId(lua_State* L)
+{
+	FillFun(instance, lua_pushnumber, 0);
+	FillFun(instance, luaL_checklstring, 0);
+
+	size_t oLen;
+	const char* o = pluaL_checklstring(L, 1, &oLen);
+
+	plua_pushnumber(L, (lua_Number)plg_JobOrderId((void*)o, oLen));
+	return 1;
+}
+
+static int LRemoteCallById(lua_State* L)
+{
+	FillFun(instance, lua_pushnumber, 0);
+	FillFun(instance, luaL_checkinteger, 0);
+	FillFun(instance, luaL_checklstring, 0);
+
+	size_t vLen;
+	lua_Integer o = pluaL_checkinteger(L, 1);
+	const char* v = pluaL_checklstring(L, 2, &vLen);
+
+	plua_pushnumber(L, (lua_Number)plg_JobRemoteCallById((unsigned int)o, (void*)v, vLen));
+	return 1;
+}
+
 static int LSet(lua_State* L)
 {
 	FillFun(instance, lua_pushnumber, 0);
@@ -1883,6 +1909,8 @@ static luaL_Reg mylibs[] = {
 	{ "MVersion", L_MVersion },
 
 	{ "RemoteCall", LRemoteCall },
+	{ "OrderId", LOrderId },
+	{ "RemoteCallById", LRemoteCallById },
 	{ "Set", LSet },
 	{ "MultiSet", LMultiSet },
 	{ "Del", LDel },
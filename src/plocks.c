@@ -20,27 +20,86 @@
 #include "plateform.h"
 #include <pthread.h>
 #include "psds.h"
-#include "padlist.h"
 #include "pelog.h"
+#include "ptimesys.h"
 #include "plocks.h"
 
+/*
+A thread holds at most LOCKS_DEPTH mutexes, ranks strictly increase from the bottom of the stack.
+*/
+#define LOCKS_DEPTH 16
+
+/*
+lockCount, waitCount, waitTime, maxWait, holdTime, maxHold: contention profile, written by
+the thread holding the mutex while the profile is on, times are nanoseconds
+lockStamp: nanosecond the profiled lock was taken, 0 when the lock was taken with the profile off
+name: lockName of the first profiled MutexLock
+prev, next: all mutexes, read by plg_LocksProfile
+*/
 typedef struct _SafeMutex
 {
 	unsigned int rank;
 	pthread_mutex_t lock;
+	unsigned long long lockCount;
+	unsigned long long waitCount;
+	unsigned long long waitTime;
+	unsigned long long maxWait;
+	unsigned long long holdTime;
+	unsigned long long maxHold;
+	unsigned long long lockStamp;
+	char name[LOCKS_NAMESIZE];
+	struct _SafeMutex* prev;
+	struct _SafeMutex* next;
 }*PSafeMutex, SafeMutex;
 
+typedef struct _LocksStack
+{
+	unsigned int depth;
+	PSafeMutex mutex[LOCKS_DEPTH];
+}*PLocksStack, LocksStack;
+
+#ifdef LOCKS_TLS
+static LOCKS_TLS LocksStack locks_stack;
+LOCKS_TLS void* locks_environmental;
+#else
 static pthread_key_t exclusionZone;
 static pthread_key_t environmental;
+#endif
+
+static volatile int locks_profile = 0;
+static pthread_mutex_t locks_registry = PTHREAD_MUTEX_INITIALIZER;
+static PSafeMutex locks_head = 0;
+
+//stats of destroyed mutexes stay in the profile
+static LockStat locks_retired[LOCKS_MAXSTAT];
+static unsigned int locks_retiredSize = 0;
 
 void plg_LocksCreate() {
+#ifndef LOCKS_TLS
 	pthread_key_create(&exclusionZone, NULL);
 	pthread_key_create(&environmental, NULL);
+#endif
 }
 
 void plg_LocksDestroy() {
+#ifndef LOCKS_TLS
 	pthread_key_delete(exclusionZone);
 	pthread_key_delete(environmental);
+#endif
+}
+
+static PLocksStack locks_GetStack() {
+#ifdef LOCKS_TLS
+	return &locks_stack;
+#else
+	PLocksStack pLocksStack = pthread_getspecific(exclusionZone);
+	if (pLocksStack == 0) {
+		pLocksStack = malloc(sizeof(LocksStack));
+		pLocksStack->depth = 0;
+		pthread_setspecific(exclusionZone, pLocksStack);
+	}
+	return pLocksStack;
+#endif
 }
 
 char plg_LocksEntry(void* pvSafeMutex) {
@@ -48,30 +107,18 @@ char plg_LocksEntry(void* pvSafeMutex) {
 	PSafeMutex pSafeMutex = pvSafeMutex;
 	//Currently internal thread needs to check lock status
 	if (plg_LocksGetSpecific() != 0) {
-		list* ptr = pthread_getspecific(exclusionZone);
-
-		//Current non lock state enters lock state creation
-		if (ptr == 0) {
-			ptr = plg_listCreate(LIST_MIDDLE);
-			plg_listAddNodeHead(ptr, pSafeMutex);
-			pthread_setspecific(exclusionZone, ptr);
-			return 1;
-		} else {
-			listNode *node = listFirst(ptr);
-			if (node != 0) {
-				PSafeMutex pHeadMutex = listNodeValue(node);
-
-				//Access is allowed only when the permission is high
-				if (pSafeMutex->rank <= pHeadMutex->rank) {
-					return 0;
-				}
-			}
-			plg_listAddNodeHead(ptr, pSafeMutex);
-			return 1;
+		PLocksStack pLocksStack = locks_GetStack();
+
+		//Access is allowed only when the permission is high
+		if (pLocksStack->depth && pSafeMutex->rank <= pLocksStack->mutex[pLocksStack->depth - 1]->rank) {
+			return 0;
+		} else if (pLocksStack->depth == LOCKS_DEPTH) {
+			elog(log_error, "plg_LocksEntry.more than %d locks held", LOCKS_DEPTH);
+			return 0;
 		}
-	} else {
-		return 1;
+		pLocksStack->mutex[pLocksStack->depth++] = pSafeMutex;
 	}
+	return 1;
 }
 
 char plg_LocksLeave(void* pvSafeMutex) {
@@ -79,65 +126,200 @@ char plg_LocksLeave(void* pvSafeMutex) {
 	PSafeMutex pSafeMutex = pvSafeMutex;
 	//Currently internal thread needs to check lock status
 	if (plg_LocksGetSpecific() != 0) {
-		list* ptr = pthread_getspecific(exclusionZone);
-		
+		PLocksStack pLocksStack = locks_GetStack();
+
 		//Repeated release will result in a critical error
-		if (ptr != 0) {
-			listNode *node = listFirst(ptr);
-			if (node != 0) {
-
-				PSafeMutex pHeadMutex = listNodeValue(node);
-				//Lock not released in pairs, serious error reported
-				if (pHeadMutex != pSafeMutex) {
-					elog(log_error, "plg_LocksLeave.lock lose");
-					return 0;
-				}
-			}
-			plg_listDelNode(ptr, node);
-			return 1;
-
-		} else {
+		if (pLocksStack->depth == 0) {
 			return 0;
 		}
-	} else {
-		return 1;
+
+		//Lock not released in pairs, serious error reported
+		if (pLocksStack->mutex[pLocksStack->depth - 1] != pSafeMutex) {
+			elog(log_error, "plg_LocksLeave.lock lose");
+			return 0;
+		}
+		pLocksStack->depth--;
 	}
+	return 1;
 }
 
 void plg_LocksSetSpecific(void* ptr) {
+#ifdef LOCKS_TLS
+	locks_environmental = ptr;
+#else
 	pthread_setspecific(environmental, ptr);
+#endif
 }
 
+#ifndef LOCKS_TLS
 void* plg_LocksGetSpecific() {
 	return pthread_getspecific(environmental);
 }
+#endif
 
 void* plg_MutexCreateHandle(unsigned int rank) {
-	PSafeMutex pSafeMutex = malloc(sizeof(SafeMutex));
+	PSafeMutex pSafeMutex = calloc(1, sizeof(SafeMutex));
 	pSafeMutex->rank = rank;
 	pthread_mutex_init(&pSafeMutex->lock, 0);
+
+	pthread_mutex_lock(&locks_registry);
+	pSafeMutex->next = locks_head;
+	if (locks_head) {
+		locks_head->prev = pSafeMutex;
+	}
+	locks_head = pSafeMutex;
+	pthread_mutex_unlock(&locks_registry);
 	return pSafeMutex;
 }
 
 void plg_MutexThreadDestroy() {
-	list* ptr = pthread_getspecific(exclusionZone);
-	if (ptr != 0) {
-		plg_listRelease(ptr);
+#ifndef LOCKS_TLS
+	PLocksStack pLocksStack = pthread_getspecific(exclusionZone);
+	if (pLocksStack != 0) {
+		free(pLocksStack);
 		pthread_setspecific(exclusionZone, 0);
 	}
+#endif
+}
+
+/*
+Adds the profile of the mutex to the stat of its name, a new name takes the next free stat.
+*/
+static unsigned int locks_AddStat(PLockStat pLockStat, unsigned int size, unsigned int max, PSafeMutex pSafeMutex) {
+
+	if (!pSafeMutex->lockCount) {
+		return size;
+	}
+
+	unsigned int l = 0;
+	for (; l < size; l++) {
+		if (strcmp(pLockStat[l].name, pSafeMutex->name) == 0) {
+			break;
+		}
+	}
+
+	if (l == size) {
+		if (size == max) {
+			return size;
+		}
+		memset(&pLockStat[l], 0, sizeof(LockStat));
+		strcpy(pLockStat[l].name, pSafeMutex->name);
+		size++;
+	}
+
+	pLockStat[l].count += pSafeMutex->lockCount;
+	pLockStat[l].contended += pSafeMutex->waitCount;
+	pLockStat[l].waitTime += pSafeMutex->waitTime;
+	pLockStat[l].holdTime += pSafeMutex->holdTime;
+	if (pSafeMutex->maxWait > pLockStat[l].maxWait) {
+		pLockStat[l].maxWait = pSafeMutex->maxWait;
+	}
+	if (pSafeMutex->maxHold > pLockStat[l].maxHold) {
+		pLockStat[l].maxHold = pSafeMutex->maxHold;
+	}
+	return size;
 }
+
 void plg_MutexDestroyHandle(void* pvSafeMutex) {
 	PSafeMutex pSafeMutex = pvSafeMutex;
+
+	pthread_mutex_lock(&locks_registry);
+	locks_retiredSize = locks_AddStat(locks_retired, locks_retiredSize, LOCKS_MAXSTAT, pSafeMutex);
+	if (pSafeMutex->prev) {
+		pSafeMutex->prev->next = pSafeMutex->next;
+	} else {
+		locks_head = pSafeMutex->next;
+	}
+	if (pSafeMutex->next) {
+		pSafeMutex->next->prev = pSafeMutex->prev;
+	}
+	pthread_mutex_unlock(&locks_registry);
+
 	pthread_mutex_destroy(&pSafeMutex->lock);
 	free(pSafeMutex);
 }
 
-int plg_MutexLock(void* pvSafeMutex) {
+/*
+With the profile on, an uncontended lock costs a trylock and a clock read,
+a contended one is timed from the failed trylock until the lock is taken.
+*/
+int plg_MutexLock(void* pvSafeMutex, char* name) {
 	PSafeMutex pSafeMutex = pvSafeMutex;
-	return pthread_mutex_lock(&pSafeMutex->lock);
+	if (!locks_profile) {
+		return pthread_mutex_lock(&pSafeMutex->lock);
+	}
+
+	unsigned long long wait = 0;
+	int r = pthread_mutex_trylock(&pSafeMutex->lock);
+	if (r != 0) {
+		unsigned long long startTime = plg_GetCurrentNano();
+		r = pthread_mutex_lock(&pSafeMutex->lock);
+		wait = plg_GetCurrentNano() - startTime;
+	}
+
+	if (!pSafeMutex->lockCount && name) {
+		strncpy(pSafeMutex->name, name, LOCKS_NAMESIZE - 1);
+	}
+	pSafeMutex->lockCount++;
+	if (wait) {
+		pSafeMutex->waitCount++;
+		pSafeMutex->waitTime += wait;
+		if (wait > pSafeMutex->maxWait) {
+			pSafeMutex->maxWait = wait;
+		}
+	}
+	pSafeMutex->lockStamp = plg_GetCurrentNano();
+	return r;
 }
 
 int plg_MutexUnlock(void* pvSafeMutex) {
 	PSafeMutex pSafeMutex = pvSafeMutex;
+	if (pSafeMutex->lockStamp) {
+		unsigned long long hold = plg_GetCurrentNano() - pSafeMutex->lockStamp;
+		pSafeMutex->lockStamp = 0;
+		pSafeMutex->holdTime += hold;
+		if (hold > pSafeMutex->maxHold) {
+			pSafeMutex->maxHold = hold;
+		}
+	}
 	return pthread_mutex_unlock(&pSafeMutex->lock);
-}
\ No newline at end of file
+}
+
+/*
+Turns the contention profile of all mutexes on or off, turning it on starts from zero.
+*/
+void plg_LocksSetProfile(unsigned char profile) {
+
+	pthread_mutex_lock(&locks_registry);
+	if (profile && !locks_profile) {
+		locks_retiredSize = 0;
+		for (PSafeMutex pSafeMutex = locks_head; pSafeMutex; pSafeMutex = pSafeMutex->next) {
+			pSafeMutex->lockCount = pSafeMutex->waitCount = pSafeMutex->waitTime = pSafeMutex->maxWait = 0;
+			pSafeMutex->holdTime = pSafeMutex->maxHold = 0;
+		}
+	}
+	locks_profile = profile;
+	pthread_mutex_unlock(&locks_registry);
+}
+
+unsigned char plg_LocksIsProfile() {
+	return locks_profile != 0;
+}
+
+/*
+Fills at most max stats, one per lockName, returns how many were filled.
+The counters of a mutex in use are read while its holder may update them, the profile is a sample.
+*/
+unsigned int plg_LocksProfile(PLockStat pLockStat, unsigned int max) {
+
+	pthread_mutex_lock(&locks_registry);
+	unsigned int size = 0;
+	for (unsigned int l = 0; l < locks_retiredSize && size < max; l++) {
+		pLockStat[size++] = locks_retired[l];
+	}
+	for (PSafeMutex pSafeMutex = locks_head; pSafeMutex; pSafeMutex = pSafeMutex->next) {
+		size = locks_AddStat(pLockStat, size, max, pSafeMutex);
+	}
+	pthread_mutex_unlock(&locks_registry);
+	return size;
+}
@@ -24,6 +24,20 @@
 
 #define Log_Switch 1
 
+//contention of all mutexes sharing a lockName, times are nanoseconds, see plg_LocksProfile
+#define LOCKS_MAXSTAT 32
+#define LOCKS_NAMESIZE 16
+typedef struct _LockStat
+{
+	char name[LOCKS_NAMESIZE];
+	unsigned long long count;
+	unsigned long long contended;
+	unsigned long long waitTime;
+	unsigned long long maxWait;
+	unsigned long long holdTime;
+	unsigned long long maxHold;
+}*PLockStat, LockStat;
+
 void plg_LocksCreate();
 void plg_LocksDestroy();
 char plg_LocksEntry(void* pSafeMutex);
@@ -31,16 +45,26 @@ char plg_LocksLeave(void* pSafeMutex);
 
 void* plg_MutexCreateHandle(unsigned int rank);
 void plg_MutexDestroyHandle(void* pSafeMutex);
-int plg_MutexLock(void* pSafeMutex);
+int plg_MutexLock(void* pSafeMutex, char* name);
 int plg_MutexUnlock(void* pSafeMutex);
 void plg_MutexThreadDestroy();
+void plg_LocksSetProfile(unsigned char profile);
+unsigned char plg_LocksIsProfile();
+unsigned int plg_LocksProfile(PLockStat pLockStat, unsigned int max);
 
+/*
+Release builds (NDEBUG) skip the rank check unless PLG_LOCKCHECK is defined.
+*/
+#if defined(NDEBUG) && !defined(PLG_LOCKCHECK)
+#define MutexLock(lockObj, lockName) plg_MutexLock(lockObj, lockName)
+#define MutexUnlock(lockObj, lockName) plg_MutexUnlock(lockObj)
+#else
 #define MutexLock(lockObj, lockName) do {\
 if(0==plg_LocksEntry(lockObj)){\
 		assert(0);sds x = plg_sdsCatPrintf(plg_sdsEmpty(),"entry mutex %p %s!", lockObj, lockName);\
 		elog(log_error, x);\
 		plg_sdsFree(x);}else {\
-plg_MutexLock(lockObj);}\
+plg_MutexLock(lockObj, lockName);}\
 } while (0)
 
 #define MutexUnlock(lockObj, lockName) do {\
@@ -50,7 +74,23 @@ if(0==plg_LocksLeave(lockObj)){\
 		plg_sdsFree(x);}else{\
 plg_MutexUnlock(lockObj);}\
 } while (0)
+#endif
+
+/*
+On linux the job context and the lock-rank stack of the thread are compiler TLS,
+plg_LocksGetSpecific is then a load instead of a call to pthread_getspecific.
+*/
+#if !defined(_WIN32) && (defined(__GNUC__) || defined(__clang__))
+#define LOCKS_TLS __thread
+#endif
 
 void plg_LocksSetSpecific(void* ptr);
+#ifdef LOCKS_TLS
+extern LOCKS_TLS void* locks_environmental;
+static inline void* plg_LocksGetSpecific() {
+	return locks_environmental;
+}
+#else
 void* plg_LocksGetSpecific();
+#endif
 #endif
\ No newline at end of file
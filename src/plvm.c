@@ -108,7 +108,7 @@ void plg_LvmDestory(void* pvlVMHandle) {
 	free(plVMHandle);
 }
 
-int plg_LvmCallFile(void* pvlVMHandle, char* file, char* fun, void* value, short len) {
+int plg_LvmCallFile(void* pvlVMHandle, char* file, char* fun, void* value, size_t len) {
 
 	PlVMHandle plVMHandle = pvlVMHandle;
 	FillFun(plVMHandle->hInstance, lua_getfield, 0);
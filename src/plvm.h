@@ -24,7 +24,7 @@
 
 void* plg_LvmLoad(const char *path);
 void plg_LvmDestory(void* plVMHandle);
-int plg_LvmCallFile(void* plVMHandle, char* file, char* fun, void* value, short len);
+int plg_LvmCallFile(void* plVMHandle, char* file, char* fun, void* value, size_t len);
 void* plg_LvmCheckSym(void *lib, const char *sym);
 void* plg_LvmGetInstance(void* plVMHandle);
 void* plg_LvmGetL(void* plVMHandle);
@@ -38,6 +38,11 @@
 #include "pjob.h"
 #include "pbase64.h"
 #include "pstart.h"
+#include "ppacket.h"
+#include "pfuture.h"
+#include "patomic.h"
+#include "phistogram.h"
+#include "pcache.h"
 
 #define NORET
 #define CheckUsingThread(r) if (plg_MngCheckUsingThread()) {elog(log_error, "Cannot run management interface in non user environment");return r;}
@@ -85,7 +90,7 @@ typedef struct _Manage
 	dict* dictTableName;
 
 	dict* order_process;
-	dict* order_equeue;
+	dict* order_id;
 	PDictSet order_tableName;
 	dict* tableName_diskHandle;
 	sds	dbPath;
@@ -100,8 +105,55 @@ typedef struct _Manage
 	sds luaDllPath;
 	sds luaPath;
 	sds dllPath;
+
+	//packets and futures of user threads, protected by mutexHandle
+	void* packetPool;
+	void* futurePool;
+
+	//order ids are given by plg_MngAddOrder, the route table is built by plg_MngInterAllocJob
+	unsigned int orderCount;
+	POrderRoute orderRoute;
+	unsigned int orderRouteSize;
+
+	//live migration, tableName_jobHandle is the job owning the cache of each table
+	dict* tableName_jobHandle;
+	unsigned long long* orderLoad;
+	char migrating;
+
+	//plan of plg_MngPlanJob or the json config, order_job is the order name to its job index + 1
+	dict* order_job;
+	unsigned int planCore;
+	unsigned long long* planCount;
+	unsigned long long* planTime;
+	PDictSet planTouch;
+
+	//cpu of each job and file thread by index, -1 when not pinned
+	int* jobCore;
+	unsigned int jobCoreSize;
+	int* fileCore;
+	unsigned int fileCoreSize;
+
+	//group commit of every job, see plg_MngSetGroupCommit
+	unsigned int commitCount;
+	unsigned int commitTime;
+
+	//high water of every job queue, see plg_MngSetQueueLimit
+	unsigned int queueHighWater;
+	int queuePolicy;
+
+	//periodic metrics file, see plg_MngSetMetricsDump, metricsGen drops the timers of an old setting
+	sds metricsPath;
+	unsigned int metricsInterval;
+	unsigned int metricsGen;
 } *PManage, Manage;
 
+//value of "metricsdump"
+typedef struct _ManageMetricDump
+{
+	void* pManage;
+	unsigned int generation;
+} *PManageMetricDump, ManageMetricDump;
+
 static void listSdsFree(void *ptr) {
 	plg_sdsFree(ptr);
 }
@@ -329,6 +381,17 @@ static void manage_CreateDisk(void* pvManage) {
 	plg_dictReleaseIterator(tableNameIter);
 }
 
+static void manage_FreeOrderRoute(PManage pManage) {
+
+	for (unsigned int l = 0; l < pManage->orderRouteSize; l++) {
+		plg_JobCoalesceDestroy(pManage->orderRoute[l].pCoalesce);
+		free(pManage->orderRoute[l].jobQueue);
+	}
+	free(pManage->orderRoute);
+	pManage->orderRoute = 0;
+	pManage->orderRouteSize = 0;
+}
+
 int plg_MngFreeJob(void* pvManage) {
 
 	PManage pManage = pvManage;
@@ -341,25 +404,114 @@ int plg_MngFreeJob(void* pvManage) {
 
 	//listjob
 	plg_listEmpty(pManage->listJob);
-	plg_dictEmpty(pManage->order_equeue, NULL);
 	plg_DictSetEmpty(pManage->order_tableName);
+	manage_FreeOrderRoute(pManage);
+	free(pManage->orderLoad);
+	pManage->orderLoad = 0;
+	plg_dictEmpty(pManage->tableName_jobHandle, NULL);
 
 	return 1;
 }
 
-static void manage_AddEqueueToJob(void* pvManage, sds order, void* equeue) {
+static unsigned int manage_OrderId(PManage pManage, sds order) {
+
+	dictEntry* entry = plg_dictFind(pManage->order_id, order);
+	if (entry) {
+		return (unsigned int)(size_t)dictGetVal(entry);
+	}
+	return 0;
+}
+
+/*
+The route table is indexed by order id and shared by all jobs.
+*/
+static void manage_CreateOrderRoute(PManage pManage) {
+
+	manage_FreeOrderRoute(pManage);
+	free(pManage->orderLoad);
+	pManage->orderRouteSize = pManage->orderCount + 1;
+	pManage->orderRoute = calloc(pManage->orderRouteSize, sizeof(OrderRoute));
+	pManage->orderLoad = calloc(pManage->orderRouteSize, sizeof(unsigned long long));
+	plg_dictEmpty(pManage->tableName_jobHandle, NULL);
+
+	dictIterator* orderIter = plg_dictGetSafeIterator(pManage->order_id);
+	dictEntry* orderNode;
+	while ((orderNode = plg_dictNext(orderIter)) != NULL) {
+		POrderRoute pOrderRoute = &pManage->orderRoute[(size_t)dictGetVal(orderNode)];
+		pOrderRoute->order = dictGetKey(orderNode);
+		dictEntry* entry = plg_dictFind(pManage->order_process, pOrderRoute->order);
+		if (entry) {
+			pOrderRoute->pCoalesce = plg_JobCoalesceCreate(dictGetVal(entry));
+		}
+	}
+	plg_dictReleaseIterator(orderIter);
+
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		plg_JobSetOrderRoute(listNodeValue(jobNode), pManage->orderRoute, pManage->orderRouteSize);
+	}
+	plg_listReleaseIterator(jobIter);
+}
+
+static void manage_AddEqueueToJob(void* pvManage, sds order, void* pJobHandle) {
 
 	//Manage external function usage
 	PManage pManage = pvManage;
-	plg_dictAdd(pManage->order_equeue, order, equeue);
+	unsigned int orderId = manage_OrderId(pManage, order);
+	pManage->orderRoute[orderId].eQueue = plg_JobEqueueHandle(pJobHandle);
+	pManage->orderRoute[orderId].pJobHandle = pJobHandle;
 
 	//listjob
 	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
 	listNode* jobNode;
 	while ((jobNode = plg_listNext(jobIter)) != NULL) {
-		plg_JobAddEventEqueue(listNodeValue(jobNode), order, equeue);
+		plg_JobAddOrderId(listNodeValue(jobNode), order, orderId);
+	}
+	plg_listReleaseIterator(jobIter);
+}
+
+/*
+The process is on every job and the route keeps the queues of all of them, for broadcast and read only orders.
+*/
+static POrderRoute manage_AddEveryJob(PManage pManage, sds order, void* process) {
+
+	unsigned int orderId = manage_OrderId(pManage, order);
+	POrderRoute pOrderRoute = &pManage->orderRoute[orderId];
+	pOrderRoute->jobQueue = malloc(listLength(pManage->listJob) * sizeof(void*));
+	pOrderRoute->jobQueueSize = 0;
+
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		plg_JobAddEventProcess(listNodeValue(jobNode), order, orderId, process);
+		plg_JobAddOrderId(listNodeValue(jobNode), order, orderId);
+		pOrderRoute->jobQueue[pOrderRoute->jobQueueSize++] = plg_JobEqueueHandle(listNodeValue(jobNode));
 	}
 	plg_listReleaseIterator(jobIter);
+
+	pOrderRoute->eQueue = pOrderRoute->jobQueueSize ? pOrderRoute->jobQueue[0] : 0;
+	pOrderRoute->pJobHandle = 0;
+	return pOrderRoute;
+}
+
+/*
+A read only order reads other jobs' caches, which only shared tables have.
+*/
+static char manage_IsShareTable(PManage pManage, dict* table) {
+
+	char share = 1;
+	dictIterator* tableIter = plg_dictGetSafeIterator(table);
+	dictEntry* tableNode;
+	while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+		dictEntry* tableEntry = plg_dictFind(pManage->dictTableName, dictGetKey(tableNode));
+		if (tableEntry && ((PTableName)dictGetVal(tableEntry))->noShare) {
+			share = 0;
+			break;
+		}
+	}
+	plg_dictReleaseIterator(tableIter);
+	return share;
 }
 
 /*
@@ -377,6 +529,9 @@ static void manage_AddTableToJob(void* pvManage, void* pJobHandle, dict * table)
 		}
 
 		void* pCacheHandle = plg_JobNewTableCache(pJobHandle, dictGetKey(diskEntry), dictGetVal(diskEntry));
+		if (plg_JobFindTableName(pJobHandle, dictGetKey(diskEntry)) && plg_dictFind(pManage->tableName_jobHandle, dictGetKey(diskEntry)) == 0) {
+			plg_dictAdd(pManage->tableName_jobHandle, dictGetKey(diskEntry), pJobHandle);
+		}
 		dictEntry * tableEntry = plg_dictFind(pManage->dictTableName, dictGetKey(diskEntry));
 		if (tableEntry == 0) {
 			continue;
@@ -426,6 +581,7 @@ int plg_MngInterAllocJob(void* pvManage, unsigned int core, char* fileName) {
 	for (unsigned int l = 0; l < core; l++) {
 		plg_listAddNodeHead(pManage->listJob, plg_JobCreateHandle(plg_JobEqueueHandle(pManage->pJobHandle), TT_PROCESS, pManage->luaPath, pManage->luaDllPath, pManage->dllPath));
 	}
+	manage_CreateOrderRoute(pManage);
 
 	//listOrder
 	listIter* eventIter = plg_listGetIterator(pManage->listOrder, AL_START_HEAD);
@@ -438,6 +594,32 @@ int plg_MngInterAllocJob(void* pvManage, unsigned int core, char* fileName) {
 			continue;
 		}
 
+		if (plg_JobIsBroadcast(dictGetVal(EventProcessEntry))) {
+			if (plg_DictSetValue(pManage->order_tableName, listNodeValue(eventNode))) {
+				elog(log_warn, "plg_MngInterAllocJob.Broadcast order:%s has no tables, its tables are ignored", listNodeValue(eventNode));
+			}
+			manage_AddEveryJob(pManage, dictGetKey(EventProcessEntry), dictGetVal(EventProcessEntry))->broadcast = 1;
+			continue;
+		}
+
+		if (plg_JobIsReadOnly(dictGetVal(EventProcessEntry))) {
+			dict* table = plg_DictSetValue(pManage->order_tableName, listNodeValue(eventNode));
+			if (!table || manage_IsShareTable(pManage, table)) {
+				continue;
+			}
+			elog(log_warn, "plg_MngInterAllocJob.Read only order:%s has a table that is not shared, it runs on one job", listNodeValue(eventNode));
+		}
+
+		//planned job
+		void* planJob = 0;
+		dictEntry * planEntry = plg_dictFind(pManage->order_job, listNodeValue(eventNode));
+		if (planEntry) {
+			listNode* planNode = plg_listIndex(pManage->listJob, (unsigned int)(size_t)dictGetVal(planEntry) - 1);
+			if (planNode) {
+				planJob = listNodeValue(planNode);
+			}
+		}
+
 		//List job intersection classification
 		char nextContinue = 0;
 		listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
@@ -455,14 +637,18 @@ int plg_MngInterAllocJob(void* pvManage, unsigned int core, char* fileName) {
 
 				if (plg_JobFindTableName(listNodeValue(jobNode), dictGetKey(tableNode))) {
 
+					if (planJob && planJob != listNodeValue(jobNode)) {
+						elog(log_warn, "plg_MngInterAllocJob.Order:%s shares table %s with another job, plan ignored", listNodeValue(eventNode), dictGetKey(tableNode));
+					}
+
 					//table
 					manage_AddTableToJob(pManage, listNodeValue(jobNode), table);
 
 					//process
-					plg_JobAddEventProcess(listNodeValue(jobNode), dictGetKey(EventProcessEntry), dictGetVal(EventProcessEntry));
+					plg_JobAddEventProcess(listNodeValue(jobNode), dictGetKey(EventProcessEntry), manage_OrderId(pManage, dictGetKey(EventProcessEntry)), dictGetVal(EventProcessEntry));
 
 					//equeue
-					manage_AddEqueueToJob(pManage, listNodeValue(eventNode), plg_JobEqueueHandle(listNodeValue(jobNode)));
+					manage_AddEqueueToJob(pManage, listNodeValue(eventNode), listNodeValue(jobNode));
 					nextContinue = 1;
 					break;
 				}
@@ -493,6 +679,11 @@ int plg_MngInterAllocJob(void* pvManage, unsigned int core, char* fileName) {
 			}
 			plg_listReleaseIterator(jobIter);
 
+			//measured plan
+			if (planJob) {
+				minJob = planJob;
+			}
+
 			//table
 			dict * table = plg_DictSetValue(pManage->order_tableName, listNodeValue(eventNode));
 			if (table) {
@@ -500,13 +691,46 @@ int plg_MngInterAllocJob(void* pvManage, unsigned int core, char* fileName) {
 			}
 
 			//process
-			plg_JobAddEventProcess(minJob, dictGetKey(EventProcessEntry), dictGetVal(EventProcessEntry));
+			plg_JobAddEventProcess(minJob, dictGetKey(EventProcessEntry), manage_OrderId(pManage, dictGetKey(EventProcessEntry)), dictGetVal(EventProcessEntry));
 
 			//equeue
-			manage_AddEqueueToJob(pManage, listNodeValue(eventNode), plg_JobEqueueHandle(minJob));
+			manage_AddEqueueToJob(pManage, listNodeValue(eventNode), minJob);
 		} while (0);
 	}
 	plg_listReleaseIterator(eventIter);
+
+	//read only orders go after the others so their tables are already owned by the jobs writing them
+	eventIter = plg_listGetIterator(pManage->listOrder, AL_START_HEAD);
+	while ((eventNode = plg_listNext(eventIter)) != NULL) {
+
+		dictEntry * EventProcessEntry = plg_dictFind(pManage->order_process, listNodeValue(eventNode));
+		if (EventProcessEntry == 0 || plg_JobIsBroadcast(dictGetVal(EventProcessEntry)) || !plg_JobIsReadOnly(dictGetVal(EventProcessEntry))) {
+			continue;
+		}
+
+		dict* table = plg_DictSetValue(pManage->order_tableName, listNodeValue(eventNode));
+		if (table && !manage_IsShareTable(pManage, table)) {
+			continue;
+		}
+
+		//a table nobody writes still needs a cache, it goes to the lightest job
+		if (table) {
+			void* minJob = 0;
+			unsigned int Weight = UINT_MAX;
+			listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+			listNode* jobNode;
+			while ((jobNode = plg_listNext(jobIter)) != NULL) {
+				if (plg_JobAllWeight(listNodeValue(jobNode)) < Weight) {
+					Weight = plg_JobAllWeight(listNodeValue(jobNode));
+					minJob = listNodeValue(jobNode);
+				}
+			}
+			plg_listReleaseIterator(jobIter);
+			manage_AddTableToJob(pManage, minJob, table);
+		}
+		manage_AddEveryJob(pManage, dictGetKey(EventProcessEntry), dictGetVal(EventProcessEntry))->readOnly = 1;
+	}
+	plg_listReleaseIterator(eventIter);
 	return 1;
 }
 
@@ -529,6 +753,7 @@ int plg_MngAddOrder(void* pvManage, char* nameOrder, short nameOrderLen, void* p
 		plg_listAddNodeHead(pManage->listOrder, sdsnameOrder);
 		plg_listAddNodeHead(pManage->listProcess, ptrProcess);
 		plg_dictAdd(pManage->order_process, sdsnameOrder, ptrProcess);
+		plg_dictAdd(pManage->order_id, sdsnameOrder, (void*)(size_t)(++pManage->orderCount));
 		return 1;
 	} else {
 		plg_sdsFree(sdsnameOrder);
@@ -658,23 +883,31 @@ int plg_MngStarJob(void* pvManage) {
 	}
 
 	//file job before workjob start
+	unsigned int index = 0;
 	listIter* diskIter = plg_listGetIterator(pManage->listDisk, AL_START_HEAD);
 	listNode* diskNode;
 	while ((diskNode = plg_listNext(diskIter)) != NULL) {
 		void* fileHandle = plg_DiskFileHandle(listNodeValue(diskNode));
 		if (fileHandle) {
+			plg_JobSetCore(plg_FileJobHandle(fileHandle), index < pManage->fileCoreSize ? pManage->fileCore[index] : -1);
 			if (plg_jobStartRouting(plg_FileJobHandle(fileHandle)) != 0)
 				elog(log_error, "can't create thread");
 		}
+		index++;
 	}
 	plg_listReleaseIterator(diskIter);
 
 	//listJob
+	index = 0;
 	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
 	listNode* jobNode;
 	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		plg_JobSetCore(listNodeValue(jobNode), index < pManage->jobCoreSize ? pManage->jobCore[index] : -1);
+		plg_JobSetGroupCommit(listNodeValue(jobNode), pManage->commitCount, pManage->commitTime);
+		plg_JobSetQueueLimit(listNodeValue(jobNode), pManage->queueHighWater, pManage->queuePolicy);
 		if (plg_jobStartRouting(listNodeValue(jobNode)) != 0)
 			elog(log_error, "can't create thread");
+		index++;
 	}
 	plg_listReleaseIterator(jobIter);
 
@@ -686,6 +919,10 @@ int plg_MngStarJob(void* pvManage) {
 	pManage->jobDestroyCount = 0;
 	pManage->fileDestroyCount = 0;
 
+	if (pManage->metricsInterval) {
+		ManageMetricDump manageMetricDump = { pManage, pManage->metricsGen };
+		plg_JobSendControl(plg_JobEqueueHandle(pManage->pJobHandle), "metricsdump", (char*)&manageMetricDump, sizeof(ManageMetricDump));
+	}
 	return 1;
 }
 
@@ -723,13 +960,96 @@ void plg_MngStopJob(void* pvManage) {
 	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
 	listNode* jobNode;
 	while ((jobNode = plg_listNext(jobIter)) != NULL) {
-		plg_JobSendOrder(plg_JobEqueueHandle(listNodeValue(jobNode)), "destroyjob", 0, 0);
+		plg_JobSendControl(plg_JobEqueueHandle(listNodeValue(jobNode)), "destroyjob", 0, 0);
 	}
 	plg_listReleaseIterator(jobIter);
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	pManage->metricsGen += 1;
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
 	pManage->runStatus = 0;
 }
 
 
+/*
+Returns 1 when the packet was merged into a pending packet of its order, see plg_JobSetCoalesce.
+*/
+static int manage_CoalescePut(PManage pManage, POrderPacket pOrderPacket) {
+
+	unsigned int orderId = pOrderPacket->orderId;
+	if (!orderId || orderId >= pManage->orderRouteSize || !pManage->orderRoute[orderId].eQueue) {
+		return 0;
+	}
+	return plg_JobCoalescePut(pManage->orderRoute[orderId].pCoalesce, pOrderPacket);
+}
+
+static int manage_PushBroadcast(PManage pManage, POrderRoute pOrderRoute, POrderPacket pOrderPacket) {
+
+	if (pOrderPacket->pFuture) {
+		elog(log_error, "manage_PushBroadcast.Broadcast order:%s can not be called with a future", pOrderPacket->order);
+		plg_PacketFree(pOrderPacket);
+		return 0;
+	}
+
+	//every queue holds a reference before the first push, a refused queue drops its own
+	int r = 1;
+	pOrderPacket->flags |= PACKET_BROADCAST;
+	pOrderPacket->ref = pOrderRoute->jobQueueSize;
+	for (unsigned int l = 0; l < pOrderRoute->jobQueueSize; l++) {
+		int ret;
+		while ((ret = plg_eqPushLimit(pOrderRoute->jobQueue[l], pOrderPacket)) == EQ_FULL) {
+			MutexUnlock(pManage->mutexHandle, pManage->objName);
+			plg_eqWaitSpace(pOrderRoute->jobQueue[l]);
+			MutexLock(pManage->mutexHandle, pManage->objName);
+		}
+		if (ret == EQ_REFUSE) {
+			plg_PacketFree(pOrderPacket);
+			r = REMOTECALL_BUSY;
+		}
+	}
+	return r;
+}
+
+/*
+Called with the mutex held, which is released while the queue of a QP_BLOCK job is full.
+The route is read again after the wait because the order may have migrated meanwhile.
+Returns 1 when pushed, 0 when the order has no job and REMOTECALL_BUSY when the job refused it.
+The packet must have gone through manage_CoalescePut.
+*/
+static int manage_PushPacket(PManage pManage, POrderPacket pOrderPacket) {
+
+	unsigned int broadcastId = pOrderPacket->orderId;
+	if (broadcastId && broadcastId < pManage->orderRouteSize && pManage->orderRoute[broadcastId].broadcast) {
+		return manage_PushBroadcast(pManage, &pManage->orderRoute[broadcastId], pOrderPacket);
+	}
+
+	do {
+		unsigned int orderId = pOrderPacket->orderId;
+		if (!orderId || orderId >= pManage->orderRouteSize || !pManage->orderRoute[orderId].eQueue) {
+			if (orderId && orderId < pManage->orderRouteSize) {
+				//the order lost its job during a QP_BLOCK wait
+				plg_JobCoalesceTake(pManage->orderRoute[orderId].pCoalesce, pOrderPacket);
+			}
+			plg_PacketFree(pOrderPacket);
+			return 0;
+		}
+
+		void* eQueue = plg_JobRouteQueue(&pManage->orderRoute[orderId]);
+		int r = plg_eqPushLimit(eQueue, pOrderPacket);
+		if (r == EQ_PUSH) {
+			return 1;
+		} else if (r == EQ_REFUSE) {
+			plg_JobCoalesceTake(pManage->orderRoute[orderId].pCoalesce, pOrderPacket);
+			plg_PacketFree(pOrderPacket);
+			return REMOTECALL_BUSY;
+		}
+
+		MutexUnlock(pManage->mutexHandle, pManage->objName);
+		plg_eqWaitSpace(eQueue);
+		MutexLock(pManage->mutexHandle, pManage->objName);
+	} while (1);
+}
+
 /*
 ԵͨѶָûʹòͬķʽͺͽ.
 ԵͨѶuserʹ÷,
@@ -740,16 +1060,12 @@ int plg_MngRemoteCall(void* pvManage, char* order, short orderLen, char* value,
 	int r = 0;
 	CheckUsingThread(0);
 	PManage pManage = pvManage;
-	POrderPacket POrderPacket = malloc(sizeof(OrderPacket));
-	POrderPacket->order = plg_sdsNewLen(order, orderLen);
-	POrderPacket->value = plg_sdsNewLen(value, valueLen);
 
 	MutexLock(pManage->mutexHandle, pManage->objName);
-	dictEntry* entry = plg_dictFind(pManage->order_equeue, POrderPacket->order);
-	if (entry) {
-		plg_eqPush(dictGetVal(entry), POrderPacket);
-		r = 1;
-	} else {
+	POrderPacket pOrderPacket = plg_PacketAlloc(pManage->packetPool, 0, order, orderLen, value, valueLen);
+	pOrderPacket->orderId = manage_OrderId(pManage, pOrderPacket->order);
+	r = manage_CoalescePut(pManage, pOrderPacket) ? 1 : manage_PushPacket(pManage, pOrderPacket);
+	if (r == 0) {
 		elog(log_error, "plg_MngRemoteCall.Order:%s not found", order);
 	}
 	MutexUnlock(pManage->mutexHandle, pManage->objName);
@@ -757,56 +1073,1292 @@ int plg_MngRemoteCall(void* pvManage, char* order, short orderLen, char* value,
 	return r;
 }
 
-void* plg_MngJobHandle(void* pvManage) {
+/*
+Hands buffer over to the job of the order without copying it, release is called with it
+once the job is done with the packet, also when the call fails.
+*/
+int plg_MngRemoteCallBuffer(void* pvManage, char* order, short orderLen, void* buffer, unsigned long long bufferLen, ReleaseBufferFun release) {
+
+	int r = 0;
+	CheckUsingThread(0);
 	PManage pManage = pvManage;
-	return pManage->pJobHandle;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	POrderPacket pOrderPacket = plg_PacketAllocBuffer(pManage->packetPool, 0, order, orderLen, buffer, bufferLen, release);
+	pOrderPacket->orderId = manage_OrderId(pManage, pOrderPacket->order);
+	r = manage_CoalescePut(pManage, pOrderPacket) ? 1 : manage_PushPacket(pManage, pOrderPacket);
+	if (r == 0) {
+		elog(log_error, "plg_MngRemoteCallBuffer.Order:%s not found", order);
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	return r;
 }
 
 /*
-ѭǶʱҪ,ܵͷʧܻ
+Same as plg_MngRemoteCall but returns a future completed when the job is done with the packet,
+its value is what the process gave to plg_JobReply. Wait with plg_FutureWait, read with plg_FutureValue
+and give it back with plg_FutureRelease. 0 when the order is not found or the job is busy.
 */
-static int OrderDestroyCount(char* value, short valueLen) {
-	unsigned int run = 0;
-	PManageDestroy pManageDestroy = (PManageDestroy)value;
-	MutexLock(pManageDestroy->pManage->mutexHandle, pManageDestroy->pManage->objName);
-	if (valueLen == sizeof(ManageDestroy)) {
-		if (pManageDestroy->type == 1) {
-			pManageDestroy->pManage->jobDestroyCount += 1;
-			if (pManageDestroy->pManage->jobDestroyCount == listLength(pManageDestroy->pManage->listJob)) {
-				run = 1;
-			}			
-		}else if (pManageDestroy->type == 2) {
-			pManageDestroy->pManage->fileDestroyCount += 1;
-			if (pManageDestroy->pManage->fileDestroyCount == listLength(pManageDestroy->pManage->listDisk)) {
-				run = 2;
+void* plg_MngCall(void* pvManage, char* order, short orderLen, char* value, short valueLen) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	POrderPacket pOrderPacket = plg_PacketAlloc(pManage->packetPool, 0, order, orderLen, value, valueLen);
+	void* pFuture = plg_FutureAlloc(pManage->futurePool);
+	pOrderPacket->pFuture = pFuture;
+	pOrderPacket->orderId = manage_OrderId(pManage, pOrderPacket->order);
+	int r = manage_PushPacket(pManage, pOrderPacket);
+	if (r == 0) {
+		elog(log_error, "plg_MngCall.Order:%s not found", order);
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	if (r != 1) {
+		plg_FutureRelease(pFuture);
+		return 0;
+	}
+	return pFuture;
+}
+
+int plg_MngRemoteCallById(void* pvManage, unsigned int orderId, char* value, short valueLen) {
+
+	int r = 0;
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	POrderPacket pOrderPacket = plg_PacketAlloc(pManage->packetPool, orderId, 0, 0, value, valueLen);
+	r = manage_CoalescePut(pManage, pOrderPacket) ? 1 : manage_PushPacket(pManage, pOrderPacket);
+	if (r == 0) {
+		elog(log_error, "plg_MngRemoteCallById.OrderId:%i not found", orderId);
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	return r;
+}
+
+/*
+Enqueues count calls taking the mutex once, the packets of each job queue are pushed together with one wakeup.
+A queue at its high water takes or refuses the group as a whole, see plg_MngSetQueueLimit.
+Returns the number of calls enqueued.
+*/
+unsigned int plg_MngRemoteCallBatch(void* pvManage, PRemoteCallItem pRemoteCallItem, unsigned int count) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	void** packets = malloc(count * sizeof(void*) * 3);
+	void** queues = packets + count;
+	void** group = queues + count;
+	unsigned int size = 0, r = 0;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	for (unsigned int l = 0; l < count; l++) {
+		POrderPacket pOrderPacket = plg_PacketAlloc(pManage->packetPool, 0, pRemoteCallItem[l].order, pRemoteCallItem[l].orderLen,
+			pRemoteCallItem[l].value, pRemoteCallItem[l].valueLen);
+		pOrderPacket->orderId = manage_OrderId(pManage, pOrderPacket->order);
+		if (manage_CoalescePut(pManage, pOrderPacket)) {
+			r++;
+		} else if (pOrderPacket->orderId && pOrderPacket->orderId < pManage->orderRouteSize && pManage->orderRoute[pOrderPacket->orderId].broadcast) {
+			if (manage_PushBroadcast(pManage, &pManage->orderRoute[pOrderPacket->orderId], pOrderPacket) == 1) {
+				r++;
 			}
+		} else if (pOrderPacket->orderId && pOrderPacket->orderId < pManage->orderRouteSize && pManage->orderRoute[pOrderPacket->orderId].eQueue) {
+			packets[size] = pOrderPacket;
+			queues[size++] = plg_JobRouteQueue(&pManage->orderRoute[pOrderPacket->orderId]);
+		} else {
+			elog(log_error, "plg_MngRemoteCallBatch.Order:%s not found", pOrderPacket->order);
+			plg_PacketFree(pOrderPacket);
 		}
 	}
-	MutexUnlock(pManageDestroy->pManage->mutexHandle, pManageDestroy->pManage->objName);
 
-	if (run == 1) {
-		sleep(0);
-		pManageDestroy->fun(pManageDestroy->ptr);
-	} else if (run == 2) {
-		sleep(0);
-		pManageDestroy->fun(pManageDestroy->ptr);
+	//one push per queue, the order of the calls to the same queue is kept
+	for (unsigned int l = 0; l < size; l++) {
+		void* eQueue = queues[l];
+		if (!eQueue) {
+			continue;
+		}
+		unsigned int groupSize = 0;
+		for (unsigned int c = l; c < size; c++) {
+			if (queues[c] == eQueue) {
+				group[groupSize++] = packets[c];
+				queues[c] = 0;
+			}
+		}
+
+		int ret = plg_eqPushBatchLimit(eQueue, group, groupSize);
+		if (ret == EQ_PUSH) {
+			r += groupSize;
+		} else if (ret == EQ_REFUSE) {
+			for (unsigned int c = 0; c < groupSize; c++) {
+				plg_JobCoalesceTake(pManage->orderRoute[((POrderPacket)group[c])->orderId].pCoalesce, group[c]);
+				plg_PacketFree(group[c]);
+			}
+		} else {
+			//blocked, the packets wait one by one and follow the route as it is after the wait
+			for (unsigned int c = 0; c < groupSize; c++) {
+				if (manage_PushPacket(pManage, group[c]) == 1) {
+					r++;
+				}
+			}
+		}
 	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	free(packets);
+	return r;
+}
+
+/*
+Bounds the queue of every job against plg_MngRemoteCall bursts of user threads.
+When a queue holds highWater packets, QP_BLOCK makes the caller wait, QP_BUSY makes
+plg_MngRemoteCall return REMOTECALL_BUSY and QP_SHED drops the oldest user packet of the queue.
+Remote calls between jobs are never held, a job blocking on another job could deadlock.
+highWater 0 leaves the queues unbounded, which is the default.
+*/
+int plg_MngSetQueueLimit(void* pvManage, unsigned int highWater, int policy) {
 
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (pManage->runStatus) {
+		elog(log_error, "plg_MngSetQueueLimit.Queue limit can not change while the system is running");
+		return 0;
+	}
+	if (policy != QP_BLOCK && policy != QP_BUSY && policy != QP_SHED) {
+		elog(log_error, "plg_MngSetQueueLimit.Unknown policy:%i", policy);
+		return 0;
+	}
+	pManage->queueHighWater = highWater;
+	pManage->queuePolicy = policy;
 	return 1;
 }
 
-static void manage_InternalDestoryHandle(void* pvManage, AfterDestroyFun fun, void* ptr, void* pEvent) {
+/*
+Gauges of the queue of the job at jobIndex, any pointer may be 0.
+depth: packets waiting now, peak: highest depth, busy: calls refused,
+block: waits of blocked callers, shed: packets dropped.
+*/
+int plg_MngQueueStat(void* pvManage, unsigned int jobIndex, unsigned long long* depth, unsigned long long* peak,
+	unsigned long long* busy, unsigned long long* block, unsigned long long* shed) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	QueueStat queueStat;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	listNode* jobNode = plg_listIndex(pManage->listJob, jobIndex);
+	if (jobNode) {
+		plg_eqStat(plg_JobEqueueHandle(listNodeValue(jobNode)), &queueStat);
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	if (!jobNode) {
+		elog(log_error, "plg_MngQueueStat.Job index:%i not found", jobIndex);
+		return 0;
+	}
+	if (depth) *depth = queueStat.depth;
+	if (peak) *peak = queueStat.peak;
+	if (busy) *busy = queueStat.busy;
+	if (block) *block = queueStat.block;
+	if (shed) *shed = queueStat.shed;
+	return 1;
+}
+
+/*
+The id of an order does not change once plg_MngAddOrder returned, 0 when the order is unknown.
+*/
+unsigned int plg_MngOrderId(void* pvManage, char* order, short orderLen) {
 
+	CheckUsingThread(0);
 	PManage pManage = pvManage;
-	plg_MutexDestroyHandle(pManage->mutexHandle);
-	plg_listRelease(pManage->listDisk);
-	plg_listRelease(pManage->listJob);
-	plg_listRelease(pManage->listOrder);
-	plg_listRelease(pManage->listProcess);
-	plg_dictRelease(pManage->dictTableName);
+	sds sdsOrder = plg_sdsNewLen(order, orderLen);
 
-	plg_dictRelease(pManage->order_process);
-	plg_dictRelease(pManage->order_equeue);
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	unsigned int orderId = manage_OrderId(pManage, sdsOrder);
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	plg_sdsFree(sdsOrder);
+	return orderId;
+}
+
+/*
+Tables of order owned by pSourceJob are added to groupTable.
+*/
+static void manage_GroupAddOrder(PManage pManage, sds order, void* pSourceJob, dict* groupOrder, dict* groupTable) {
+
+	plg_dictAdd(groupOrder, order, 0);
+	dict* table = plg_DictSetValue(pManage->order_tableName, order);
+	if (!table) {
+		return;
+	}
+
+	dictIterator* tableIter = plg_dictGetSafeIterator(table);
+	dictEntry* tableNode;
+	while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+		dictEntry* ownerEntry = plg_dictFind(pManage->tableName_jobHandle, dictGetKey(tableNode));
+		if (ownerEntry && dictGetVal(ownerEntry) == pSourceJob && plg_dictFind(groupTable, dictGetKey(ownerEntry)) == 0) {
+			plg_dictAdd(groupTable, dictGetKey(ownerEntry), 0);
+		}
+	}
+	plg_dictReleaseIterator(tableIter);
+}
+
+/*
+The group of an order is every order of the same job reaching it through a table owned by that job.
+Such orders must stay on one job because only the owner of a cache may write it.
+The returned JobMigrate is one block, freed by the target job when the migration is done.
+*/
+static PJobMigrate manage_MigrateGroup(PManage pManage, sds order, void* pSourceJob) {
+
+	dict* groupOrder = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	dict* groupTable = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	manage_GroupAddOrder(pManage, order, pSourceJob, groupOrder, groupTable);
+
+	char changed;
+	do {
+		changed = 0;
+		listIter* orderIter = plg_listGetIterator(pManage->listOrder, AL_START_HEAD);
+		listNode* orderNode;
+		while ((orderNode = plg_listNext(orderIter)) != NULL) {
+			unsigned int orderId = manage_OrderId(pManage, listNodeValue(orderNode));
+			if (!orderId || pManage->orderRoute[orderId].pJobHandle != pSourceJob || plg_dictFind(groupOrder, listNodeValue(orderNode))) {
+				continue;
+			}
+
+			dict* table = plg_DictSetValue(pManage->order_tableName, listNodeValue(orderNode));
+			if (!table) {
+				continue;
+			}
+
+			char intersect = 0;
+			dictIterator* tableIter = plg_dictGetSafeIterator(table);
+			dictEntry* tableNode;
+			while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+				if (plg_dictFind(groupTable, dictGetKey(tableNode))) {
+					intersect = 1;
+					break;
+				}
+			}
+			plg_dictReleaseIterator(tableIter);
+
+			if (intersect) {
+				manage_GroupAddOrder(pManage, listNodeValue(orderNode), pSourceJob, groupOrder, groupTable);
+				changed = 1;
+			}
+		}
+		plg_listReleaseIterator(orderIter);
+	} while (changed);
+
+	unsigned int orderLength = dictSize(groupOrder);
+	unsigned int tableLength = dictSize(groupTable);
+	unsigned int jobLength = listLength(pManage->listJob);
+	PJobMigrate pJobMigrate = malloc(sizeof(JobMigrate) + orderLength * (sizeof(unsigned int) + 2 * sizeof(void*))
+		+ tableLength * (2 * sizeof(void*) + sizeof(unsigned char)) + jobLength * sizeof(void*));
+
+	char* ptr = (char*)pJobMigrate + sizeof(JobMigrate);
+	pJobMigrate->order = (char**)ptr;
+	ptr += orderLength * sizeof(void*);
+	pJobMigrate->process = (void**)ptr;
+	ptr += orderLength * sizeof(void*);
+	pJobMigrate->table = (char**)ptr;
+	ptr += tableLength * sizeof(void*);
+	pJobMigrate->cache = (void**)ptr;
+	ptr += tableLength * sizeof(void*);
+	pJobMigrate->job = (void**)ptr;
+	ptr += jobLength * sizeof(void*);
+	pJobMigrate->orderId = (unsigned int*)ptr;
+	ptr += orderLength * sizeof(unsigned int);
+	pJobMigrate->noShare = (unsigned char*)ptr;
+
+	pJobMigrate->pManage = pManage;
+	pJobMigrate->pSourceJob = pSourceJob;
+	pJobMigrate->pTargetJob = 0;
+	pJobMigrate->orderLength = orderLength;
+	pJobMigrate->tableLength = tableLength;
+	pJobMigrate->jobLength = jobLength;
+	pJobMigrate->barrier = 0;
+
+	unsigned int l = 0;
+	dictIterator* iter = plg_dictGetSafeIterator(groupOrder);
+	dictEntry* node;
+	while ((node = plg_dictNext(iter)) != NULL) {
+		pJobMigrate->order[l] = dictGetKey(node);
+		pJobMigrate->orderId[l] = manage_OrderId(pManage, dictGetKey(node));
+		pJobMigrate->process[l] = 0;
+		l++;
+	}
+	plg_dictReleaseIterator(iter);
+
+	l = 0;
+	iter = plg_dictGetSafeIterator(groupTable);
+	while ((node = plg_dictNext(iter)) != NULL) {
+		pJobMigrate->table[l] = dictGetKey(node);
+		pJobMigrate->cache[l] = 0;
+		pJobMigrate->noShare[l] = 0;
+		dictEntry* tableEntry = plg_dictFind(pManage->dictTableName, dictGetKey(node));
+		if (tableEntry) {
+			pJobMigrate->noShare[l] = ((PTableName)dictGetVal(tableEntry))->noShare;
+		}
+		l++;
+	}
+	plg_dictReleaseIterator(iter);
+
+	l = 0;
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		pJobMigrate->job[l++] = listNodeValue(jobNode);
+	}
+	plg_listReleaseIterator(jobIter);
+
+	plg_dictRelease(groupOrder);
+	plg_dictRelease(groupTable);
+	return pJobMigrate;
+}
+
+/*
+Manage switches the routes and the table owners at once, user threads see the new route under the mutex.
+Packets already sent on the old route are forwarded by the source job, see plg_JobMigrateOut.
+*/
+static void manage_StartMigrate(PManage pManage, PJobMigrate pJobMigrate, void* pTargetJob) {
+
+	pJobMigrate->pTargetJob = pTargetJob;
+	pManage->migrating = 1;
+
+	for (unsigned int l = 0; l < pJobMigrate->orderLength; l++) {
+		POrderRoute pOrderRoute = &pManage->orderRoute[pJobMigrate->orderId[l]];
+		plg_JobHoldOrder(pTargetJob, pJobMigrate->orderId[l]);
+		pOrderRoute->pJobHandle = pTargetJob;
+		plg_AtomicStorePtr(&pOrderRoute->eQueue, plg_JobEqueueHandle(pTargetJob));
+	}
+
+	for (unsigned int l = 0; l < pJobMigrate->tableLength; l++) {
+		plg_dictReplace(pManage->tableName_jobHandle, pJobMigrate->table[l], pTargetJob);
+	}
+
+	elog(log_details, "manage_StartMigrate.order:%i table:%i", pJobMigrate->orderLength, pJobMigrate->tableLength);
+	plg_JobMigrateOut(pJobMigrate->pSourceJob, pJobMigrate);
+}
+
+/*
+Move the group of order to the job at jobIndex without stopping the jobs.
+Only one migration runs at a time, 0 is returned while another one is in progress.
+*/
+int plg_MngMigrateOrder(void* pvManage, char* order, short orderLen, unsigned int jobIndex) {
+
+	int r = 0;
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	sds sdsOrder = plg_sdsNewLen(order, orderLen);
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	do {
+		if (!pManage->runStatus || pManage->migrating) {
+			elog(log_error, "plg_MngMigrateOrder.Jobs are not running or a migration is in progress");
+			break;
+		}
+
+		unsigned int orderId = manage_OrderId(pManage, sdsOrder);
+		if (!orderId || orderId >= pManage->orderRouteSize || !pManage->orderRoute[orderId].pJobHandle) {
+			elog(log_error, "plg_MngMigrateOrder.Order:%s not found", sdsOrder);
+			break;
+		}
+
+		listNode* jobNode = plg_listIndex(pManage->listJob, jobIndex);
+		if (!jobNode) {
+			elog(log_error, "plg_MngMigrateOrder.Job:%i not found", jobIndex);
+			break;
+		}
+
+		void* pSourceJob = pManage->orderRoute[orderId].pJobHandle;
+		if (pSourceJob == listNodeValue(jobNode)) {
+			break;
+		}
+
+		manage_StartMigrate(pManage, manage_MigrateGroup(pManage, pManage->orderRoute[orderId].order, pSourceJob), listNodeValue(jobNode));
+		r = 1;
+	} while (0);
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	plg_sdsFree(sdsOrder);
+	return r;
+}
+
+/*
+Called by the target job when the migration is done.
+*/
+void plg_MngMigrateFinish(void* pvManage) {
+
+	PManage pManage = pvManage;
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	pManage->migrating = 0;
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+}
+
+/*
+The load of an order is the number of packets processed since the last call.
+The group of the busiest job that best evens it with the least loaded job is migrated.
+*/
+int plg_MngRebalanceJob(void* pvManage) {
+
+	int r = 0;
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	unsigned int jobLength = listLength(pManage->listJob);
+	if (!pManage->runStatus || pManage->migrating || jobLength < 2) {
+		MutexUnlock(pManage->mutexHandle, pManage->objName);
+		return 0;
+	}
+
+	unsigned long long* orderDelta = calloc(pManage->orderRouteSize, sizeof(unsigned long long));
+	for (unsigned int orderId = 1; orderId < pManage->orderRouteSize; orderId++) {
+		unsigned long long load = 0;
+		listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+		listNode* jobNode;
+		while ((jobNode = plg_listNext(jobIter)) != NULL) {
+			load += plg_JobOrderCount(listNodeValue(jobNode), orderId);
+		}
+		plg_listReleaseIterator(jobIter);
+
+		orderDelta[orderId] = load - pManage->orderLoad[orderId];
+		pManage->orderLoad[orderId] = load;
+	}
+
+	//busiest and least loaded job
+	void* pBusyJob = 0, *pIdleJob = 0;
+	unsigned long long busyLoad = 0, idleLoad = ULLONG_MAX;
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		unsigned long long load = 0;
+		for (unsigned int orderId = 1; orderId < pManage->orderRouteSize; orderId++) {
+			if (pManage->orderRoute[orderId].pJobHandle == listNodeValue(jobNode)) {
+				load += orderDelta[orderId];
+			}
+		}
+
+		if (pBusyJob == 0 || load > busyLoad) {
+			busyLoad = load;
+			pBusyJob = listNodeValue(jobNode);
+		}
+		if (load < idleLoad) {
+			idleLoad = load;
+			pIdleJob = listNodeValue(jobNode);
+		}
+	}
+	plg_listReleaseIterator(jobIter);
+
+	PJobMigrate pBestMigrate = 0;
+	unsigned long long bestGap = busyLoad - idleLoad;
+	if (pBusyJob != pIdleJob && bestGap) {
+		unsigned char* visit = calloc(pManage->orderRouteSize, sizeof(unsigned char));
+		for (unsigned int orderId = 1; orderId < pManage->orderRouteSize; orderId++) {
+			if (visit[orderId] || pManage->orderRoute[orderId].pJobHandle != pBusyJob) {
+				continue;
+			}
+
+			PJobMigrate pJobMigrate = manage_MigrateGroup(pManage, pManage->orderRoute[orderId].order, pBusyJob);
+			unsigned long long groupLoad = 0;
+			for (unsigned int l = 0; l < pJobMigrate->orderLength; l++) {
+				visit[pJobMigrate->orderId[l]] = 1;
+				groupLoad += orderDelta[pJobMigrate->orderId[l]];
+			}
+
+			long long gap = (long long)(busyLoad - groupLoad) - (long long)(idleLoad + groupLoad);
+			unsigned long long absGap = gap < 0 ? -gap : gap;
+			if (groupLoad && absGap < bestGap) {
+				free(pBestMigrate);
+				pBestMigrate = pJobMigrate;
+				bestGap = absGap;
+			} else {
+				free(pJobMigrate);
+			}
+		}
+		free(visit);
+	}
+
+	if (pBestMigrate) {
+		manage_StartMigrate(pManage, pBestMigrate, pIdleJob);
+		r = 1;
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	free(orderDelta);
+	return r;
+}
+
+static void manage_SetCore(int** coreArray, unsigned int* coreSize, unsigned int index, int core) {
+
+	if (index >= *coreSize) {
+		*coreArray = realloc(*coreArray, (index + 1) * sizeof(int));
+		for (unsigned int l = *coreSize; l <= index; l++) {
+			(*coreArray)[l] = -1;
+		}
+		*coreSize = index + 1;
+	}
+	(*coreArray)[index] = core;
+}
+
+/*
+Pin the job thread at jobIndex, in the order plg_MngAllocJob created the jobs, to a cpu when plg_MngStarJob starts it.
+The pages of the caches written by the job are then on the numa node of that cpu.
+core -1 removes the pin.
+*/
+int plg_MngSetJobCore(void* pvManage, unsigned int jobIndex, int core) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (pManage->runStatus) {
+		elog(log_error, "plg_MngSetJobCore.Affinity can not change while the system is running");
+		return 0;
+	}
+	manage_SetCore(&pManage->jobCore, &pManage->jobCoreSize, jobIndex, core);
+	return 1;
+}
+
+/*
+Same as plg_MngSetJobCore for the thread of each file in the order of the files in the data path.
+*/
+int plg_MngSetFileCore(void* pvManage, unsigned int fileIndex, int core) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (pManage->runStatus) {
+		elog(log_error, "plg_MngSetFileCore.Affinity can not change while the system is running");
+		return 0;
+	}
+	manage_SetCore(&pManage->fileCore, &pManage->fileCoreSize, fileIndex, core);
+	return 1;
+}
+
+/*
+Opt-in group commit: a job commits once for up to commitCount packets drained from its queue
+or commitTime microseconds, and always when the queue runs empty.
+When a packet rolls back, the group is rolled back and every packet of it runs again with its own commit.
+Remote calls of the group are held until it commits, other side effects such as plg_EventSend are not,
+so only orders whose process can run twice should be used with it.
+commitCount below 2 commits after every packet, which is the default.
+*/
+int plg_MngSetGroupCommit(void* pvManage, unsigned int commitCount, unsigned int commitTime) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (pManage->runStatus) {
+		elog(log_error, "plg_MngSetGroupCommit.Group commit can not change while the system is running");
+		return 0;
+	}
+	pManage->commitCount = commitCount;
+	pManage->commitTime = commitTime;
+	return 1;
+}
+
+/*
+The job at jobIndex is used by the next plg_MngAllocJob for the order, unless a table of the order is owned by another job.
+*/
+int plg_MngSetOrderJob(void* pvManage, char* nameOrder, short nameOrderLen, unsigned int jobIndex) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	sds sdsOrder = plg_sdsNewLen(nameOrder, nameOrderLen);
+	dictEntry * entry = plg_dictFind(pManage->order_process, sdsOrder);
+	plg_sdsFree(sdsOrder);
+	if (entry == 0) {
+		elog(log_error, "plg_MngSetOrderJob.Order:%s not found", nameOrder);
+		return 0;
+	}
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	plg_dictReplace(pManage->order_job, dictGetKey(entry), (void*)(size_t)(jobIndex + 1));
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+	return 1;
+}
+
+static unsigned int manage_PlanFind(unsigned int* group, unsigned int orderId) {
+
+	while (group[orderId] != orderId) {
+		group[orderId] = group[group[orderId]];
+		orderId = group[orderId];
+	}
+	return orderId;
+}
+
+/*
+Orders using the same table fall into one group, table_orderId keeps the first order of each table.
+*/
+static void manage_PlanUnion(dict* table_orderId, unsigned int* group, unsigned int orderId, sds table) {
+
+	dictEntry* entry = plg_dictFind(table_orderId, table);
+	if (entry == 0) {
+		plg_dictAdd(table_orderId, table, (void*)(size_t)orderId);
+	} else {
+		unsigned int root = manage_PlanFind(group, (unsigned int)(size_t)dictGetVal(entry));
+		group[manage_PlanFind(group, orderId)] = root;
+	}
+}
+
+typedef struct _PlanGroup
+{
+	unsigned int root;
+	unsigned long long load;
+}*PPlanGroup, PlanGroup;
+
+static int PlanGroupCmp(const void* value1, const void* value2) {
+
+	const PlanGroup* pg1 = value1;
+	const PlanGroup* pg2 = value2;
+	if (pg1->load < pg2->load) {
+		return 1;
+	} else if (pg1->load == pg2->load) {
+		return 0;
+	} else {
+		return -1;
+	}
+}
+
+/*
+Plan the allocation over core jobs from the load measured by the running jobs.
+Orders sharing a declared or used table stay in one group, the groups are placed from the heaviest,
+each on the job it calls most among the jobs still under the average load plus 10%.
+The plan is used by the next plg_MngAllocJob and written by plg_MngPlanToJsonFile.
+*/
+int plg_MngPlanJob(void* pvManage, unsigned int core) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (!pManage->runStatus || !core) {
+		elog(log_error, "plg_MngPlanJob.Jobs are not running or core is 0");
+		return 0;
+	}
+
+	//measure, the jobs answer one by one
+	unsigned int orderSize = pManage->orderRouteSize;
+	JobLoad jobLoad;
+	PJobLoad pJobLoad = &jobLoad;
+	jobLoad.pEvent = plg_EventCreateHandle();
+	jobLoad.orderSize = orderSize;
+	jobLoad.count = calloc(orderSize, sizeof(unsigned long long));
+	jobLoad.time = calloc(orderSize, sizeof(unsigned long long));
+	jobLoad.call = calloc(orderSize * orderSize, sizeof(unsigned long long));
+	jobLoad.touch = plg_DictSetCreate(plg_DefaultSdsDictPtr(), DICT_MIDDLE, plg_DefaultSdsDictPtr(), DICT_MIDDLE);
+
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		plg_JobSendControl(plg_JobEqueueHandle(listNodeValue(jobNode)), "loadreport", (char*)&pJobLoad, sizeof(PJobLoad));
+		plg_EventWait(jobLoad.pEvent);
+		unsigned int eventLen;
+		plg_EventFreePtr(plg_EventRecvAlloc(jobLoad.pEvent, &eventLen));
+	}
+	plg_listReleaseIterator(jobIter);
+	plg_EventDestroyHandle(jobLoad.pEvent);
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+
+	//group
+	unsigned int* group = malloc(orderSize * sizeof(unsigned int));
+	for (unsigned int l = 0; l < orderSize; l++) {
+		group[l] = l;
+	}
+
+	unsigned long long allTime = 0;
+	dict* table_orderId = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	listIter* orderIter = plg_listGetIterator(pManage->listOrder, AL_START_HEAD);
+	listNode* orderNode;
+	while ((orderNode = plg_listNext(orderIter)) != NULL) {
+		unsigned int orderId = manage_OrderId(pManage, listNodeValue(orderNode));
+		allTime += jobLoad.time[orderId];
+
+		dict* table[2] = { plg_DictSetValue(pManage->order_tableName, listNodeValue(orderNode)), plg_DictSetValue(jobLoad.touch, listNodeValue(orderNode)) };
+		for (int t = 0; t < 2; t++) {
+			if (!table[t]) {
+				continue;
+			}
+
+			dictIterator* tableIter = plg_dictGetSafeIterator(table[t]);
+			dictEntry* tableNode;
+			while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+				manage_PlanUnion(table_orderId, group, orderId, dictGetKey(tableNode));
+			}
+			plg_dictReleaseIterator(tableIter);
+		}
+	}
+	plg_listReleaseIterator(orderIter);
+	plg_dictRelease(table_orderId);
+
+	//load of the groups, the count is used before any time was measured
+	unsigned long long* load = allTime ? jobLoad.time : jobLoad.count;
+	unsigned int* next = calloc(orderSize, sizeof(unsigned int));
+	unsigned int* head = calloc(orderSize, sizeof(unsigned int));
+	PPlanGroup planGroup = calloc(orderSize, sizeof(PlanGroup));
+	unsigned int groupLength = 0;
+	unsigned long long allLoad = 0;
+	for (unsigned int orderId = 1; orderId < orderSize; orderId++) {
+		unsigned int root = manage_PlanFind(group, orderId);
+		if (root == orderId) {
+			planGroup[groupLength++].root = root;
+		}
+		next[orderId] = head[root];
+		head[root] = orderId;
+		allLoad += load[orderId];
+	}
+
+	for (unsigned int l = 0; l < groupLength; l++) {
+		for (unsigned int orderId = head[planGroup[l].root]; orderId; orderId = next[orderId]) {
+			planGroup[l].load += load[orderId];
+		}
+	}
+	qsort(planGroup, groupLength, sizeof(PlanGroup), PlanGroupCmp);
+
+	//place
+	unsigned int* orderJob = calloc(orderSize, sizeof(unsigned int));
+	unsigned long long* jobLoadSum = calloc(core, sizeof(unsigned long long));
+	unsigned long long* affinity = malloc(core * sizeof(unsigned long long));
+	unsigned long long limit = allLoad / core + allLoad / core / 10;
+	for (unsigned int l = 0; l < groupLength; l++) {
+
+		memset(affinity, 0, core * sizeof(unsigned long long));
+		for (unsigned int orderId = head[planGroup[l].root]; orderId; orderId = next[orderId]) {
+			for (unsigned int callId = 1; callId < orderSize; callId++) {
+				if (orderJob[callId]) {
+					affinity[orderJob[callId] - 1] += jobLoad.call[orderId * orderSize + callId] + jobLoad.call[callId * orderSize + orderId];
+				}
+			}
+		}
+
+		int best = -1;
+		for (unsigned int j = 0; j < core; j++) {
+			if (jobLoadSum[j] && jobLoadSum[j] + planGroup[l].load > limit) {
+				continue;
+			}
+			if (best == -1 || affinity[j] > affinity[best] || (affinity[j] == affinity[best] && jobLoadSum[j] < jobLoadSum[best])) {
+				best = j;
+			}
+		}
+
+		if (best == -1) {
+			best = 0;
+			for (unsigned int j = 1; j < core; j++) {
+				if (jobLoadSum[j] < jobLoadSum[best]) {
+					best = j;
+				}
+			}
+		}
+
+		jobLoadSum[best] += planGroup[l].load;
+		for (unsigned int orderId = head[planGroup[l].root]; orderId; orderId = next[orderId]) {
+			orderJob[orderId] = best + 1;
+		}
+	}
+
+	plg_dictEmpty(pManage->order_job, NULL);
+	for (unsigned int orderId = 1; orderId < orderSize; orderId++) {
+		if (orderJob[orderId] && pManage->orderRoute[orderId].order) {
+			plg_dictAdd(pManage->order_job, pManage->orderRoute[orderId].order, (void*)(size_t)orderJob[orderId]);
+		}
+	}
+
+	pManage->planCore = core;
+	free(pManage->planCount);
+	free(pManage->planTime);
+	if (pManage->planTouch) {
+		plg_DictSetDestroy(pManage->planTouch);
+	}
+	pManage->planCount = jobLoad.count;
+	pManage->planTime = jobLoad.time;
+	pManage->planTouch = jobLoad.touch;
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	free(jobLoad.call);
+	free(group);
+	free(next);
+	free(head);
+	free(planGroup);
+	free(orderJob);
+	free(jobLoadSum);
+	free(affinity);
+	return 1;
+}
+
+/*
+Prints and deletes root.
+*/
+static int manage_JsonToFile(pJSON* root, char* jsonPath) {
+
+	int r = 0;
+	FILE *outputFile = fopen_t(jsonPath, "wb");
+	if (outputFile) {
+		char* ptr = pJson_Print(root);
+		fwrite(ptr, 1, strlen(ptr), outputFile);
+		fclose(outputFile);
+		free(ptr);
+		r = 1;
+	} else {
+		elog(log_error, "manage_JsonToFile.fopen_t.wb:%s", jsonPath);
+	}
+
+	pJson_Delete(root);
+	return r;
+}
+
+/*
+Writes the orders, their tables and the plan in the format of plg_MngConfigFromJsonFile.
+count, load (nanoseconds) and touch are the measurements the plan was made from.
+*/
+int plg_MngPlanToJsonFile(void* pvManage, char* jsonPath) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	pJSON* root = pJson_CreateObject();
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	pJson_AddNumberToObject(root, "core", pManage->planCore ? pManage->planCore : listLength(pManage->listJob));
+
+	listIter* orderIter = plg_listGetIterator(pManage->listOrder, AL_START_HEAD);
+	listNode* orderNode;
+	while ((orderNode = plg_listNext(orderIter)) != NULL) {
+
+		pJSON* orderObj = pJson_CreateObject();
+		pJson_AddItemToObject(root, listNodeValue(orderNode), orderObj);
+
+		dictEntry* entry = plg_dictFind(pManage->order_process, listNodeValue(orderNode));
+		if (entry) {
+			plg_JobProcessToJson(dictGetVal(entry), orderObj);
+		}
+
+		entry = plg_dictFind(pManage->order_job, listNodeValue(orderNode));
+		if (entry) {
+			pJson_AddNumberToObject(orderObj, "job", (unsigned int)(size_t)dictGetVal(entry) - 1);
+		}
+
+		unsigned int orderId = manage_OrderId(pManage, listNodeValue(orderNode));
+		if (pManage->planCount && orderId < pManage->orderRouteSize) {
+			pJson_AddNumberToObject(orderObj, "count", (double)pManage->planCount[orderId]);
+			pJson_AddNumberToObject(orderObj, "load", (double)pManage->planTime[orderId]);
+
+			pJSON* touchArray = pJson_CreateArray();
+			pJson_AddItemToObject(orderObj, "touch", touchArray);
+			dict* touch = plg_DictSetValue(pManage->planTouch, listNodeValue(orderNode));
+			if (touch) {
+				dictIterator* touchIter = plg_dictGetSafeIterator(touch);
+				dictEntry* touchNode;
+				while ((touchNode = plg_dictNext(touchIter)) != NULL) {
+					pJson_AddItemToArray(touchArray, pJson_CreateString(dictGetKey(touchNode)));
+				}
+				plg_dictReleaseIterator(touchIter);
+			}
+		}
+
+		dict* table = plg_DictSetValue(pManage->order_tableName, listNodeValue(orderNode));
+		if (table) {
+			dictIterator* tableIter = plg_dictGetSafeIterator(table);
+			dictEntry* tableNode;
+			while ((tableNode = plg_dictNext(tableIter)) != NULL) {
+				pJSON* tableObj = pJson_CreateObject();
+				pJson_AddItemToObject(orderObj, dictGetKey(tableNode), tableObj);
+
+				dictEntry* tableEntry = plg_dictFind(pManage->dictTableName, dictGetKey(tableNode));
+				if (tableEntry) {
+					PTableName pTableName = dictGetVal(tableEntry);
+					pJson_AddNumberToObject(tableObj, "weight", pTableName->weight);
+					pJson_AddNumberToObject(tableObj, "noshare", pTableName->noShare);
+					pJson_AddNumberToObject(tableObj, "nosave", pTableName->noSave);
+				}
+			}
+			plg_dictReleaseIterator(tableIter);
+		}
+	}
+	plg_listReleaseIterator(orderIter);
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	return manage_JsonToFile(root, jsonPath);
+}
+
+/*
+Called with the mutex held, the jobs are copied because the report runs after it is released.
+*/
+static PJobMetric manage_MetricCreate(PManage pManage, void* pEvent) {
+
+	PJobMetric pJobMetric = malloc(sizeof(JobMetric));
+	pJobMetric->pEvent = pEvent;
+	pJobMetric->pManage = pManage;
+	pJobMetric->generation = pManage->metricsGen;
+	pJobMetric->orderSize = pManage->orderRouteSize;
+	pJobMetric->jobLength = listLength(pManage->listJob);
+	pJobMetric->jobIndex = 0;
+
+	pJobMetric->job = malloc(pJobMetric->jobLength * sizeof(void*));
+	unsigned int index = 0;
+	listIter* jobIter = plg_listGetIterator(pManage->listJob, AL_START_HEAD);
+	listNode* jobNode;
+	while ((jobNode = plg_listNext(jobIter)) != NULL) {
+		pJobMetric->job[index++] = listNodeValue(jobNode);
+	}
+	plg_listReleaseIterator(jobIter);
+
+	pJobMetric->exec = malloc(pJobMetric->orderSize * sizeof(void*));
+	pJobMetric->wait = malloc(pJobMetric->orderSize * sizeof(void*));
+	for (unsigned int l = 0; l < pJobMetric->orderSize; l++) {
+		pJobMetric->exec[l] = plg_HistogramCreate();
+		pJobMetric->wait[l] = plg_HistogramCreate();
+	}
+	pJobMetric->rollback = calloc(pJobMetric->orderSize, sizeof(unsigned long long));
+	pJobMetric->orderJob = calloc(pJobMetric->orderSize, sizeof(unsigned int));
+
+	pJobMetric->commit = malloc(pJobMetric->jobLength * sizeof(void*));
+	for (unsigned int l = 0; l < pJobMetric->jobLength; l++) {
+		pJobMetric->commit[l] = plg_HistogramCreate();
+	}
+	pJobMetric->jobCount = calloc(pJobMetric->jobLength, sizeof(unsigned long long));
+	pJobMetric->jobRollback = calloc(pJobMetric->jobLength, sizeof(unsigned long long));
+	pJobMetric->jobElapsed = calloc(pJobMetric->jobLength, sizeof(unsigned long long));
+	return pJobMetric;
+}
+
+static void manage_MetricDestroy(PJobMetric pJobMetric) {
+
+	for (unsigned int l = 0; l < pJobMetric->orderSize; l++) {
+		plg_HistogramDestroy(pJobMetric->exec[l]);
+		plg_HistogramDestroy(pJobMetric->wait[l]);
+	}
+	for (unsigned int l = 0; l < pJobMetric->jobLength; l++) {
+		plg_HistogramDestroy(pJobMetric->commit[l]);
+	}
+	free(pJobMetric->job);
+	free(pJobMetric->exec);
+	free(pJobMetric->wait);
+	free(pJobMetric->rollback);
+	free(pJobMetric->orderJob);
+	free(pJobMetric->commit);
+	free(pJobMetric->jobCount);
+	free(pJobMetric->jobRollback);
+	free(pJobMetric->jobElapsed);
+	free(pJobMetric);
+}
+
+/*
+Runs "metricsreport" through all jobs and waits for the last one, 0 when jobs are not running.
+*/
+static PJobMetric manage_MetricCollect(PManage pManage) {
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	if (!pManage->runStatus || !listLength(pManage->listJob)) {
+		MutexUnlock(pManage->mutexHandle, pManage->objName);
+		return 0;
+	}
+	PJobMetric pJobMetric = manage_MetricCreate(pManage, plg_EventCreateHandle());
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	plg_JobSendControl(plg_JobEqueueHandle(pJobMetric->job[0]), "metricsreport", (char*)&pJobMetric, sizeof(PJobMetric));
+	plg_EventWait(pJobMetric->pEvent);
+	unsigned int eventLen;
+	plg_EventFreePtr(plg_EventRecvAlloc(pJobMetric->pEvent, &eventLen));
+	plg_EventDestroyHandle(pJobMetric->pEvent);
+	pJobMetric->pEvent = 0;
+	return pJobMetric;
+}
+
+static void manage_HistogramToJson(pJSON* root, char* name, void* pHistogram) {
+
+	pJSON* histogramObj = pJson_CreateObject();
+	pJson_AddItemToObject(root, name, histogramObj);
+	pJson_AddNumberToObject(histogramObj, "count", (double)plg_HistogramCount(pHistogram));
+	pJson_AddNumberToObject(histogramObj, "mean", (double)plg_HistogramMean(pHistogram));
+	pJson_AddNumberToObject(histogramObj, "p50", (double)plg_HistogramPercentile(pHistogram, 50));
+	pJson_AddNumberToObject(histogramObj, "p99", (double)plg_HistogramPercentile(pHistogram, 99));
+	pJson_AddNumberToObject(histogramObj, "p999", (double)plg_HistogramPercentile(pHistogram, 99.9));
+	pJson_AddNumberToObject(histogramObj, "max", (double)plg_HistogramMax(pHistogram));
+}
+
+/*
+Latencies are nanoseconds, rate is packets per second since the job started.
+*/
+static pJSON* manage_MetricToJson(PManage pManage, PJobMetric pJobMetric) {
+
+	pJSON* root = pJson_CreateObject();
+	pJSON* jobArray = pJson_CreateArray();
+	pJson_AddItemToObject(root, "job", jobArray);
+	for (unsigned int l = 0; l < pJobMetric->jobLength; l++) {
+		pJSON* jobObj = pJson_CreateObject();
+		pJson_AddItemToArray(jobArray, jobObj);
+
+		QueueStat queueStat;
+		plg_eqStat(plg_JobEqueueHandle(pJobMetric->job[l]), &queueStat);
+		pJson_AddNumberToObject(jobObj, "count", (double)pJobMetric->jobCount[l]);
+		pJson_AddNumberToObject(jobObj, "rollback", (double)pJobMetric->jobRollback[l]);
+		pJson_AddNumberToObject(jobObj, "rate", pJobMetric->jobElapsed[l] ? (double)pJobMetric->jobCount[l] * 1000000000 / pJobMetric->jobElapsed[l] : 0);
+		pJson_AddNumberToObject(jobObj, "depth", (double)queueStat.depth);
+		pJson_AddNumberToObject(jobObj, "peak", (double)queueStat.peak);
+		manage_HistogramToJson(jobObj, "commit", pJobMetric->commit[l]);
+	}
+
+	pJSON* orderObj = pJson_CreateObject();
+	pJson_AddItemToObject(root, "order", orderObj);
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	for (unsigned int orderId = 1; orderId < pJobMetric->orderSize && orderId < pManage->orderRouteSize; orderId++) {
+		if (!pJobMetric->orderJob[orderId] || !pManage->orderRoute[orderId].order) {
+			continue;
+		}
+
+		pJSON* metricObj = pJson_CreateObject();
+		pJson_AddItemToObject(orderObj, pManage->orderRoute[orderId].order, metricObj);
+		pJson_AddNumberToObject(metricObj, "job", pJobMetric->orderJob[orderId] - 1);
+		pJson_AddNumberToObject(metricObj, "rollback", (double)pJobMetric->rollback[orderId]);
+		manage_HistogramToJson(metricObj, "exec", pJobMetric->exec[orderId]);
+		manage_HistogramToJson(metricObj, "wait", pJobMetric->wait[orderId]);
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	unsigned long long budget, resident, evict;
+	plg_CacheBudgetStat(&budget, &resident, &evict);
+	pJSON* cacheObj = pJson_CreateObject();
+	pJson_AddItemToObject(root, "cache", cacheObj);
+	pJson_AddNumberToObject(cacheObj, "budget", (double)budget);
+	pJson_AddNumberToObject(cacheObj, "resident", (double)resident);
+	pJson_AddNumberToObject(cacheObj, "evict", (double)evict);
+
+	if (plg_LocksIsProfile()) {
+		LockStat lockStat[LOCKS_MAXSTAT];
+		unsigned int lockSize = plg_LocksProfile(lockStat, LOCKS_MAXSTAT);
+		pJSON* lockObj = pJson_CreateObject();
+		pJson_AddItemToObject(root, "lock", lockObj);
+		for (unsigned int l = 0; l < lockSize; l++) {
+			pJSON* statObj = pJson_CreateObject();
+			pJson_AddItemToObject(lockObj, lockStat[l].name, statObj);
+			pJson_AddNumberToObject(statObj, "count", (double)lockStat[l].count);
+			pJson_AddNumberToObject(statObj, "contended", (double)lockStat[l].contended);
+			pJson_AddNumberToObject(statObj, "waitTime", (double)lockStat[l].waitTime);
+			pJson_AddNumberToObject(statObj, "maxWait", (double)lockStat[l].maxWait);
+			pJson_AddNumberToObject(statObj, "holdTime", (double)lockStat[l].holdTime);
+			pJson_AddNumberToObject(statObj, "maxHold", (double)lockStat[l].maxHold);
+		}
+	}
+	return root;
+}
+
+/*
+Writes the metrics of all jobs, see manage_MetricToJson.
+*/
+int plg_MngMetricsToJsonFile(void* pvManage, char* jsonPath) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	PJobMetric pJobMetric = manage_MetricCollect(pManage);
+	if (!pJobMetric) {
+		elog(log_error, "plg_MngMetricsToJsonFile.Jobs are not running");
+		return 0;
+	}
+
+	pJSON* root = manage_MetricToJson(pManage, pJobMetric);
+	manage_MetricDestroy(pJobMetric);
+	return manage_JsonToFile(root, jsonPath);
+}
+
+/*
+Metrics of an order over all jobs, latencies are nanoseconds.
+*/
+int plg_MngOrderStat(void* pvManage, char* order, short orderLen, POrderStat pOrderStat) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	unsigned int orderId = plg_MngOrderId(pManage, order, orderLen);
+	if (!orderId) {
+		elog(log_error, "plg_MngOrderStat.Order not found");
+		return 0;
+	}
+
+	PJobMetric pJobMetric = manage_MetricCollect(pManage);
+	if (!pJobMetric) {
+		elog(log_error, "plg_MngOrderStat.Jobs are not running");
+		return 0;
+	}
+
+	memset(pOrderStat, 0, sizeof(OrderStat));
+	if (orderId < pJobMetric->orderSize) {
+		void* exec = pJobMetric->exec[orderId];
+		void* wait = pJobMetric->wait[orderId];
+		pOrderStat->count = plg_HistogramCount(exec);
+		pOrderStat->rollback = pJobMetric->rollback[orderId];
+		pOrderStat->execMean = plg_HistogramMean(exec);
+		pOrderStat->execP50 = plg_HistogramPercentile(exec, 50);
+		pOrderStat->execP99 = plg_HistogramPercentile(exec, 99);
+		pOrderStat->execP999 = plg_HistogramPercentile(exec, 99.9);
+		pOrderStat->execMax = plg_HistogramMax(exec);
+		pOrderStat->waitMean = plg_HistogramMean(wait);
+		pOrderStat->waitP50 = plg_HistogramPercentile(wait, 50);
+		pOrderStat->waitP99 = plg_HistogramPercentile(wait, 99);
+		pOrderStat->waitP999 = plg_HistogramPercentile(wait, 99.9);
+		pOrderStat->waitMax = plg_HistogramMax(wait);
+	}
+	manage_MetricDestroy(pJobMetric);
+	return 1;
+}
+
+/*
+Writes the metrics to jsonPath every interval seconds while the jobs run, interval 0 stops it.
+The file is written by the manage job, the jobs are not waited for.
+*/
+int plg_MngSetMetricsDump(void* pvManage, char* jsonPath, unsigned int interval) {
+
+	CheckUsingThread(0);
+	PManage pManage = pvManage;
+	if (interval && !jsonPath) {
+		elog(log_error, "plg_MngSetMetricsDump.No path");
+		return 0;
+	}
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	plg_sdsFree(pManage->metricsPath);
+	pManage->metricsPath = interval ? plg_sdsNew(jsonPath) : 0;
+	pManage->metricsInterval = interval;
+	pManage->metricsGen += 1;
+	ManageMetricDump manageMetricDump = { pManage, pManage->metricsGen };
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	if (pManage->runStatus && interval) {
+		plg_JobSendControl(plg_JobEqueueHandle(pManage->pJobHandle), "metricsdump", (char*)&manageMetricDump, sizeof(ManageMetricDump));
+	}
+	return 1;
+}
+
+/*
+Profiles the wait and hold time of every mutex, the metrics then have a lock entry per lockName.
+The profile is process wide, all manage handles share it.
+*/
+void plg_MngSetLockProfile(void* pvManage, unsigned char profile) {
+
+	NOTUSED(pvManage);
+	plg_LocksSetProfile(profile);
+}
+
+/*
+Byte budget of the pages cached by all jobs, clean pages are evicted when it is exceeded.
+0 keeps the pages until they are not hit for 3 times the cache interval.
+The budget is process wide, all manage handles share it.
+*/
+void plg_MngSetCacheBudget(void* pvManage, unsigned long long budget) {
+
+	NOTUSED(pvManage);
+	plg_CacheSetBudget(budget);
+}
+
+void* plg_MngJobHandle(void* pvManage) {
+	PManage pManage = pvManage;
+	return pManage->pJobHandle;
+}
+
+/*
+ѭǶʱҪ,ܵͷʧܻ
+*/
+static int OrderDestroyCount(char* value, short valueLen) {
+	unsigned int run = 0;
+	PManageDestroy pManageDestroy = (PManageDestroy)value;
+	MutexLock(pManageDestroy->pManage->mutexHandle, pManageDestroy->pManage->objName);
+	if (valueLen == sizeof(ManageDestroy)) {
+		if (pManageDestroy->type == 1) {
+			pManageDestroy->pManage->jobDestroyCount += 1;
+			if (pManageDestroy->pManage->jobDestroyCount == listLength(pManageDestroy->pManage->listJob)) {
+				run = 1;
+			}			
+		}else if (pManageDestroy->type == 2) {
+			pManageDestroy->pManage->fileDestroyCount += 1;
+			if (pManageDestroy->pManage->fileDestroyCount == listLength(pManageDestroy->pManage->listDisk)) {
+				run = 2;
+			}
+		}
+	}
+	MutexUnlock(pManageDestroy->pManage->mutexHandle, pManageDestroy->pManage->objName);
+
+	if (run == 1) {
+		sleep(0);
+		pManageDestroy->fun(pManageDestroy->ptr);
+	} else if (run == 2) {
+		sleep(0);
+		pManageDestroy->fun(pManageDestroy->ptr);
+	}
+
+	return 1;
+}
+
+/*
+Starts a report of the metrics dump unless plg_MngSetMetricsDump or plg_MngStopJob came after the timer.
+*/
+static int OrderMetricDump(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PManageMetricDump pManageMetricDump = (PManageMetricDump)value;
+	PManage pManage = pManageMetricDump->pManage;
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	if (pManageMetricDump->generation != pManage->metricsGen || !pManage->runStatus || !pManage->metricsInterval) {
+		MutexUnlock(pManage->mutexHandle, pManage->objName);
+		return 1;
+	}
+
+	if (!listLength(pManage->listJob)) {
+		plg_JobAddAdmTimer(pManage->pJobHandle, pManage->metricsInterval * 1000, "metricsdump", value, valueLen);
+		MutexUnlock(pManage->mutexHandle, pManage->objName);
+		return 1;
+	}
+	PJobMetric pJobMetric = manage_MetricCreate(pManage, 0);
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	plg_JobSendControl(plg_JobEqueueHandle(pJobMetric->job[0]), "metricsreport", (char*)&pJobMetric, sizeof(PJobMetric));
+	return 1;
+}
+
+/*
+The last job of a metrics dump sends the report back here.
+*/
+static int OrderMetricWrite(char* value, short valueLen) {
+	NOTUSED(valueLen);
+	PJobMetric pJobMetric = *(PJobMetric*)value;
+	PManage pManage = pJobMetric->pManage;
+	ManageMetricDump manageMetricDump = { pManage, pJobMetric->generation };
+
+	MutexLock(pManage->mutexHandle, pManage->objName);
+	sds jsonPath = 0;
+	unsigned int interval = 0;
+	if (pJobMetric->generation == pManage->metricsGen && pManage->metricsPath) {
+		jsonPath = plg_sdsDup(pManage->metricsPath);
+		interval = pManage->metricsInterval;
+	}
+	MutexUnlock(pManage->mutexHandle, pManage->objName);
+
+	if (jsonPath) {
+		manage_JsonToFile(manage_MetricToJson(pManage, pJobMetric), jsonPath);
+		plg_sdsFree(jsonPath);
+		plg_JobAddAdmTimer(pManage->pJobHandle, interval * 1000, "metricsdump", (char*)&manageMetricDump, sizeof(ManageMetricDump));
+	}
+	manage_MetricDestroy(pJobMetric);
+	return 1;
+}
+
+static void manage_InternalDestoryHandle(void* pvManage, AfterDestroyFun fun, void* ptr, void* pEvent) {
+
+	PManage pManage = pvManage;
+	plg_MutexDestroyHandle(pManage->mutexHandle);
+	plg_listRelease(pManage->listDisk);
+	plg_listRelease(pManage->listJob);
+	plg_listRelease(pManage->listOrder);
+	plg_listRelease(pManage->listProcess);
+	plg_dictRelease(pManage->dictTableName);
+
+	plg_dictRelease(pManage->order_process);
+	plg_dictRelease(pManage->order_id);
+	manage_FreeOrderRoute(pManage);
+	free(pManage->orderLoad);
+	plg_dictRelease(pManage->tableName_jobHandle);
+	plg_dictRelease(pManage->order_job);
+	free(pManage->planCount);
+	free(pManage->planTime);
+	if (pManage->planTouch) {
+		plg_DictSetDestroy(pManage->planTouch);
+	}
+	free(pManage->jobCore);
+	free(pManage->fileCore);
 	plg_DictSetDestroy(pManage->order_tableName);
 	plg_dictRelease(pManage->tableName_diskHandle);
 	
@@ -815,6 +2367,9 @@ static void manage_InternalDestoryHandle(void* pvManage, AfterDestroyFun fun, vo
 	plg_sdsFree(pManage->luaDllPath);
 	plg_sdsFree(pManage->luaPath);
 	plg_sdsFree(pManage->dllPath);
+	plg_sdsFree(pManage->metricsPath);
+	plg_PacketPoolDestroy(pManage->packetPool);
+	plg_FuturePoolDestroy(pManage->futurePool);
 	free(pManage);
 	//user callback;
 	if (fun) {
@@ -899,7 +2454,29 @@ void* plg_MngCreateHandle(char* dbPath, short dbPahtLen) {
 	pManage->order_tableName = plg_DictSetCreate(plg_DefaultSdsDictPtr(), DICT_MIDDLE, plg_DefaultSdsDictPtr(), DICT_MIDDLE);
 	pManage->tableName_diskHandle = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
 	pManage->order_process = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
-	pManage->order_equeue = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pManage->order_id = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pManage->orderCount = 0;
+	pManage->orderRoute = 0;
+	pManage->orderRouteSize = 0;
+	pManage->tableName_jobHandle = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pManage->orderLoad = 0;
+	pManage->migrating = 0;
+	pManage->order_job = plg_dictCreate(plg_DefaultSdsDictPtr(), NULL, DICT_MIDDLE);
+	pManage->planCore = 0;
+	pManage->planCount = 0;
+	pManage->planTime = 0;
+	pManage->planTouch = 0;
+	pManage->jobCore = 0;
+	pManage->jobCoreSize = 0;
+	pManage->fileCore = 0;
+	pManage->fileCoreSize = 0;
+	pManage->commitCount = 0;
+	pManage->commitTime = 0;
+	pManage->queueHighWater = 0;
+	pManage->queuePolicy = QP_BLOCK;
+	pManage->metricsPath = 0;
+	pManage->metricsInterval = 0;
+	pManage->metricsGen = 0;
 	pManage->dbPath = plg_sdsNewLen(dbPath, dbPahtLen);
 	pManage->objName = plg_sdsNew("manage");
 	pManage->pJobHandle = plg_JobCreateHandle(0, TT_MANAGE, 0, 0, 0);
@@ -911,10 +2488,14 @@ void* plg_MngCreateHandle(char* dbPath, short dbPahtLen) {
 	pManage->luaDllPath = plg_sdsEmpty();
 	pManage->luaPath = plg_sdsEmpty();
 	pManage->dllPath = plg_sdsEmpty();
+	pManage->packetPool = plg_PacketPoolCreate();
+	pManage->futurePool = plg_FuturePoolCreate();
 	plg_LocksCreate();
 
 	//event process
 	plg_JobAddAdmOrderProcess(pManage->pJobHandle, "destroycount", plg_JobCreateFunPtr(OrderDestroyCount));
+	plg_JobAddAdmOrderProcess(pManage->pJobHandle, "metricsdump", plg_JobCreateFunPtr(OrderMetricDump));
+	plg_JobAddAdmOrderProcess(pManage->pJobHandle, "metricswrite", plg_JobCreateFunPtr(OrderMetricWrite));
 	return pManage;
 }
 
@@ -1007,14 +2588,14 @@ void plg_MngPrintAllJobDetails(void* pvManage) {
 void plg_MngPrintAllStatus(void* pvManage) {
 
 	PManage pManage = pvManage;
-	printf("ldisk:%d ljob:%d lorder:%d lprocess:%d dtable:%d order_process:%d o_equeue:%d o_table:%d table_disk:%d file_count:%d job_destroy_c:%d f_d_c:%d\n",
+	printf("ldisk:%d ljob:%d lorder:%d lprocess:%d dtable:%d order_process:%d o_id:%d o_table:%d table_disk:%d file_count:%d job_destroy_c:%d f_d_c:%d\n",
 		listLength(pManage->listDisk),
 		listLength(pManage->listJob),
 		listLength(pManage->listOrder),
 		listLength(pManage->listProcess),
 		dictSize(pManage->dictTableName),
 		dictSize(pManage->order_process),
-		dictSize(pManage->order_equeue),
+		dictSize(pManage->order_id),
 		plg_DictSetSize(pManage->order_tableName),
 		dictSize(pManage->tableName_diskHandle),
 		pManage->fileCount,
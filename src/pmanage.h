@@ -30,6 +30,7 @@ char plg_MngCheckUsingThread();
 int plg_MngSetTableParent(void* pManage, char* nameTable, short nameTableLen, char* parent, short parentLen);
 void plg_MngPrintAllDetails(void* pManage);
 int plg_MngInterAllocJob(void* pManage, unsigned int core, char* fileName);
+void plg_MngMigrateFinish(void* pManage);
 
 void plg_MngOutJson(char* fileName, char* outJson);
 void plg_MngFromJson(char* fromJson);
@@ -162,8 +162,9 @@ void* plg_MemListPop(void* pvMemoryListHandle) {
 		pMemoryListHandle->head = pMemoryListHandle->head->next;
 		pMemoryListHandle->length -= 1;
 	} else {
-		pMemoryListNode = malloc(pMemoryListHandle->size + sizeof(MemoryListNode));	
-		pMemoryListNode->next = 0;
+		//first written by the popping thread, so the pages are placed on the numa node of the owning job
+		pMemoryListNode = malloc(pMemoryListHandle->size + sizeof(MemoryListNode));
+		memset(pMemoryListNode, 0, pMemoryListHandle->size + sizeof(MemoryListNode));
 	}
 	plg_dictAdd(pMemoryListHandle->dictPop, pMemoryListNode, NULL);
 
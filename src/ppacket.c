@@ -0,0 +1,241 @@
+/* packet.c - Order packet recycling pool
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#include "plateform.h"
+#include "psds.h"
+#include "pinterface.h"
+#include "patomic.h"
+#include "ppacket.h"
+#include "pfuture.h"
+#include "ptimesys.h"
+#include "pelagia.h"
+
+/*
+A packet is one block: the OrderPacket head followed by the order and the value,
+both laid out as sds so the routing code can keep using plg_sdsLen on them.
+Packets that fit in PACKET_INLINESIZE come from the pool of the sending thread.
+Only the owner thread allocates from the pool and uses freeList.
+Any thread gives a packet back by pushing it on returnStack, the owner takes the
+whole stack at once when freeList runs dry, so there is no ABA problem.
+refCount is one for the owner plus one for every packet out of the pool,
+whoever drops it to zero releases the pool.
+*/
+#define PACKET_INLINESIZE 256
+#define PACKET_MAXFREE 1024
+
+typedef struct _PacketPool
+{
+	POrderPacket freeList;
+	unsigned int freeCount;
+	POrderPacket volatile returnStack;
+	volatile long long refCount;
+} *PPacketPool, PacketPool;
+
+/*
+The value of a PACKET_BUFFER packet, the buffer is not copied and belongs to the packet
+until it is freed, release is then called with it.
+It is stored unaligned behind the order name, so it is only read back with memcpy.
+*/
+typedef struct _PacketBuffer
+{
+	void* buffer;
+	unsigned long long bufferLen;
+	ReleaseBufferFun release;
+} *PPacketBuffer, PacketBuffer;
+
+#define PACKET_HEADSIZE (sizeof(OrderPacket) + sizeof(struct sdshdr16) + 1 + sizeof(struct sdshdr32) + 1)
+
+void* plg_PacketPoolCreate() {
+
+	PPacketPool pPacketPool = malloc(sizeof(PacketPool));
+	pPacketPool->freeList = 0;
+	pPacketPool->freeCount = 0;
+	pPacketPool->returnStack = 0;
+	pPacketPool->refCount = 1;
+	return pPacketPool;
+}
+
+static void packet_FreeList(POrderPacket pOrderPacket) {
+
+	while (pOrderPacket) {
+		POrderPacket next = pOrderPacket->next;
+		free(pOrderPacket);
+		pOrderPacket = next;
+	}
+}
+
+static void packet_PoolRelease(PPacketPool pPacketPool) {
+
+	if (plg_AtomicSub64(&pPacketPool->refCount, 1) == 0) {
+		packet_FreeList(pPacketPool->freeList);
+		packet_FreeList(pPacketPool->returnStack);
+		free(pPacketPool);
+	}
+}
+
+void plg_PacketPoolDestroy(void* pvPacketPool) {
+
+	PPacketPool pPacketPool = pvPacketPool;
+	if (pPacketPool) {
+		packet_PoolRelease(pPacketPool);
+	}
+}
+
+static POrderPacket packet_PoolPop(PPacketPool pPacketPool) {
+
+	if (!pPacketPool->freeList) {
+		//Keep at most PACKET_MAXFREE packets after a burst.
+		pPacketPool->freeList = plg_AtomicExchangePtr(&pPacketPool->returnStack, 0);
+		pPacketPool->freeCount = 0;
+		for (POrderPacket pOrderPacket = pPacketPool->freeList; pOrderPacket; pOrderPacket = pOrderPacket->next) {
+			if (++pPacketPool->freeCount == PACKET_MAXFREE) {
+				packet_FreeList(pOrderPacket->next);
+				pOrderPacket->next = 0;
+				break;
+			}
+		}
+	}
+
+	POrderPacket pOrderPacket = pPacketPool->freeList;
+	if (pOrderPacket) {
+		pPacketPool->freeList = pOrderPacket->next;
+		pPacketPool->freeCount -= 1;
+	} else {
+		pOrderPacket = malloc(PACKET_INLINESIZE);
+	}
+
+	plg_AtomicAdd64(&pPacketPool->refCount, 1);
+	pOrderPacket->pPacketPool = pPacketPool;
+	return pOrderPacket;
+}
+
+static sds packet_SetSds16(char* ptr, char* s, unsigned short len) {
+
+	struct sdshdr16* sh = (struct sdshdr16*)ptr;
+	sh->len = len;
+	sh->alloc = len;
+	sh->flags = SDS_TYPE_16;
+	if (len) {
+		memcpy(sh->buf, s, len);
+	}
+	sh->buf[len] = '\0';
+	return sh->buf;
+}
+
+static sds packet_SetSds32(char* ptr, char* s, unsigned int len) {
+
+	struct sdshdr32* sh = (struct sdshdr32*)ptr;
+	sh->len = len;
+	sh->alloc = len;
+	sh->flags = SDS_TYPE_32;
+	if (len) {
+		memcpy(sh->buf, s, len);
+	}
+	sh->buf[len] = '\0';
+	return sh->buf;
+}
+
+void* plg_PacketAlloc(void* pvPacketPool, unsigned int orderId, char* order, unsigned short orderLen, char* value, unsigned int valueLen) {
+
+	PPacketPool pPacketPool = pvPacketPool;
+	size_t size = PACKET_HEADSIZE + orderLen + valueLen;
+	POrderPacket pOrderPacket;
+	if (pPacketPool && size <= PACKET_INLINESIZE) {
+		pOrderPacket = packet_PoolPop(pPacketPool);
+	} else {
+		pOrderPacket = malloc(size);
+		pOrderPacket->pPacketPool = 0;
+	}
+
+	char* ptr = (char*)pOrderPacket + sizeof(OrderPacket);
+	pOrderPacket->order = packet_SetSds16(ptr, order, orderLen);
+	ptr += sizeof(struct sdshdr16) + orderLen + 1;
+	pOrderPacket->value = packet_SetSds32(ptr, value, valueLen);
+	pOrderPacket->orderId = orderId;
+	pOrderPacket->flags = 0;
+	pOrderPacket->next = 0;
+	pOrderPacket->pFuture = 0;
+	pOrderPacket->stamp = plg_GetCurrentNano();
+	pOrderPacket->ref = 1;
+	return pOrderPacket;
+}
+
+void* plg_PacketAllocBuffer(void* pvPacketPool, unsigned int orderId, char* order, unsigned short orderLen, void* buffer, unsigned long long bufferLen, void* release) {
+
+	PacketBuffer packetBuffer;
+	packetBuffer.buffer = buffer;
+	packetBuffer.bufferLen = bufferLen;
+	packetBuffer.release = release;
+
+	POrderPacket pOrderPacket = plg_PacketAlloc(pvPacketPool, orderId, order, orderLen, (char*)&packetBuffer, sizeof(PacketBuffer));
+	pOrderPacket->flags |= PACKET_BUFFER;
+	return pOrderPacket;
+}
+
+/*
+The buffer handed over by the packet, 0 if it is not a PACKET_BUFFER packet.
+*/
+void* plg_PacketBuffer(void* pvOrderPacket, unsigned long long* bufferLen) {
+
+	POrderPacket pOrderPacket = pvOrderPacket;
+	if (!(pOrderPacket->flags & PACKET_BUFFER)) {
+		return 0;
+	}
+
+	PacketBuffer packetBuffer;
+	memcpy(&packetBuffer, pOrderPacket->value, sizeof(PacketBuffer));
+	if (bufferLen) {
+		*bufferLen = packetBuffer.bufferLen;
+	}
+	return packetBuffer.buffer;
+}
+
+void plg_PacketFree(void* pvOrderPacket) {
+
+	POrderPacket pOrderPacket = pvOrderPacket;
+	if ((pOrderPacket->flags & PACKET_BROADCAST) && plg_AtomicSub32(&pOrderPacket->ref, 1) != 0) {
+		return;
+	}
+
+	if (pOrderPacket->flags & PACKET_BUFFER) {
+		PacketBuffer packetBuffer;
+		memcpy(&packetBuffer, pOrderPacket->value, sizeof(PacketBuffer));
+		if (packetBuffer.release) {
+			packetBuffer.release(packetBuffer.buffer, packetBuffer.bufferLen);
+		}
+	}
+
+	if (pOrderPacket->pFuture) {
+		plg_FutureComplete(pOrderPacket->pFuture);
+	}
+
+	PPacketPool pPacketPool = pOrderPacket->pPacketPool;
+	if (!pPacketPool) {
+		free(pOrderPacket);
+		return;
+	}
+
+	POrderPacket head;
+	do {
+		head = plg_AtomicLoadPtr(&pPacketPool->returnStack);
+		pOrderPacket->next = head;
+	} while (!plg_AtomicCasPtr(&pPacketPool->returnStack, head, pOrderPacket));
+
+	packet_PoolRelease(pPacketPool);
+}
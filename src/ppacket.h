@@ -0,0 +1,30 @@
+/* packet.h - Order packet recycling pool
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PACKET_H
+#define __PACKET_H
+
+void* plg_PacketPoolCreate();
+void plg_PacketPoolDestroy(void* pPacketPool);
+void* plg_PacketAlloc(void* pPacketPool, unsigned int orderId, char* order, unsigned short orderLen, char* value, unsigned int valueLen);
+void* plg_PacketAllocBuffer(void* pPacketPool, unsigned int orderId, char* order, unsigned short orderLen, void* buffer, unsigned long long bufferLen, void* release);
+void* plg_PacketBuffer(void* pOrderPacket, unsigned long long* bufferLen);
+void plg_PacketFree(void* pOrderPacket);
+
+#endif
@@ -48,6 +48,11 @@ static void EnumOrderJson(pJSON * root, void* pManage)
 	char* file = 0;
 	char* fun = 0;
 	int weight = -1;
+	int async = -1;
+	int job = -1;
+	char* coalesce = 0;
+	int broadcast = -1;
+	int readOnly = -1;
 	for (int i = 0; i < pJson_GetArraySize(root); i++)
 	{
 		pJSON * item = pJson_GetArrayItem(root, i);
@@ -60,19 +65,30 @@ static void EnumOrderJson(pJSON * root, void* pManage)
 				fun = item->valuestring;
 			} else if (strcmp(item->string, "weight") == 0) {
 				weight = item->valueint;
+			} else if (strcmp(item->string, "async") == 0) {
+				async = item->valueint;
+			} else if (strcmp(item->string, "job") == 0) {
+				job = item->valueint;
+			} else if (strcmp(item->string, "coalesce") == 0) {
+				coalesce = item->valuestring;
+			} else if (strcmp(item->string, "broadcast") == 0) {
+				broadcast = item->valueint;
+			} else if (strcmp(item->string, "readonly") == 0) {
+				readOnly = item->valueint;
 			}
 		}
 	}
 
+	//without orderType the order was added by plg_MngAddOrder, only tables and job are configured
 	void* process = 0;
-	if (strcmp(orderType, "lua") == 0) {
+	if (orderType && strcmp(orderType, "lua") == 0) {
 
 		if (!file || !fun) {
 			elog(log_error, "EnumOrderJson.lua:%s file or fun empty!", root->string);
 		}
 		process = plg_JobCreateLua(file, strlen(file), fun, strlen(fun));
 		plg_MngAddOrder(pManage, root->string, strlen(root->string), process);
-	} else if (strcmp(orderType, "dll") == 0) {
+	} else if (orderType && strcmp(orderType, "dll") == 0) {
 
 		if (!file || !fun) {
 			elog(log_error, "EnumOrderJson.dll:%s file or fun empty!", root->string);
@@ -81,10 +97,30 @@ static void EnumOrderJson(pJSON * root, void* pManage)
 		plg_MngAddOrder(pManage, root->string, strlen(root->string), process);
 	}
 
-	if (weight != -1) {
+	if (weight != -1 && process) {
 		plg_JobSetWeight(process, weight);
 	}
 
+	if (async != -1 && process) {
+		plg_JobSetAsync(process, async);
+	}
+
+	if (broadcast != -1 && process) {
+		plg_JobSetBroadcast(process, broadcast);
+	}
+
+	if (readOnly != -1 && process) {
+		plg_JobSetReadOnly(process, readOnly);
+	}
+
+	if (coalesce && process) {
+		plg_JobSetCoalesce(process, strcmp(coalesce, "latest") == 0 ? CM_LATEST : CM_SAME);
+	}
+
+	if (job != -1) {
+		plg_MngSetOrderJob(pManage, root->string, strlen(root->string), job);
+	}
+
 	for (int i = 0; i < pJson_GetArraySize(root); i++)
 	{
 		pJSON * item = pJson_GetArrayItem(root, i);
@@ -93,14 +129,44 @@ static void EnumOrderJson(pJSON * root, void* pManage)
 	}
 }
 
+/*
+Settings written as objects, they are not orders.
+*/
+static int EnumSettingJson(pJSON * item, void* pManage)
+{
+	if (strcmp(item->string, "GroupCommit") == 0) {
+		pJSON* count = pJson_GetObjectItem(item, "Count");
+		pJSON* time = pJson_GetObjectItem(item, "Time");
+		plg_MngSetGroupCommit(pManage, count ? count->valueint : 0, time ? time->valueint : 0);
+	} else 	if (strcmp(item->string, "QueueLimit") == 0) {
+		pJSON* highWater = pJson_GetObjectItem(item, "HighWater");
+		pJSON* policy = pJson_GetObjectItem(item, "Policy");
+		int queuePolicy = QP_BLOCK;
+		if (policy && policy->valuestring && strcmp(policy->valuestring, "busy") == 0) {
+			queuePolicy = QP_BUSY;
+		} else if (policy && policy->valuestring && strcmp(policy->valuestring, "shed") == 0) {
+			queuePolicy = QP_SHED;
+		}
+		plg_MngSetQueueLimit(pManage, highWater ? highWater->valueint : 0, queuePolicy);
+	} else 	if (strcmp(item->string, "MetricsDump") == 0) {
+		pJSON* path = pJson_GetObjectItem(item, "Path");
+		pJSON* interval = pJson_GetObjectItem(item, "Interval");
+		plg_MngSetMetricsDump(pManage, path ? path->valuestring : 0, interval ? interval->valueint : 0);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
 static void EnumJson(pJSON * root, void* pManage)
 {
 	for (int i = 0; i < pJson_GetArraySize(root); i++)
 	{
 		pJSON * item = pJson_GetArrayItem(root, i);
-		if (pJson_Object == item->type)      
-			EnumOrderJson(item, pManage);
-		else
+		if (pJson_Object == item->type) {
+			if (!EnumSettingJson(item, pManage))
+				EnumOrderJson(item, pManage);
+		} else
 		{
 			if (strcmp(item->string, "MaxTableWeight")==0) {
 				plg_MngSetMaxTableWeight(pManage, item->valueint);
@@ -110,6 +176,18 @@ static void EnumJson(pJSON * root, void* pManage)
 				plg_MngSetLuaDllPath(pManage, item->valuestring);
 			} else 	if (strcmp(item->string, "DllPath") == 0) {
 				plg_MngSetDllPath(pManage, item->valuestring);
+			} else 	if (strcmp(item->string, "LockProfile") == 0) {
+				plg_MngSetLockProfile(pManage, item->valueint);
+			} else 	if (strcmp(item->string, "CacheBudget") == 0) {
+				plg_MngSetCacheBudget(pManage, (unsigned long long)item->valuedouble);
+			} else 	if (strcmp(item->string, "JobCore") == 0) {
+				for (int c = 0; c < pJson_GetArraySize(item); c++) {
+					plg_MngSetJobCore(pManage, c, pJson_GetArrayItem(item, c)->valueint);
+				}
+			} else 	if (strcmp(item->string, "FileCore") == 0) {
+				for (int c = 0; c < pJson_GetArraySize(item); c++) {
+					plg_MngSetFileCore(pManage, c, pJson_GetArrayItem(item, c)->valueint);
+				}
 			}
 		}
 	}
@@ -62,6 +62,13 @@ typedef struct _SkipListPoint
 
 typedef SkipListPoint(ARRAY_SKIPLISTPOINT)[SKIPLIST_MAXLEVEL];
 
+/*
+Pages are written in place, a write first hands the bytes it is about to change to pageUndo
+so the transaction can put them back. page is 0 when ptr is in a TableInFile.
+*/
+#define TABLE_UNDO(h, page, ptr, len) (h)->pTableHandleCallBack->pageUndo((h)->pageOperateHandle, page, ptr, len)
+#define TABLE_UNDOVAR(h, page, var) TABLE_UNDO(h, page, &(var), sizeof(var))
+
 void* plg_TableCreateHandle(void* pTableInFile, void* pageOperateHandle, unsigned int pageSize,
 	sds	nameaTable, PTableHandleCallBack pTableHandleCallBack) {
 	assert(pTableInFile);
@@ -405,6 +412,7 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 	PDiskPageHead pUsingPageHead = 0;
 	PDiskTableUsingPage pDiskTableUsingPage = 0;
 	int emptySlot = -1;
+	void* nextPageBase = 0;
 
 	//Loop the using page to find the appropriate using. If not, create a using. Then create a table
 	do {
@@ -424,6 +432,12 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 			emptySlot = 0;
 
 			pUsingPageHead->prevPage = prevPage;
+			if (nextPageBase) {
+				TABLE_UNDOVAR(pTableHandle, nextPageBase, *nextPageAddr);
+			} else if (!pTableHandle->pTableInFile->isSetHead) {
+				pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
+				nextPageAddr = &pTableInFile->tableUsingPage;
+			}
 			*nextPageAddr = pUsingPageHead->addr;
 
 		} else {
@@ -449,6 +463,7 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 
 			if (noTry) {
 				PDiskPageHead pDiskPageHead = (PDiskPageHead)usingPage;
+				nextPageBase = usingPage;
 				nextPageAddr = &pDiskPageHead->nextPage;
 				prevPage = pDiskPageHead->addr;
 				continue;
@@ -524,6 +539,7 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 					nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, tableNextPageAddr, nextPage);
 
 					PDiskPageHead pDiskNextPageHead = (PDiskPageHead)nextPage;
+					TABLE_UNDOVAR(pTableHandle, nextPage, pDiskNextPageHead->prevPage);
 					pDiskNextPageHead->prevPage = pDiskPageHead->addr;
 					pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, tableNextPageAddr);
 				}
@@ -534,6 +550,8 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 				pDiskTablePage->spaceLength = FULLSIZE(pTableHandle->pageSize) - pDiskTablePage->spaceAddr;
 
 				//write to using page
+				TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+				TABLE_UNDOVAR(pTableHandle, usingPage, pDiskTableUsingPage->element[emptySlot]);
 				pDiskTableUsingPage->element[emptySlot].pageAddr = pDiskPageHead->addr;
 				pDiskTableUsingPage->element[emptySlot].spaceLength = pDiskTablePage->spaceLength;
 				pDiskTableUsingPage->usingPageLength += 1;
@@ -545,6 +563,7 @@ static unsigned int table_FindOrNewPage(void* pvTableHandle, unsigned short requ
 		}
 
 		PDiskPageHead pDiskPageHead = (PDiskPageHead)usingPage;
+		nextPageBase = usingPage;
 		nextPageAddr = &pDiskPageHead->nextPage;
 		prevPage = pDiskPageHead->addr;
 		continue;
@@ -566,7 +585,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 	if (pTableHandle->pTableInFile->isSetHead) {
 		pTableInFile = pTableHandle->pTableInFile;
 	} else {
-		pTableInFile = pTableHandle->pTableHandleCallBack->findTableInFile(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
+		pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
 	}
 	//find page
 	void* page;
@@ -588,6 +607,8 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 	PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskTablePage->usingPageOffset);
 
 	//clear in using page
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 	pDiskTableUsingPage->allSpace -= pDiskTableUsing->spaceLength;
 	pDiskTableUsing->pageAddr = 0;
 	pDiskTableUsing->spaceLength = 0;
@@ -602,6 +623,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 			prevUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->prevPage, prevUsingPage);
 
 			PDiskPageHead pPrevUsingPageHead = (PDiskPageHead)((unsigned char*)prevUsingPage);		
+			TABLE_UNDOVAR(pTableHandle, prevUsingPage, pPrevUsingPageHead->nextPage);
 			pPrevUsingPageHead->nextPage = pUsingPageHead->nextPage;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pPrevUsingPageHead->addr);
 
@@ -612,6 +634,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 				nextUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->nextPage, nextUsingPage);
 
 				PDiskPageHead pNextUsingPageHead = (PDiskPageHead)(nextUsingPage);
+				TABLE_UNDOVAR(pTableHandle, nextUsingPage, pNextUsingPageHead->prevPage);
 				pNextUsingPageHead->prevPage = pPrevUsingPageHead->addr;
 				pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextUsingPageHead->addr);
 			}
@@ -629,6 +652,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 				nextUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->nextPage, nextUsingPage);
 
 				PDiskPageHead pNextUsingPageHead = (PDiskPageHead)(nextUsingPage);
+				TABLE_UNDOVAR(pTableHandle, nextUsingPage, pNextUsingPageHead->prevPage);
 				pNextUsingPageHead->prevPage = 0;
 				pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextUsingPageHead->addr);
 			}
@@ -646,6 +670,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 		prevPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->prevPage, prevPage);
 
 		PDiskPageHead pPrevPageHead = (PDiskPageHead)prevPage;
+		TABLE_UNDOVAR(pTableHandle, prevPage, pPrevPageHead->nextPage);
 		pPrevPageHead->nextPage = pDiskPageHead->nextPage;
 		pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pPrevPageHead->addr);
 
@@ -657,6 +682,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 			nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->nextPage, nextPage);
 
 			PDiskPageHead pNextPageHead = (PDiskPageHead)nextPage;
+			TABLE_UNDOVAR(pTableHandle, nextPage, pNextPageHead->prevPage);
 			pNextPageHead->prevPage = pPrevPageHead->addr;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextPageHead->addr);
 		}
@@ -674,6 +700,7 @@ static unsigned int table_DelPage(void* pvTableHandle, unsigned int pageAddr) {
 			nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->nextPage, nextPage);
 
 			PDiskPageHead pNextPageHead = (PDiskPageHead)((unsigned char*)nextPage);
+			TABLE_UNDOVAR(pTableHandle, nextPage, pNextPageHead->prevPage);
 			pNextPageHead->prevPage = 0;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextPageHead->addr);
 		}
@@ -712,8 +739,10 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 	PDiskPageHead pDiskPageHead = (PDiskPageHead)((unsigned char*)tablePage);
 	PDiskTablePage pDiskTablePage = (PDiskTablePage)((unsigned char*)tablePage + sizeof(DiskPageHead));
 
+	TABLE_UNDOVAR(pTableHandle, tablePage, *pDiskTablePage);
 	//write pDiskTableKey
 	PDiskTableKey pDiskTableKey = (PDiskTableKey)POINTER(tablePage, pDiskTablePage->spaceAddr + pDiskTablePage->spaceLength - kvLength);
+	TABLE_UNDO(pTableHandle, tablePage, pDiskTableKey, kvLength);
 	pDiskTableKey->prevElementPage = (*skipListPoint)[0].skipListAddr;
 	pDiskTableKey->prevElementOffset = (*skipListPoint)[0].skipListOffset;
 	pDiskTableKey->valueType = valueType;
@@ -745,6 +774,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 			curLevel -= 1;
 
 			//set current element
+			TABLE_UNDOVAR(pTableHandle, tablePage, pDiskTablePage->element[l]);
 			pDiskTablePage->element[l].currentLevel = curLevel;
 			pDiskTablePage->element[l].keyOffset = OFFSET(tablePage, pDiskTableKey);
 
@@ -775,6 +805,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 			PDiskTableElement pPrevDiskTablePageElement = (*skipListPoint)[curLevel].pDiskTableElement;
 			pDiskTablePage->element[l].nextElementPage = pPrevDiskTablePageElement->nextElementPage;
 			pDiskTablePage->element[l].nextElementOffset = pPrevDiskTablePageElement->nextElementOffset;
+			TABLE_UNDOVAR(pTableHandle, (*skipListPoint)[curLevel].skipListAddr ? (*skipListPoint)[curLevel].page : 0, *pPrevDiskTablePageElement);
 			pPrevDiskTablePageElement->nextElementPage = pDiskPageHead->addr;
 			pPrevDiskTablePageElement->nextElementOffset = OFFSET(tablePage, &pDiskTablePage->element[l]);
 
@@ -785,6 +816,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 				if (page != 0) {
 					PDiskTableElement pDiskTableElement = (PDiskTableElement)POINTER(page, pDiskTablePage->element[l].nextElementOffset);
 					PDiskTableKey pDiskTableKey = (PDiskTableKey)POINTER(page, pDiskTableElement->keyOffset);
+					TABLE_UNDOVAR(pTableHandle, page, *pDiskTableKey);
 					pDiskTableKey->prevElementPage = pPrevDiskTablePageElement->nextElementPage;
 					pDiskTableKey->prevElementOffset = pPrevDiskTablePageElement->nextElementOffset;
 				}
@@ -814,6 +846,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 		assert(!pDiskTablePage->element[l].keyOffset);
 		//set current element
 		curLevel -= 1;
+		TABLE_UNDOVAR(pTableHandle, tablePage, pDiskTablePage->element[l]);
 		pDiskTablePage->element[l].currentLevel = curLevel;
 		pDiskTablePage->element[l].keyOffset = OFFSET(tablePage, pDiskTableKey);
 
@@ -841,6 +874,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 		PDiskTableElement pPrevDiskTablePageElement = (*skipListPoint)[curLevel].pDiskTableElement;
 		pDiskTablePage->element[l].nextElementPage = pPrevDiskTablePageElement->nextElementPage;
 		pDiskTablePage->element[l].nextElementOffset = pPrevDiskTablePageElement->nextElementOffset;
+		TABLE_UNDOVAR(pTableHandle, (*skipListPoint)[curLevel].skipListAddr ? (*skipListPoint)[curLevel].page : 0, *pPrevDiskTablePageElement);
 		pPrevDiskTablePageElement->nextElementPage = pDiskPageHead->addr;
 		pPrevDiskTablePageElement->nextElementOffset = OFFSET(tablePage, &pDiskTablePage->element[l]);
 
@@ -851,6 +885,7 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 			if (page != 0) {
 				PDiskTableElement pDiskTableElement = (PDiskTableElement)POINTER(page, pDiskTablePage->element[l].nextElementOffset);
 				PDiskTableKey pDiskTableKey = (PDiskTableKey)POINTER(page, pDiskTableElement->keyOffset);
+				TABLE_UNDOVAR(pTableHandle, page, *pDiskTableKey);
 				pDiskTableKey->prevElementPage = pPrevDiskTablePageElement->nextElementPage;
 				pDiskTableKey->prevElementOffset = pPrevDiskTablePageElement->nextElementOffset;
 			}
@@ -880,6 +915,8 @@ static unsigned int table_InsideNew(void* pvTableHandle, char* key, unsigned sho
 	PDiskTableUsingPage pDiskTableUsingPage = (PDiskTableUsingPage)((unsigned char*)usingPage + sizeof(DiskPageHead));
 	PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskTablePage->usingPageOffset);
 
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 	pDiskTableUsingPage->allSpace += (int)pDiskTablePage->spaceLength - pDiskTableUsing->spaceLength;
 	pDiskTableUsing->spaceLength = pDiskTablePage->spaceLength;
 	pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskTablePage->usingPageAddr);
@@ -1003,6 +1040,9 @@ static unsigned int table_CreateValuePage(void* pvTableHandle, PTableInFile pTab
 
 	PTableHandle pTableHandle = pvTableHandle;
 	unsigned int tableNextPageAddr;
+	if (!pTableHandle->pTableInFile->isSetHead) {
+		pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
+	}
 	tableNextPageAddr = pTableInFile->valuePage;
 	pTableHandle->hitStamp = plg_GetCurrentSec();
 	
@@ -1030,6 +1070,7 @@ static unsigned int table_CreateValuePage(void* pvTableHandle, PTableInFile pTab
 			nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, tableNextPageAddr, nextPage);
 
 			PDiskPageHead pDiskNextPageHead = (PDiskPageHead)nextPage;
+			TABLE_UNDOVAR(pTableHandle, nextPage, pDiskNextPageHead->prevPage);
 			pDiskNextPageHead->prevPage = pDiskPageHead->addr;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, tableNextPageAddr);
 		}
@@ -1040,6 +1081,8 @@ static unsigned int table_CreateValuePage(void* pvTableHandle, PTableInFile pTab
 		pDiskValuePage->valueSpaceLength = FULLSIZE(pTableHandle->pageSize) - pDiskValuePage->valueSpaceAddr;
 
 		//write to using page
+		TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+		TABLE_UNDOVAR(pTableHandle, usingPage, pDiskTableUsingPage->element[emptySlot]);
 		pDiskTableUsingPage->element[emptySlot].pageAddr = pDiskPageHead->addr;
 		pDiskTableUsingPage->element[emptySlot].spaceLength = pDiskValuePage->valueSpaceLength;
 		pDiskTableUsingPage->usingPageLength += 1;
@@ -1066,6 +1109,7 @@ static unsigned int table_ValueFindOrNewPage(void* pvTableHandle, unsigned short
 	PDiskPageHead pUsingPageHead = 0;
 	PDiskTableUsingPage pDiskTableUsingPage = 0;
 	int emptySlot = -1;
+	void* nextPageBase = 0;
 
 	//Loop the using page to find the appropriate using. If not, create a using. Then create a value
 	do {
@@ -1084,6 +1128,12 @@ static unsigned int table_ValueFindOrNewPage(void* pvTableHandle, unsigned short
 			emptySlot = 0;
 
 			pUsingPageHead->prevPage = prevPage;
+			if (nextPageBase) {
+				TABLE_UNDOVAR(pTableHandle, nextPageBase, *nextPageAddr);
+			} else if (!pTableHandle->pTableInFile->isSetHead) {
+				pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
+				nextPageAddr = &pTableInFile->valueUsingPage;
+			}
 			*nextPageAddr = pUsingPageHead->addr;
 
 		} else {
@@ -1109,6 +1159,7 @@ static unsigned int table_ValueFindOrNewPage(void* pvTableHandle, unsigned short
 
 			if (noTry) {
 				PDiskPageHead pDiskPageHead = (PDiskPageHead)usingPage;
+				nextPageBase = usingPage;
 				nextPageAddr = &pDiskPageHead->nextPage;
 				prevPage = pDiskPageHead->addr;
 				continue;
@@ -1153,6 +1204,7 @@ static unsigned int table_ValueFindOrNewPage(void* pvTableHandle, unsigned short
 
 		//next page
 		PDiskPageHead pDiskPageHead = (PDiskPageHead)usingPage;
+		nextPageBase = usingPage;
 		nextPageAddr = &pDiskPageHead->nextPage;
 		prevPage = pDiskPageHead->addr;
 
@@ -1169,6 +1221,7 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 	unsigned int curLen = valueLen;
 	unsigned int savaSize = FULLSIZE(pTableHandle->pageSize) - (sizeof(DiskPageHead) + sizeof(DiskValuePage) + sizeof(DiskValueElement) + sizeof(DiskBigValue));
 	PDiskValueElement prevValueElement = 0;
+	void* prevValuePage = 0;
 	pDiskKeyBigValue->valuePageAddr = 0;
 	pDiskKeyBigValue->valueOffset = 0;
 	pDiskKeyBigValue->crc = plg_crc16(value, valueLen);
@@ -1185,6 +1238,8 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 			PDiskValuePage pDiskValuePage = (PDiskValuePage)((unsigned char*)valuePage + sizeof(DiskPageHead));
 			PDiskBigValue valuePtr = (PDiskBigValue)((unsigned char*)pDiskValuePage->valueElement + sizeof(DiskValueElement));
 			
+			TABLE_UNDOVAR(pTableHandle, valuePage, *pDiskValuePage);
+			TABLE_UNDO(pTableHandle, valuePage, pDiskValuePage->valueElement, sizeof(DiskValueElement) + sizeof(DiskBigValue) + savaSize);
 			valuePtr->valueSize = savaSize;
 			memcpy(valuePtr->valueBuff, curPtr, savaSize);
 			pDiskValuePage->valueElement[0].valueOffset = OFFSET(valuePage, valuePtr);
@@ -1200,9 +1255,11 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 			}
 
 			if (prevValueElement != 0) {
+				TABLE_UNDOVAR(pTableHandle, prevValuePage, *prevValueElement);
 				prevValueElement->nextElementPage = pDiskPageHead->addr;
 				prevValueElement->nextElementOffset = OFFSET(valuePage, &pDiskValuePage->valueElement[0]);
 			}
+			prevValuePage = valuePage;
 			prevValueElement = &pDiskValuePage->valueElement[0];
 
 			pDiskValuePage->valueSpaceAddr = OFFSET(valuePage, valuePtr);
@@ -1220,6 +1277,8 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 			PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskValuePage->valueUsingPageOffset);
 			PDiskTableUsingPage pDiskTableUsingPage = (PDiskTableUsingPage)((unsigned char*)usingPage + sizeof(DiskPageHead));
 			
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 			pDiskTableUsingPage->allSpace += (int)pDiskTableUsing->spaceLength - (int)pDiskValuePage->valueSpaceLength;	
 			pDiskTableUsing->spaceLength = pDiskValuePage->valueSpaceLength;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskValuePage->valueUsingPageAddr);
@@ -1240,6 +1299,8 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 		PDiskValuePage pDiskValuePage = (PDiskValuePage)((unsigned char*)valuePage + sizeof(DiskPageHead));
 
 		PDiskBigValue valuePtr = (PDiskBigValue)POINTER(valuePage, pDiskValuePage->valueSpaceAddr + pDiskValuePage->valueSpaceLength) - (sizeof(DiskBigValue) + curLen);
+		TABLE_UNDOVAR(pTableHandle, valuePage, *pDiskValuePage);
+		TABLE_UNDO(pTableHandle, valuePage, valuePtr, sizeof(DiskBigValue) + curLen);
 		memcpy(valuePtr->valueBuff, curPtr, curLen);
 		valuePtr->valueSize = curLen;
 
@@ -1266,11 +1327,13 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 			pDiskKeyBigValue->valueOffset = OFFSET(valuePage, &pDiskValuePage->valueElement[emptySlot]);
 		}
 
+		TABLE_UNDOVAR(pTableHandle, valuePage, pDiskValuePage->valueElement[emptySlot]);
 		pDiskValuePage->valueElement[emptySlot].valueOffset = OFFSET(valuePage, valuePtr);
 		pDiskValuePage->valueElement[emptySlot].nextElementPage = 0;
 		pDiskValuePage->valueElement[emptySlot].nextElementOffset = 0;
 
 		if (prevValueElement != 0) {
+			TABLE_UNDOVAR(pTableHandle, prevValuePage, *prevValueElement);
 			prevValueElement->nextElementPage = pDiskPageHead->addr;
 			prevValueElement->nextElementOffset = OFFSET(valuePage, &pDiskValuePage->valueElement[emptySlot]);
 		}
@@ -1290,6 +1353,8 @@ unsigned int plg_TableNewBigValue(void* pvTableHandle, char* value, unsigned int
 		PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskValuePage->valueUsingPageOffset);
 		PDiskTableUsingPage pDiskTableUsingPage = (PDiskTableUsingPage)((unsigned char*)usingPage + sizeof(DiskPageHead));
 		
+		TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+		TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 		pDiskTableUsingPage->allSpace += (int)pDiskTableUsing->spaceLength - (int)pDiskValuePage->valueSpaceLength;
 		pDiskTableUsing->spaceLength = pDiskValuePage->valueSpaceLength;
 		pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskValuePage->valueUsingPageAddr);
@@ -1306,7 +1371,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 	if (pTableHandle->pTableInFile->isSetHead) {
 		pTableInFile = pTableHandle->pTableInFile;
 	} else {
-		pTableInFile = pTableHandle->pTableHandleCallBack->findTableInFile(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
+		pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
 	}
 	//find page
 	void* page;
@@ -1328,6 +1393,8 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 	PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskValuePage->valueUsingPageOffset);
 
 	//clear in using page
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+	TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 	pDiskTableUsingPage->allSpace -= pDiskTableUsing->spaceLength;
 	pDiskTableUsing->pageAddr = 0;
 	pDiskTableUsing->spaceLength = 0;
@@ -1342,6 +1409,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 			prevUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->prevPage, prevUsingPage);
 
 			PDiskPageHead pPrevUsingPageHead = (PDiskPageHead)((unsigned char*)prevUsingPage);
+			TABLE_UNDOVAR(pTableHandle, prevUsingPage, pPrevUsingPageHead->nextPage);
 			pPrevUsingPageHead->nextPage = pUsingPageHead->nextPage;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pPrevUsingPageHead->addr);
 
@@ -1352,6 +1420,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 				nextUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->nextPage, nextUsingPage);
 
 				PDiskPageHead pNextUsingPageHead = (PDiskPageHead)(nextUsingPage);
+				TABLE_UNDOVAR(pTableHandle, nextUsingPage, pNextUsingPageHead->prevPage);
 				pNextUsingPageHead->prevPage = pPrevUsingPageHead->addr;
 				pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextUsingPageHead->addr);
 			}
@@ -1369,6 +1438,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 				nextUsingPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pUsingPageHead->nextPage, nextUsingPage);
 
 				PDiskPageHead pNextUsingPageHead = (PDiskPageHead)(nextUsingPage);
+				TABLE_UNDOVAR(pTableHandle, nextUsingPage, pNextUsingPageHead->prevPage);
 				pNextUsingPageHead->prevPage = 0;
 				pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextUsingPageHead->addr);
 			}
@@ -1386,6 +1456,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 		prevPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->prevPage, prevPage);
 
 		PDiskPageHead pPrevPageHead = (PDiskPageHead)prevPage;
+		TABLE_UNDOVAR(pTableHandle, prevPage, pPrevPageHead->nextPage);
 		pPrevPageHead->nextPage = pDiskPageHead->nextPage;
 		pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pPrevPageHead->addr);
 
@@ -1397,6 +1468,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 			nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->nextPage, nextPage);
 
 			PDiskPageHead pNextPageHead = (PDiskPageHead)nextPage;
+			TABLE_UNDOVAR(pTableHandle, nextPage, pNextPageHead->prevPage);
 			pNextPageHead->prevPage = pPrevPageHead->addr;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextPageHead->addr);
 		}
@@ -1414,6 +1486,7 @@ static unsigned int table_DelValuePage(void* pvTableHandle, unsigned int pageAdd
 			nextPage = pTableHandle->pTableHandleCallBack->pageCopyOnWrite(pTableHandle->pageOperateHandle, pDiskPageHead->nextPage, nextPage);
 
 			PDiskPageHead pNextPageHead = (PDiskPageHead)((unsigned char*)nextPage);
+			TABLE_UNDOVAR(pTableHandle, nextPage, pNextPageHead->prevPage);
 			pNextPageHead->prevPage = 0;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pNextPageHead->addr);
 		}
@@ -1448,6 +1521,9 @@ static int table_DelBigValue(void* pvTableHandle, PDiskKeyBigValue pDiskKeyBigVa
 		PDiskValuePage pDiskValuePage = (PDiskValuePage)((unsigned char*)valuePage + sizeof(DiskPageHead));
 		PDiskValueElement pDiskValueElement = (PDiskValueElement)POINTER(valuePage, nextOffset);
 		PDiskBigValue valuePtr = (PDiskBigValue)POINTER(valuePage, pDiskValueElement->valueOffset);
+		TABLE_UNDOVAR(pTableHandle, valuePage, *pDiskValuePage);
+		TABLE_UNDOVAR(pTableHandle, valuePage, *pDiskValueElement);
+		TABLE_UNDO(pTableHandle, valuePage, valuePtr, valuePtr->valueSize);
 		memset(valuePtr, 0, valuePtr->valueSize);
 
 		if (pDiskValueElement == &pDiskValuePage->valueElement[pDiskValuePage->valueLength - 1]) {
@@ -1475,6 +1551,8 @@ static int table_DelBigValue(void* pvTableHandle, PDiskKeyBigValue pDiskKeyBigVa
 			PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskValuePage->valueUsingPageOffset);
 			PDiskTableUsingPage pDiskTableUsingPage = (PDiskTableUsingPage)((unsigned char*)usingPage + sizeof(DiskPageHead));
 
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 			pDiskTableUsingPage->allSpace += (int)pDiskTableUsing->spaceLength - (int)pDiskValuePage->valueSpaceLength;
 			pDiskTableUsing->spaceLength = pDiskValuePage->valueSpaceLength;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskValuePage->valueUsingPageAddr);
@@ -1616,11 +1694,13 @@ static unsigned int table_InsideAlter(void* pvTableHandle, char* key, unsigned s
 			return 0;
 		}
 
+		TABLE_UNDO(pTableHandle, page, pDiskTableKey, sizeof(DiskTableKey) + pDiskTableKey->keyStrSize + pDiskTableKey->valueSize);
 		pDiskTableKey->valueSize = length;
 		memcpy(vluePtr, value, length);
 
 		PDiskPageHead pDiskPageHead = (PDiskPageHead)((unsigned char*)page);
 		PDiskTablePage pDiskTablePage = (PDiskTablePage)((unsigned char*)page + sizeof(DiskPageHead));
+		TABLE_UNDOVAR(pTableHandle, page, pDiskTablePage->usingLength);
 		pDiskTablePage->usingLength -= (pDiskTableKey->valueSize - length);
 
 		pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskPageHead->addr);
@@ -1676,11 +1756,13 @@ static unsigned int table_InsideAlterFroSet(void* pvTableHandle, char* key, unsi
 	//Because the deletion of other sets will cause table cleaning.
 	if (pDiskTableKey->valueType == VALUE_SETHEAD)  {
 
+		TABLE_UNDO(pTableHandle, page, pDiskTableKey, sizeof(DiskTableKey) + pDiskTableKey->keyStrSize + pDiskTableKey->valueSize);
 		pDiskTableKey->valueSize = length;
 		memcpy(vluePtr, value, length);
 
 		PDiskPageHead pDiskPageHead = (PDiskPageHead)((unsigned char*)page);
 		PDiskTablePage pDiskTablePage = (PDiskTablePage)((unsigned char*)page + sizeof(DiskPageHead));
+		TABLE_UNDOVAR(pTableHandle, page, pDiskTablePage->usingLength);
 		pDiskTablePage->usingLength -= (pDiskTableKey->valueSize - length);
 
 		pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskPageHead->addr);
@@ -1827,6 +1909,8 @@ static unsigned int table_InsideDel(void* pvTableHandle, char* key, unsigned sho
 			break;
 		}
 
+		TABLE_UNDO(pTableHandle, nextPage, pDiskTableKey, keyVlaueSize);
+		TABLE_UNDOVAR(pTableHandle, nextPage, *pDiskTablePage);
 		if (pDiskTableKey->valueType == VALUE_BIGVALUE) {
 			PDiskKeyBigValue pDiskKeyBigValue = (PDiskKeyBigValue)vluePtr;
 			table_DelBigValue(pTableHandle, pDiskKeyBigValue);
@@ -1866,6 +1950,7 @@ static unsigned int table_InsideDel(void* pvTableHandle, char* key, unsigned sho
 			}
 			tailPoint[pHighElement->currentLevel].addr = pHighElement->nextElementPage;
 			tailPoint[pHighElement->currentLevel].offset = pHighElement->nextElementOffset;
+			TABLE_UNDOVAR(pTableHandle, nextPage, *pHighElement);
 			memset(pHighElement, 0, sizeof(DiskTableElement));
 
 			pDiskTablePage->tableLength -= 1;
@@ -1905,6 +1990,8 @@ static unsigned int table_InsideDel(void* pvTableHandle, char* key, unsigned sho
 			PDiskTableUsingPage pDiskTableUsingPage = (PDiskTableUsingPage)((unsigned char*)usingPage + sizeof(DiskPageHead));
 			PDiskTableUsing pDiskTableUsing = (PDiskTableUsing)POINTER(usingPage, pDiskTablePage->usingPageOffset);
 			
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsingPage);
+			TABLE_UNDOVAR(pTableHandle, usingPage, *pDiskTableUsing);
 			pDiskTableUsingPage->allSpace += (int)pDiskTablePage->spaceLength - pDiskTableUsing->spaceLength;
 			pDiskTableUsing->spaceLength = pDiskTablePage->spaceLength;
 			pTableHandle->pTableHandleCallBack->addDirtyPage(pTableHandle->pageOperateHandle, pDiskTablePage->usingPageAddr);
@@ -1938,6 +2025,7 @@ static unsigned int table_InsideDel(void* pvTableHandle, char* key, unsigned sho
 			}
 
 			PDiskTableElement pDiskTableElement = (*pSkipListPoint)[l].pDiskTableElement;
+			TABLE_UNDOVAR(pTableHandle, (*pSkipListPoint)[l].skipListAddr ? (*pSkipListPoint)[l].page : 0, *pDiskTableElement);
 			pDiskTableElement->nextElementPage = tailPoint[l].addr;
 			pDiskTableElement->nextElementOffset = tailPoint[l].offset;
 
@@ -1948,6 +2036,7 @@ static unsigned int table_InsideDel(void* pvTableHandle, char* key, unsigned sho
 				if (page != 0) {
 					PDiskTableElement pNextDiskTableElement = (PDiskTableElement)POINTER(page, tailPoint[l].offset);
 					PDiskTableKey pDiskTableKey = (PDiskTableKey)POINTER(page, pNextDiskTableElement->keyOffset);
+					TABLE_UNDOVAR(pTableHandle, page, *pDiskTableKey);
 					pDiskTableKey->prevElementPage = pDiskTableElement->nextElementPage;
 					pDiskTableKey->prevElementOffset = pDiskTableElement->nextElementOffset;
 				}
@@ -2691,15 +2780,21 @@ void plg_TableClear(void* pvTableHandle, short recursive) {
 	if (recursive) {
 		PDiskTableKey pDiskTableKey = 0;
 		PTableIterator iter = plg_TableGetIteratorWithKey(pTableHandle, NULL);
+		unsigned int elementPage = iter->elementPage;
 		while ((pDiskTableKey = plg_TableNextIterator(iter)) != NULL) {
 			if (pDiskTableKey->valueType == VALUE_SETHEAD) {
 				void* vluePtr = (unsigned char*)pDiskTableKey + sizeof(DiskTableKey) + pDiskTableKey->keyStrSize;
 				PTableInFile pTableInFile = (PTableInFile)vluePtr;
+				void* page;
+				if (pTableHandle->pTableHandleCallBack->findPage(pTableHandle->pageOperateHandle, elementPage, &page)) {
+					TABLE_UNDO(pTableHandle, page, pTableInFile, sizeof(TableInFile));
+				}
 				PTableInFile pRecTableInFile = pTableHandle->pTableInFile;
 				pTableHandle->pTableInFile = pTableInFile;
 				plg_TableClear(pTableHandle, 0);
 				pTableHandle->pTableInFile = pRecTableInFile;
 			}
+			elementPage = iter->elementPage;
 		}
 		plg_TableReleaseIterator(iter);
 		pTableInFile = pTableHandle->pTableHandleCallBack->tableCopyOnWrite(pTableHandle->pageOperateHandle, pTableHandle->nameaTable, pTableHandle->pTableInFile);
@@ -32,6 +32,7 @@ typedef struct _TableHandleCallBack {
 	void*(*tableCopyOnWrite)(void* pageOperateHandle, sds table, void* tableInFile);
 	void(*addDirtyTable)(void* pageOperateHandle, sds table);
 	void*(*findTableInFile)(void* pageOperateHandle, sds table, void* tableInFile);
+	void(*pageUndo)(void* pageOperateHandle, void* page, void* ptr, unsigned int length);
 }*PTableHandleCallBack, TableHandleCallBack;
 
 void* plg_TableCreateHandle(void* pTableInFile, void* pageOperateHandle, unsigned int pageSize,
@@ -60,6 +60,26 @@ unsigned long long plg_GetCurrentSec()
 #endif
 }
 
+/*
+Monotonic clock for measuring intervals, not related to the calendar time.
+*/
+unsigned long long plg_GetCurrentNano()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000 + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 void plg_GetTime(long long *sec, int *usec)
 {
 #ifdef _WIN32
@@ -32,6 +32,7 @@ void usleep(unsigned long usec);
 
 unsigned long long plg_GetCurrentMilli();
 unsigned long long plg_GetCurrentSec();
+unsigned long long plg_GetCurrentNano();
 void plg_GetTime(long long *sec, int *usec);
 
 #endif
\ No newline at end of file
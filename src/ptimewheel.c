@@ -0,0 +1,272 @@
+/* timewheel.c - Hierarchical timing wheel with millisecond ticks
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+
+#include "plateform.h"
+#include "ptimewheel.h"
+
+/*
+Five levels like the kernel timer: 256 slots of one millisecond,
+then four levels of 64 slots, each slot covering a whole lap of the level below.
+Timers are nodes of one array linked by index, so a handle is the index with a generation
+in the high word, which makes cancel O(1) and a stale handle harmless.
+current: the next tick to run, all timers before it have been run.
+A timer further than 2^32 ms waits in the top level and is linked again when it comes down.
+*/
+#define TW_ROOTBITS 8
+#define TW_LEVELBITS 6
+#define TW_ROOTSIZE (1 << TW_ROOTBITS)
+#define TW_LEVELSIZE (1 << TW_LEVELBITS)
+#define TW_LEVELS 4
+#define TW_SLOTS (TW_ROOTSIZE + TW_LEVELS * TW_LEVELSIZE)
+#define TW_MAXTICK 0xffffffffULL
+#define TW_NIL 0xffffffff
+
+typedef struct _TimerNode
+{
+	unsigned long long expire;
+	void* ptr;
+	unsigned int prev;
+	unsigned int next;
+	unsigned int slot;
+	unsigned int generation;
+} *PTimerNode, TimerNode;
+
+typedef struct _TimeWheel
+{
+	unsigned long long current;
+	unsigned int count;
+	unsigned int freeNode;
+	unsigned int nodeSize;
+	PTimerNode nodes;
+	unsigned int slot[TW_SLOTS];
+} *PTimeWheel, TimeWheel;
+
+void* plg_TimeWheelCreate(unsigned long long milli) {
+
+	PTimeWheel pTimeWheel = malloc(sizeof(TimeWheel));
+	pTimeWheel->current = milli;
+	pTimeWheel->count = 0;
+	pTimeWheel->freeNode = TW_NIL;
+	pTimeWheel->nodeSize = 0;
+	pTimeWheel->nodes = 0;
+	for (unsigned int l = 0; l < TW_SLOTS; l++) {
+		pTimeWheel->slot[l] = TW_NIL;
+	}
+	return pTimeWheel;
+}
+
+void plg_TimeWheelDestroy(void* pvTimeWheel, TimeWheelFun freeFun, void* ctx) {
+
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	if (freeFun) {
+		for (unsigned int l = 0; l < pTimeWheel->nodeSize; l++) {
+			if (pTimeWheel->nodes[l].slot != TW_NIL) {
+				freeFun(pTimeWheel->nodes[l].ptr, ctx);
+			}
+		}
+	}
+	free(pTimeWheel->nodes);
+	free(pTimeWheel);
+}
+
+static void timewheel_Link(PTimeWheel pTimeWheel, unsigned int index) {
+
+	PTimerNode pTimerNode = &pTimeWheel->nodes[index];
+	unsigned long long expire = pTimerNode->expire;
+	if (expire < pTimeWheel->current) {
+		expire = pTimeWheel->current;
+	}
+
+	unsigned long long tick = expire - pTimeWheel->current;
+	unsigned int slot;
+	if (tick < TW_ROOTSIZE) {
+		slot = expire & (TW_ROOTSIZE - 1);
+	} else {
+		if (tick > TW_MAXTICK) {
+			expire = pTimeWheel->current + TW_MAXTICK;
+		}
+
+		unsigned int level = 1;
+		while (level < TW_LEVELS && tick >= (1ULL << (TW_ROOTBITS + level * TW_LEVELBITS))) {
+			level++;
+		}
+		slot = TW_ROOTSIZE + (level - 1) * TW_LEVELSIZE + ((expire >> (TW_ROOTBITS + (level - 1) * TW_LEVELBITS)) & (TW_LEVELSIZE - 1));
+	}
+
+	pTimerNode->slot = slot;
+	pTimerNode->prev = TW_NIL;
+	pTimerNode->next = pTimeWheel->slot[slot];
+	if (pTimerNode->next != TW_NIL) {
+		pTimeWheel->nodes[pTimerNode->next].prev = index;
+	}
+	pTimeWheel->slot[slot] = index;
+}
+
+static void timewheel_Unlink(PTimeWheel pTimeWheel, unsigned int index) {
+
+	PTimerNode pTimerNode = &pTimeWheel->nodes[index];
+	if (pTimerNode->prev != TW_NIL) {
+		pTimeWheel->nodes[pTimerNode->prev].next = pTimerNode->next;
+	} else {
+		pTimeWheel->slot[pTimerNode->slot] = pTimerNode->next;
+	}
+	if (pTimerNode->next != TW_NIL) {
+		pTimeWheel->nodes[pTimerNode->next].prev = pTimerNode->prev;
+	}
+	pTimerNode->slot = TW_NIL;
+}
+
+static void* timewheel_FreeNode(PTimeWheel pTimeWheel, unsigned int index) {
+
+	PTimerNode pTimerNode = &pTimeWheel->nodes[index];
+	void* ptr = pTimerNode->ptr;
+	timewheel_Unlink(pTimeWheel, index);
+	if (++pTimerNode->generation == 0) {
+		pTimerNode->generation = 1;
+	}
+	pTimerNode->next = pTimeWheel->freeNode;
+	pTimeWheel->freeNode = index;
+	pTimeWheel->count--;
+	return ptr;
+}
+
+/*
+Returns the handle of the timer, 0 is never a handle.
+now is the caller's millisecond, an empty wheel jumps to it so an idle period is not stepped through.
+*/
+unsigned long long plg_TimeWheelAdd(void* pvTimeWheel, unsigned long long now, unsigned long long milli, void* ptr) {
+
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	if (pTimeWheel->count == 0 && now > pTimeWheel->current) {
+		pTimeWheel->current = now;
+	}
+
+	if (pTimeWheel->freeNode == TW_NIL) {
+		unsigned int size = pTimeWheel->nodeSize ? pTimeWheel->nodeSize * 2 : 64;
+		pTimeWheel->nodes = realloc(pTimeWheel->nodes, size * sizeof(TimerNode));
+		for (unsigned int l = size; l > pTimeWheel->nodeSize; l--) {
+			pTimeWheel->nodes[l - 1].slot = TW_NIL;
+			pTimeWheel->nodes[l - 1].generation = 1;
+			pTimeWheel->nodes[l - 1].next = pTimeWheel->freeNode;
+			pTimeWheel->freeNode = l - 1;
+		}
+		pTimeWheel->nodeSize = size;
+	}
+
+	unsigned int index = pTimeWheel->freeNode;
+	PTimerNode pTimerNode = &pTimeWheel->nodes[index];
+	pTimeWheel->freeNode = pTimerNode->next;
+	pTimerNode->expire = milli;
+	pTimerNode->ptr = ptr;
+	timewheel_Link(pTimeWheel, index);
+	pTimeWheel->count++;
+
+	return ((unsigned long long)pTimerNode->generation << 32) | index;
+}
+
+/*
+Returns the ptr of the timer, 0 if it has already run or been cancelled.
+*/
+void* plg_TimeWheelCancel(void* pvTimeWheel, unsigned long long timerHandle) {
+
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	unsigned int index = timerHandle & TW_NIL;
+	if (index >= pTimeWheel->nodeSize) {
+		return 0;
+	}
+
+	PTimerNode pTimerNode = &pTimeWheel->nodes[index];
+	if (pTimerNode->slot == TW_NIL || pTimerNode->generation != (unsigned int)(timerHandle >> 32)) {
+		return 0;
+	}
+	return timewheel_FreeNode(pTimeWheel, index);
+}
+
+static unsigned int timewheel_Cascade(PTimeWheel pTimeWheel, unsigned int level) {
+
+	unsigned int index = (pTimeWheel->current >> (TW_ROOTBITS + (level - 1) * TW_LEVELBITS)) & (TW_LEVELSIZE - 1);
+	unsigned int slot = TW_ROOTSIZE + (level - 1) * TW_LEVELSIZE + index;
+	while (pTimeWheel->slot[slot] != TW_NIL) {
+		unsigned int node = pTimeWheel->slot[slot];
+		timewheel_Unlink(pTimeWheel, node);
+		timewheel_Link(pTimeWheel, node);
+	}
+	return index;
+}
+
+/*
+Run every timer up to and including milli.
+fun may add or cancel timers of the same wheel.
+*/
+unsigned int plg_TimeWheelExpire(void* pvTimeWheel, unsigned long long milli, TimeWheelFun fun, void* ctx) {
+
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	unsigned int count = 0;
+	while (pTimeWheel->current <= milli) {
+
+		if (pTimeWheel->count == 0) {
+			pTimeWheel->current = milli + 1;
+			break;
+		}
+
+		unsigned int index = pTimeWheel->current & (TW_ROOTSIZE - 1);
+		if (index == 0) {
+			for (unsigned int level = 1; level <= TW_LEVELS; level++) {
+				if (timewheel_Cascade(pTimeWheel, level) != 0) {
+					break;
+				}
+			}
+		}
+
+		pTimeWheel->current++;
+		while (pTimeWheel->slot[index] != TW_NIL) {
+			void* ptr = timewheel_FreeNode(pTimeWheel, pTimeWheel->slot[index]);
+			fun(ptr, ctx);
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+The millisecond the wheel has to run again, 0 if there is no timer.
+Beyond the root level it is the next cascade, so a far timer costs one wakeup per 256 ms.
+*/
+unsigned long long plg_TimeWheelNext(void* pvTimeWheel) {
+
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	if (pTimeWheel->count == 0) {
+		return 0;
+	}
+
+	unsigned long long tick = pTimeWheel->current;
+	do {
+		if (pTimeWheel->slot[tick & (TW_ROOTSIZE - 1)] != TW_NIL) {
+			return tick;
+		}
+		tick++;
+	} while (tick & (TW_ROOTSIZE - 1));
+	return tick;
+}
+
+unsigned int plg_TimeWheelCount(void* pvTimeWheel) {
+	PTimeWheel pTimeWheel = pvTimeWheel;
+	return pTimeWheel->count;
+}
@@ -0,0 +1,33 @@
+/* timewheel.h - Hierarchical timing wheel with millisecond ticks
+*
+* Copyright(C) 2019 - 2020, sun shuo <sun.shuo@surparallel.org>
+* All rights reserved.
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or(at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.If not, see < https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TIMEWHEEL_H
+#define __TIMEWHEEL_H
+
+typedef void(*TimeWheelFun)(void* ptr, void* ctx);
+
+void* plg_TimeWheelCreate(unsigned long long milli);
+void plg_TimeWheelDestroy(void* pTimeWheel, TimeWheelFun freeFun, void* ctx);
+unsigned long long plg_TimeWheelAdd(void* pTimeWheel, unsigned long long now, unsigned long long milli, void* ptr);
+void* plg_TimeWheelCancel(void* pTimeWheel, unsigned long long timerHandle);
+unsigned int plg_TimeWheelExpire(void* pTimeWheel, unsigned long long milli, TimeWheelFun fun, void* ctx);
+unsigned long long plg_TimeWheelNext(void* pTimeWheel);
+unsigned int plg_TimeWheelCount(void* pTimeWheel);
+
+#endif